@@ -2,34 +2,99 @@
 #define NOB_STRIP_PREFIX
 #define NOB_GRU_DELETE_OLD_BINARY
 #include "nob.h"
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
 
 #include "./src_build/flags.c"
+#include "./src/route_hash.h"
 typedef enum {
     BF_FORCE,
     BF_ASAN,
+    BF_ALL,
+    BF_RELEASE,
+    BF_PGO,
     BF_HELP,
     COUNT_BUILD_FLAGS
 } Build_Flag_Index;
-static_assert(COUNT_BUILD_FLAGS == 3, "Amount of build flags has changed");
+static_assert(COUNT_BUILD_FLAGS == 6, "Amount of build flags has changed");
 static Flag build_flags[COUNT_BUILD_FLAGS] = {
-    [BF_FORCE] = {.name = "-f",    .description = "Force full rebuild"},
-    [BF_ASAN]  = {.name = "-asan", .description = "Enable address sanitizer"},
-    [BF_HELP]  = {.name = "-h",    .description = "Print build flags"},
+    [BF_FORCE]   = {.name = "-f",       .description = "Force full rebuild"},
+    [BF_ASAN]    = {.name = "-asan",    .description = "Enable address sanitizer"},
+    [BF_ALL]     = {.name = "-all",     .description = "Build both with and without address sanitizer at once"},
+    [BF_RELEASE] = {.name = "-release", .description = "Build optimized tore-release with link time optimization"},
+    [BF_PGO]     = {.name = "-pgo",     .description = "Build tore-pgo optimized with the profile of the recorded workload"},
+    [BF_HELP]    = {.name = "-h",       .description = "Print build flags"},
 };
 
 // Folder must end with forward slash /
 #define BUILD_FOLDER "./build/"
 #define SRC_FOLDER "./src/"
 #define SRC_BUILD_FOLDER "./src_build/"
+#define TESTS_FOLDER "./tests/"
 #define GIT_HASH_FILE BUILD_FOLDER"git-hash.txt"
-#define TORE_BIN_PATH (build_flags[BF_ASAN].value ? BUILD_FOLDER"tore-asan" : BUILD_FOLDER"tore")
-#define SQLITE3_OBJ_PATH (build_flags[BF_ASAN].value ? BUILD_FOLDER"sqlite3-asan.o" : BUILD_FOLDER"sqlite3.o")
+#define BUNDLE_BIN_PATH BUILD_FOLDER"bundle.bin"
+#define BUNDLE_ASM_PATH BUILD_FOLDER"bundle.S"
+#define BUNDLE_OBJ_PATH BUILD_FOLDER"bundle.o"
+// The profile of the instrumented tore running the workload, see collect_profile()
+#define PGO_FOLDER BUILD_FOLDER"pgo/"
+#define PGO_PROFILE_PATH BUILD_FOLDER"tore.profdata"
+// See the usage of `./nob test`
+#define TEST_BIN_PATH BUILD_FOLDER"tore-test"
+
+// Every variant of tore is linked with its own build of SQLite, so the optimizations apply to both.
+// The variants starting from VARIANT_RELEASE are optimized with LTO.
+typedef enum {
+    VARIANT_DEBUG,
+    VARIANT_ASAN,
+    VARIANT_RELEASE,
+    VARIANT_INSTRUMENTED, // VARIANT_RELEASE that records where it spends its time for VARIANT_PGO
+    VARIANT_PGO,
+    COUNT_VARIANTS,
+} Build_Variant;
+
+static const char *variant_suffixes[COUNT_VARIANTS] = {
+    [VARIANT_DEBUG]        = "",
+    [VARIANT_ASAN]         = "-asan",
+    [VARIANT_RELEASE]      = "-release",
+    [VARIANT_INSTRUMENTED] = "-instrumented",
+    [VARIANT_PGO]          = "-pgo",
+};
+
+const char *tore_bin_path(Build_Variant variant)
+{
+    return temp_sprintf(BUILD_FOLDER"tore%s", variant_suffixes[variant]);
+}
+
+const char *sqlite3_obj_path(Build_Variant variant)
+{
+    return temp_sprintf(BUILD_FOLDER"sqlite3%s.o", variant_suffixes[variant]);
+}
 
 #define builder_compiler(cmd) cmd_append(cmd, "clang")
 
 
-void builder_common_flags(Cmd *cmd){
-    if (build_flags[BF_ASAN].value) cmd_append(cmd, "-fsanitize=address");
+void builder_common_flags(Cmd *cmd, Build_Variant variant){
+    switch (variant) {
+    case VARIANT_DEBUG: break;
+    case VARIANT_ASAN: {
+        cmd_append(cmd, "-fsanitize=address");
+    } break;
+    case VARIANT_RELEASE: {
+        cmd_append(cmd, "-O2", "-flto");
+    } break;
+    case VARIANT_INSTRUMENTED: {
+        cmd_append(cmd, "-O2", "-flto", "-fprofile-instr-generate");
+    } break;
+    case VARIANT_PGO: {
+        cmd_append(cmd, "-O2", "-flto", "-fprofile-instr-use="PGO_PROFILE_PATH);
+    } break;
+    case COUNT_VARIANTS:
+    default: UNREACHABLE("builder_common_flags");
+    }
     cmd_append(cmd,
             "-Wall",
             "-Wextra",
@@ -42,23 +107,304 @@ void builder_common_flags(Cmd *cmd){
 #define builder_output(cmd, output_path) cmd_append(cmd, "-o", (output_path))
 #define builder_inputs(cmd, ...) cmd_append(cmd, __VA_ARGS__)
 
-bool build_sqlite3(Nob_Cmd *cmd){
-    const char *output_path = SQLITE3_OBJ_PATH;
-    const char *input_path = SRC_FOLDER"sqlite-amalgamation-3460100/sqlite3.c";
-    int rebuild_is_needed = nob_needs_rebuild1(output_path, input_path);
+// The features of SQLite tore relies on. tore.c is compiled with them too, because some of them
+// (like the session extension for `tore sync`) are only declared in sqlite3.h when enabled.
+#define SQLITE3_FEATURES "-DSQLITE_ENABLE_FTS5", "-DSQLITE_ENABLE_SESSION", "-DSQLITE_ENABLE_PREUPDATE_HOOK"
+
+// The build is a small graph of steps. Every step starts once all its dependencies are done, so
+// the long compilation of the SQLite amalgamation runs in parallel with everything else and only
+// the final link of tore waits for it.
+//
+// A step is skipped if its command is the same as the last time and none of its inputs changed
+// since then. The command is saved next to the output with BUILD_STAMP_SUFFIX and the modification
+// time of that file is when the step was last done. The outputs themselves are replaced only if
+// their content changes, so a step that produces the same output again does not trigger the steps
+// that depend on it. With nothing changed ./nob only runs git rev-parse and regenerates the bundle
+// in memory.
+//
+// A run step is always done too, unless it is given a stamp upfront. Then it is skipped the same way
+// when the stamp and the inputs are unchanged.
+typedef enum {
+    STEP_PENDING,
+    STEP_RUNNING,
+    STEP_DONE,
+    STEP_FAILED,
+} Build_Step_State;
+
+#define BUILD_STEP_MAX_DEPS 8
+#define BUILD_STEP_MAX_INPUTS 4
+#define BUILD_STAMP_SUFFIX ".cmd"
+
+typedef struct Build_Step Build_Step;
+struct Build_Step {
+    const char *name;
+    // Appends the command that writes tmp_output to cmd
+    void (*command)(Build_Step *step, Cmd *cmd);
+    bool stdout_is_output; // the command prints the output instead of writing it
+    // Writes tmp_output without running any command
+    bool (*run)(Build_Step *step);
+    const char *input;
+    const char *extra_inputs[BUILD_STEP_MAX_INPUTS]; // besides input and the outputs of the dependencies
+    // Steps write their output into tmp_output and it replaces output once the step succeeds, so
+    // neither an interrupted build nor another nob building the other variant at the same time ever
+    // sees a half-written file.
+    const char *output;
+    const char *tmp_output;
+    Build_Variant variant;
+    bool always;    // the command is run even if nothing changed, like asking git for the hash
+    bool optional;  // if it fails the output is empty and the build goes on
+    size_t deps[BUILD_STEP_MAX_DEPS];
+    size_t deps_count;
+
+    Build_Step_State state;
+    Proc proc;
+    const char *stamp; // the rendered command, or whatever a run step is given upfront
+    double started_at;
+    double finished_at;
+    size_t gated_by;  // the dependency that finished last, or the step itself if it had none
+};
+
+typedef struct {
+    Build_Step *items;
+    size_t count;
+    size_t capacity;
+} Build_Steps;
+
+double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+const char *tmp_path_of(const char *path)
+{
+    return temp_sprintf("%s.%d.tmp", path, (int)getpid());
+}
+
+size_t build_step(Build_Steps *steps, Build_Step step)
+{
+    if (step.output) step.tmp_output = tmp_path_of(step.output);
+    da_append(steps, step);
+    return steps->count - 1;
+}
+
+void build_step_depends(Build_Steps *steps, size_t step, size_t dep)
+{
+    Build_Step *it = &steps->items[step];
+    assert(it->deps_count < BUILD_STEP_MAX_DEPS);
+    it->deps[it->deps_count++] = dep;
+}
+
+// Replaces path with tmp_path unless they are the same, in which case path keeps its modification
+// time and nothing that depends on it is rebuilt.
+bool replace_if_changed(const char *tmp_path, const char *path)
+{
+    bool result = true;
+    String_Builder old_content = {0};
+    String_Builder new_content = {0};
+    if (file_exists(path) == 1) {
+        if (!read_entire_file(path, &old_content)) return_defer(false);
+        if (!read_entire_file(tmp_path, &new_content)) return_defer(false);
+        if (old_content.count == new_content.count && memcmp(old_content.items, new_content.items, old_content.count) == 0) {
+            if (!delete_file(tmp_path)) return_defer(false);
+            return_defer(true);
+        }
+    }
+    if (!rename(tmp_path, path)) return_defer(false);
+defer:
+    free(old_content.items);
+    free(new_content.items);
+    return result;
+}
+
+int build_step_needs_rebuild(Build_Steps *steps, Build_Step *step)
+{
+    if (build_flags[BF_FORCE].value || step->always) return 1;
+    String_Builder stamp = {0};
+    if (file_exists(step->output) != 1 || file_exists(temp_sprintf("%s"BUILD_STAMP_SUFFIX, step->output)) != 1) return 1;
+    if (!read_entire_file(temp_sprintf("%s"BUILD_STAMP_SUFFIX, step->output), &stamp)) return -1;
+    bool same_command = stamp.count == strlen(step->stamp) && memcmp(stamp.items, step->stamp, stamp.count) == 0;
+    free(stamp.items);
+    if (!same_command) return 1;
+
+    const char *inputs[1 + BUILD_STEP_MAX_INPUTS + BUILD_STEP_MAX_DEPS];
+    size_t inputs_count = 0;
+    if (step->input) inputs[inputs_count++] = step->input;
+    for (size_t i = 0; i < BUILD_STEP_MAX_INPUTS && step->extra_inputs[i]; ++i) inputs[inputs_count++] = step->extra_inputs[i];
+    for (size_t i = 0; i < step->deps_count; ++i) inputs[inputs_count++] = steps->items[step->deps[i]].output;
+    return needs_rebuild(temp_sprintf("%s"BUILD_STAMP_SUFFIX, step->output), inputs, inputs_count);
+}
+
+// Starts the step. Leaves step->proc invalid if it is already done.
+bool build_step_start(Build_Steps *steps, Build_Step *step, Cmd *cmd)
+{
+    step->proc = INVALID_PROC;
+    if (step->run) {
+        if (step->stamp) {
+            int rebuild_is_needed = build_step_needs_rebuild(steps, step);
+            if (rebuild_is_needed < 0) return false;
+            if (!rebuild_is_needed) {
+                nob_log(INFO, "%s is up to date", step->output);
+                return true;
+            }
+        }
+        return step->run(step);
+    }
+
+    // The stamp is rendered with the final output path, because the temporary one differs every time
+    const char *tmp_output = step->tmp_output;
+    step->tmp_output = step->output;
+    cmd->count = 0;
+    step->command(step, cmd);
+    String_Builder rendered = {0};
+    cmd_render(*cmd, &rendered);
+    sb_append_null(&rendered);
+    step->stamp = temp_strdup(rendered.items);
+    free(rendered.items);
+    step->tmp_output = tmp_output;
+    cmd->count = 0;
+    step->command(step, cmd);
+
+    int rebuild_is_needed = build_step_needs_rebuild(steps, step);
     if (rebuild_is_needed < 0) return false;
-    if (rebuild_is_needed || build_flags[BF_FORCE].value) {
-        // NOTE: We are omitting extension loading because it depends on dlopen which prevents us from makeing tore statically linked
-        builder_compiler(cmd);
-        builder_common_flags(cmd);
-        cmd_append(cmd, "-DSQLITE_OMIT_LOAD_EXTENSION", "-O3", "-c");
-        builder_output(cmd, output_path);
-        builder_inputs(cmd, input_path);
-        if (!nob_cmd_run_sync_and_reset(cmd)) return false;
+    if (!rebuild_is_needed) {
+        nob_log(INFO, "%s is up to date", step->output);
+        return true;
+    }
+
+    if (step->stdout_is_output) {
+        Fd fdout = fd_open_for_write(step->tmp_output);
+        if (fdout == INVALID_FD) return false;
+        step->proc = cmd_run_async_redirect_and_reset(cmd, (Nob_Cmd_Redirect) {
+            .fdout = &fdout,
+        });
     } else {
-        nob_log(NOB_INFO, "%s is up to date", output_path);
+        step->proc = cmd_run_async_and_reset(cmd);
     }
-    return true;
+    return step->proc != INVALID_PROC;
+}
+
+bool build_step_finish(Build_Step *step, bool ok)
+{
+    step->finished_at = now_secs();
+    if (!ok && step->optional) {
+        nob_log(WARNING, "%s failed, going on without it", step->name);
+        ok = write_entire_file(step->tmp_output, "", 0);
+    }
+    if (ok && step->tmp_output && file_exists(step->tmp_output) == 1) {
+        ok = replace_if_changed(step->tmp_output, step->output);
+        if (ok && step->stamp && !step->always) {
+            ok = write_entire_file(temp_sprintf("%s"BUILD_STAMP_SUFFIX, step->output), step->stamp, strlen(step->stamp));
+        }
+    }
+    if (!ok && step->tmp_output && file_exists(step->tmp_output) == 1) delete_file(step->tmp_output);
+    step->state = ok ? STEP_DONE : STEP_FAILED;
+    return ok;
+}
+
+void append_critical_path(String_Builder *sb, Build_Steps *steps, size_t last)
+{
+    Build_Step *it = &steps->items[last];
+    if (it->gated_by != last) {
+        append_critical_path(sb, steps, it->gated_by);
+        sb_append_cstr(sb, " -> ");
+    }
+    sb_append_cstr(sb, temp_sprintf("%s %.3fs", it->name, it->finished_at - it->started_at));
+}
+
+// Runs the steps in the order of their dependencies with as many of them in parallel as possible.
+// Once a step fails no new ones are started, but the running ones are waited for.
+bool run_build_steps(Build_Steps *steps)
+{
+    bool result = true;
+    Cmd cmd = {0};
+    size_t running = 0;
+    size_t finished = 0;
+    double build_started_at = now_secs();
+
+    while (running > 0 || (result && finished < steps->count)) {
+        bool progress = false;
+        for (size_t i = 0; result && i < steps->count; ++i) {
+            Build_Step *it = &steps->items[i];
+            if (it->state != STEP_PENDING) continue;
+            bool ready = true;
+            it->gated_by = i;
+            for (size_t j = 0; j < it->deps_count && ready; ++j) {
+                Build_Step *dep = &steps->items[it->deps[j]];
+                ready = dep->state == STEP_DONE;
+                if (ready && (it->gated_by == i || dep->finished_at > steps->items[it->gated_by].finished_at)) {
+                    it->gated_by = it->deps[j];
+                }
+            }
+            if (!ready) continue;
+
+            it->started_at = now_secs();
+            if (!build_step_start(steps, it, &cmd)) {
+                if (!build_step_finish(it, false)) result = false;
+                finished += 1;
+            } else if (it->proc == INVALID_PROC) {
+                if (!build_step_finish(it, true)) result = false;
+                finished += 1;
+            } else {
+                it->state = STEP_RUNNING;
+                running += 1;
+            }
+            progress = true;
+        }
+        if (progress || running == 0) continue;
+
+        int wstatus = 0;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            nob_log(ERROR, "Could not wait on the build steps: %s", strerror(errno));
+            return_defer(false);
+        }
+        for (size_t i = 0; i < steps->count; ++i) {
+            Build_Step *it = &steps->items[i];
+            if (it->state != STEP_RUNNING || it->proc != pid) continue;
+            bool ok = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+            if (!ok && !it->optional) {
+                if (WIFSIGNALED(wstatus)) {
+                    nob_log(ERROR, "%s was terminated by %s", it->name, strsignal(WTERMSIG(wstatus)));
+                } else {
+                    nob_log(ERROR, "%s exited with exit code %d", it->name, WEXITSTATUS(wstatus));
+                }
+            }
+            if (!build_step_finish(it, ok)) result = false;
+            running -= 1;
+            finished += 1;
+            break;
+        }
+    }
+    if (!result) return_defer(false);
+
+    // The critical path is the chain of the steps that kept each other waiting, going back from the
+    // step that finished last. Making anything outside of it faster does not make the build faster.
+    size_t last = 0;
+    for (size_t i = 0; i < steps->count; ++i) {
+        if (steps->items[i].finished_at > steps->items[last].finished_at) last = i;
+    }
+    String_Builder path = {0};
+    append_critical_path(&path, steps, last);
+    sb_append_null(&path);
+    nob_log(INFO, "Built in %.3fs. Critical path: %s", now_secs() - build_started_at, path.items);
+    free(path.items);
+
+defer:
+    free(cmd.items);
+    return result;
+}
+
+void command_sqlite3(Build_Step *step, Cmd *cmd)
+{
+    // NOTE: We are omitting extension loading because it depends on dlopen which prevents us from makeing tore statically linked
+    // NOTE: FTS5 backs `tore search` and the session extension `tore sync`.
+    builder_compiler(cmd);
+    builder_common_flags(cmd, step->variant);
+    cmd_append(cmd, "-DSQLITE_OMIT_LOAD_EXTENSION", SQLITE3_FEATURES, "-O3", "-c");
+    builder_output(cmd, step->tmp_output);
+    builder_inputs(cmd, step->input);
 }
 
 bool set_environment_variable(const char *name, const char *value)
@@ -71,18 +417,33 @@ bool set_environment_variable(const char *name, const char *value)
     return true;
 }
 
-char *get_git_hash(Cmd *cmd)
+bool program_in_path(const char *program)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL) path = "/usr/bin:/bin";
+    String_View dirs = sv_from_cstr(path);
+    while (dirs.count > 0) {
+        String_View dir = sv_chop_by_delim(&dirs, ':');
+        if (dir.count == 0) dir = sv_from_cstr(".");
+        if (access(temp_sprintf(SV_Fmt"/%s", SV_Arg(dir), program), X_OK) == 0) return true;
+    }
+    return false;
+}
+
+void command_git_hash(Build_Step *step, Cmd *cmd)
+{
+    UNUSED(step);
+    cmd_append(cmd, "git", "rev-parse", "HEAD");
+}
+
+// NULL if command_git_hash() failed, for instance outside of a git repo
+char *read_git_hash(void)
 {
     char *result = NULL;
     String_Builder sb = {0};
-    Fd fdout = fd_open_for_write(GIT_HASH_FILE);
-    if (fdout == INVALID_FD) return_defer(NULL);
-    cmd_append(cmd, "git", "rev-parse", "HEAD");
-    if (!cmd_run_sync_redirect_and_reset(cmd, (Nob_Cmd_Redirect) {
-        .fdout = &fdout
-    })) return_defer(NULL);
     if (!read_entire_file(GIT_HASH_FILE, &sb)) return_defer(NULL);
     while (sb.count > 0 && isspace(sb.items[sb.count - 1])) sb.count -= 1;
+    if (sb.count == 0) return_defer(NULL);
     sb_append_null(&sb);
     return_defer(sb.items);
 defer:
@@ -97,27 +458,294 @@ void usage(const char *program_name)
     print_flags(build_flags, COUNT_BUILD_FLAGS);
 }
 
-bool compile_template(Cmd *cmd, const char *src_path, const char *dst_path)
+int compare_cstrs(const void *a, const void *b)
 {
-    Fd index_fd = fd_open_for_write(dst_path);
-    if (index_fd == INVALID_FD) return false;;
-    cmd_append(cmd, BUILD_FOLDER"tt", src_path);
-    if (!cmd_run_sync_redirect_and_reset(cmd, (Nob_Cmd_Redirect) {
-        .fdout = &index_fd,
-    })) return false;;
-    return true;
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// Builds a program that runs during the build, like tt
+void command_tool(Build_Step *step, Cmd *cmd)
+{
+    // NOTE: the tools are shared by all the variants, so they are always built the debug way
+    builder_compiler(cmd);
+    builder_common_flags(cmd, VARIANT_DEBUG);
+    builder_output(cmd, step->tmp_output);
+    builder_inputs(cmd, step->input);
+}
+
+void command_template(Build_Step *step, Cmd *cmd)
+{
+    cmd_append(cmd, BUILD_FOLDER"tt", step->input);
 }
 
 typedef struct {
     const char *file_path;
     size_t offset;
     size_t size;
+    const char *content_type;
+    uint64_t hash;
+    size_t response_offset; // prerendered 200 response: headers immediately followed by the content
+    size_t response_size;
 } Resource;
 
-Resource resources[] = {
-    { .file_path = "./resources/images/tore.png" },
+typedef struct {
+    Resource *items;
+    size_t count;
+    size_t capacity;
+} Resources;
+
+// All the files in these folders (recursively) are bundled into tore. Every resource is also
+// served by the Web Server under its file path without the leading dot.
+// Folder must end with forward slash /
+const char *resource_folders[] = {
+    "./resources/",
+};
+
+Resources resources = {0};
+
+bool collect_resources(const char *folder)
+{
+    bool result = true;
+    File_Paths children = {0};
+    if (!read_entire_dir(folder, &children)) return_defer(false);
+    qsort(children.items, children.count, sizeof(*children.items), compare_cstrs);
+    for (size_t i = 0; i < children.count; ++i) {
+        if (*children.items[i] == '.') continue;
+        const char *child_path = temp_sprintf("%s%s", folder, children.items[i]);
+        File_Type type = get_file_type(child_path);
+        switch (type) {
+        case FILE_REGULAR: {
+            da_append(&resources, ((Resource) { .file_path = child_path }));
+        } break;
+        case FILE_DIRECTORY: {
+            if (!collect_resources(temp_sprintf("%s/", child_path))) return_defer(false);
+        } break;
+        case FILE_SYMLINK:
+        case FILE_OTHER: {
+            nob_log(WARNING, "Skipping %s: not a regular file", child_path);
+        } break;
+        default: UNREACHABLE("collect_resources");
+        }
+    }
+defer:
+    free(children.items);
+    return result;
+}
+
+uint64_t fnv1a64(const char *data, size_t count)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < count; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+typedef struct {
+    const char *extension;
+    const char *content_type;
+} Content_Type;
+
+Content_Type content_types[] = {
+    { .extension = ".png",   .content_type = "image/png"              },
+    { .extension = ".svg",   .content_type = "image/svg+xml"          },
+    { .extension = ".ico",   .content_type = "image/x-icon"           },
+    { .extension = ".html",  .content_type = "text/html"              },
+    { .extension = ".css",   .content_type = "text/css"               },
+    { .extension = ".js",    .content_type = "text/javascript"        },
+    { .extension = ".json",  .content_type = "application/json"       },
+    { .extension = ".txt",   .content_type = "text/plain"             },
+    { .extension = ".woff2", .content_type = "font/woff2"             },
+};
+
+const char *content_type_of_file(const char *file_path)
+{
+    for (size_t i = 0; i < NOB_ARRAY_LEN(content_types); ++i) {
+        if (sv_end_with(sv_from_cstr(file_path), content_types[i].extension)) {
+            return content_types[i].content_type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+typedef struct {
+    const char *id; // suffix of the generated CANNED_* constant
+    int code;
+    const char *name;
+    size_t offset;
+    size_t size;
+} Canned_Response;
+
+// Fixed responses of the Web Server that are prerendered at build time and served as is
+Canned_Response canned_responses[] = {
+    { .id = "BAD_REQUEST",              .code = 400, .name = "Bad Request" },
+    { .id = "NOT_FOUND",                .code = 404, .name = "Not Found" },
+    { .id = "REQUEST_ENTITY_TOO_LARGE", .code = 413, .name = "Request Entity Too Large" },
+    { .id = "INTERNAL_SERVER_ERROR",    .code = 500, .name = "Internal Server Error" },
 };
 
+#define ERROR_PAGE_BIN_PATH BUILD_FOLDER"error_page"
+
+// Renders the error page with the error_page tool, which is error_page.h.tt compiled by tt
+bool render_error_page(String_Builder *sb, int code, const char *name)
+{
+    bool result = true;
+    Cmd cmd = {0};
+    const char *page_path = tmp_path_of(BUILD_FOLDER"error_page.html");
+    Fd fdout = fd_open_for_write(page_path);
+    if (fdout == INVALID_FD) return_defer(false);
+    cmd_append(&cmd, ERROR_PAGE_BIN_PATH, temp_sprintf("%d", code), name);
+    if (!cmd_run_sync_redirect_and_reset(&cmd, (Nob_Cmd_Redirect) { .fdout = &fdout })) return_defer(false);
+    if (!read_entire_file(page_path, sb)) return_defer(false);
+defer:
+    if (file_exists(page_path) == 1) delete_file(page_path);
+    free(cmd.items);
+    return result;
+}
+
+// Routes of the Web Server. Exactly one of handler, resource or canned must be set.
+typedef struct {
+    const char *uri;
+    const char *handler;  // suffix of the generated ROUTE_* constant that tore dispatches on
+    const char *resource; // file path of the resource to serve
+    const char *canned;   // id of the canned response to serve
+} Route;
+
+Route routes[] = {
+    { .uri = "/",            .handler  = "INDEX" },
+    { .uri = "/search",      .handler  = "SEARCH" },
+    { .uri = "/calendar",    .handler  = "CALENDAR" },
+    { .uri = "/metrics",     .handler  = "METRICS" },
+    { .uri = "/favicon.ico", .resource = "./resources/images/tore.png" },
+    { .uri = "/urmom",       .canned   = "REQUEST_ENTITY_TOO_LARGE" },
+};
+
+typedef struct {
+    const char *uri;
+    const char *kind;
+    size_t offset;
+    size_t size;
+    uint64_t hash; // the ETag of a resource, 0 for everything else
+} Route_Slot;
+
+typedef struct {
+    Route_Slot *items;
+    size_t count;
+    size_t capacity;
+} Route_Slots;
+
+bool find_canned_response(const char *id, Canned_Response **canned)
+{
+    for (size_t i = 0; i < NOB_ARRAY_LEN(canned_responses); ++i) {
+        if (strcmp(canned_responses[i].id, id) == 0) {
+            *canned = &canned_responses[i];
+            return true;
+        }
+    }
+    nob_log(ERROR, "Unknown canned response %s", id);
+    return false;
+}
+
+bool find_resource(const char *file_path, Resource **resource)
+{
+    for (size_t i = 0; i < resources.count; ++i) {
+        if (strcmp(resources.items[i].file_path, file_path) == 0) {
+            *resource = &resources.items[i];
+            return true;
+        }
+    }
+    nob_log(ERROR, "Unknown resource %s", file_path);
+    return false;
+}
+
+// Collects all the routes (explicit ones and the ones of the resources) and lays them out
+// into a table of power of two size with a seed for route_hash() that makes it collision-free.
+bool build_routes_table(Route_Slots *table, uint32_t *seed)
+{
+    bool result = true;
+    Route_Slots slots = {0};
+
+    for (size_t i = 0; i < resources.count; ++i) {
+        da_append(&slots, ((Route_Slot) {
+            .uri = resources.items[i].file_path + 1,
+            .kind = "STATIC",
+            .offset = resources.items[i].response_offset,
+            .size = resources.items[i].response_size,
+            .hash = resources.items[i].hash,
+        }));
+    }
+    for (size_t i = 0; i < NOB_ARRAY_LEN(routes); ++i) {
+        Route *it = &routes[i];
+        assert(!!it->handler + !!it->resource + !!it->canned == 1);
+        Route_Slot slot = { .uri = it->uri, .kind = "STATIC" };
+        if (it->handler) {
+            slot.kind = it->handler;
+        } else if (it->resource) {
+            Resource *resource = NULL;
+            if (!find_resource(it->resource, &resource)) return_defer(false);
+            slot.offset = resource->response_offset;
+            slot.size = resource->response_size;
+            slot.hash = resource->hash;
+        } else {
+            Canned_Response *canned = NULL;
+            if (!find_canned_response(it->canned, &canned)) return_defer(false);
+            slot.offset = canned->offset;
+            slot.size = canned->size;
+        }
+        da_append(&slots, slot);
+    }
+    for (size_t i = 0; i < slots.count; ++i) {
+        for (size_t j = i + 1; j < slots.count; ++j) {
+            if (strcmp(slots.items[i].uri, slots.items[j].uri) == 0) {
+                nob_log(ERROR, "Route %s is defined more than once", slots.items[i].uri);
+                return_defer(false);
+            }
+        }
+    }
+
+    size_t capacity = 1;
+    while (capacity < 2*slots.count) capacity *= 2;
+    for (;;) {
+        table->items = realloc(table->items, capacity*sizeof(*table->items));
+        assert(table->items != NULL && "Buy more RAM lol");
+        table->capacity = capacity;
+        for (*seed = 0; *seed < 100000; ++*seed) {
+            memset(table->items, 0, capacity*sizeof(*table->items));
+            table->count = capacity;
+            bool collision = false;
+            for (size_t i = 0; i < slots.count && !collision; ++i) {
+                Route_Slot *slot = &table->items[route_hash(slots.items[i].uri, strlen(slots.items[i].uri), *seed) & (capacity - 1)];
+                if (slot->uri) {
+                    collision = true;
+                } else {
+                    *slot = slots.items[i];
+                }
+            }
+            if (!collision) return_defer(true);
+        }
+        capacity *= 2;
+    }
+
+defer:
+    free(slots.items);
+    return result;
+}
+
+// Every byte is written as a \x escape, the same way tt writes the text of the templates, so
+// nothing in a file path can break out of the literal.
+const char *c_string_literal_temp(const char *cstr)
+{
+    size_t n = strlen(cstr);
+    char *result = temp_alloc(n*4 + 3);
+    char *p = result;
+    *p++ = '"';
+    for (size_t i = 0; i < n; ++i) p += sprintf(p, "\\x%02x", (unsigned char)cstr[i]);
+    *p++ = '"';
+    *p = '\0';
+    return result;
+}
+
 #define genf(out, ...) \
     do { \
         fprintf((out), __VA_ARGS__); \
@@ -125,31 +753,84 @@ Resource resources[] = {
     } while(0)
 
 
-bool generate_resource_bundle(void)
+// The content of the bundle is written into a binary file that is pulled into an object file
+// with the .incbin assembler directive, so the compilation time of tore does not depend on the
+// size of the resources. bundle.h only contains the index into it.
+bool generate_resource_bundle(Build_Step *step)
 {
     bool result = true;
     Nob_String_Builder bundle = {0};
     Nob_String_Builder content = {0};
+    Route_Slots routes_table = {0};
+    uint32_t routes_seed = 0;
     FILE *out = NULL;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    // bundle  = [aaaaaaaaabbbbb]
-    //            ^        ^
-    // content = []
-    // 0, 9
+    resources.count = 0;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(resource_folders); ++i) {
+        if (!collect_resources(resource_folders[i])) nob_return_defer(false);
+    }
 
-    for (size_t i = 0; i < NOB_ARRAY_LEN(resources); ++i) {
+    for (size_t i = 0; i < resources.count; ++i) {
+        Resource *it = &resources.items[i];
         content.count = 0;
-        if (!nob_read_entire_file(resources[i].file_path, &content)) nob_return_defer(false);
-        resources[i].offset = bundle.count;
-        resources[i].size = content.count;
+        if (!nob_read_entire_file(it->file_path, &content)) nob_return_defer(false);
+        it->content_type = content_type_of_file(it->file_path);
+        it->hash = fnv1a64(content.items, content.count);
+        it->response_offset = bundle.count;
+        sb_append_cstr(&bundle, "HTTP/1.0 200 OK\r\n");
+        sb_append_cstr(&bundle, temp_sprintf("Content-Type: %s\r\n", it->content_type));
+        sb_append_cstr(&bundle, temp_sprintf("Content-Length: %zu\r\n", content.count));
+        sb_append_cstr(&bundle, temp_sprintf("ETag: \"%016llx\"\r\n", (unsigned long long)it->hash));
+        sb_append_cstr(&bundle, "Connection: close\r\n");
+        sb_append_cstr(&bundle, "\r\n");
+        it->offset = bundle.count;
+        it->size = content.count;
         nob_da_append_many(&bundle, content.items, content.count);
+        it->response_size = bundle.count - it->response_offset;
         nob_da_append(&bundle, 0);
     }
 
-    const char *bundle_h_path = BUILD_FOLDER"bundle.h";
-    out = fopen(bundle_h_path, "wb");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(canned_responses); ++i) {
+        Canned_Response *it = &canned_responses[i];
+        content.count = 0;
+        if (!render_error_page(&content, it->code, it->name)) nob_return_defer(false);
+        it->offset = bundle.count;
+        sb_append_cstr(&bundle, temp_sprintf("HTTP/1.0 %d %s\r\n", it->code, it->name));
+        sb_append_cstr(&bundle, "Content-Type: text/html\r\n");
+        sb_append_cstr(&bundle, temp_sprintf("Content-Length: %zu\r\n", content.count));
+        sb_append_cstr(&bundle, "Connection: close\r\n");
+        sb_append_cstr(&bundle, "\r\n");
+        nob_da_append_many(&bundle, content.items, content.count);
+        it->size = bundle.count - it->offset;
+    }
+
+    if (!build_routes_table(&routes_table, &routes_seed)) nob_return_defer(false);
+
+    if (!write_entire_file(tmp_path_of(BUNDLE_BIN_PATH), bundle.items, bundle.count)) nob_return_defer(false);
+    if (!replace_if_changed(tmp_path_of(BUNDLE_BIN_PATH), BUNDLE_BIN_PATH)) nob_return_defer(false);
+
+    out = fopen(tmp_path_of(BUNDLE_ASM_PATH), "wb");
+    if (out == NULL) {
+        nob_log(NOB_ERROR, "Could not open file %s for writing: %s", BUNDLE_ASM_PATH, strerror(errno));
+        nob_return_defer(false);
+    }
+    genf(out, "    .section .rodata");
+    genf(out, "    .global bundle");
+    genf(out, "    .type bundle, @object");
+    genf(out, "    .balign 16");
+    genf(out, "bundle:");
+    genf(out, "    .incbin \"%s\"", BUNDLE_BIN_PATH);
+    genf(out, "    .size bundle, . - bundle");
+    genf(out, "    .section .note.GNU-stack,\"\",@progbits");
+    fclose(out);
+    out = NULL;
+    if (!replace_if_changed(tmp_path_of(BUNDLE_ASM_PATH), BUNDLE_ASM_PATH)) nob_return_defer(false);
+
+    out = fopen(step->tmp_output, "wb");
     if (out == NULL) {
-        nob_log(NOB_ERROR, "Could not open file %s for writing: %s", bundle_h_path, strerror(errno));
+        nob_log(NOB_ERROR, "Could not open file %s for writing: %s", step->output, strerror(errno));
         nob_return_defer(false);
     }
 
@@ -157,41 +838,485 @@ bool generate_resource_bundle(void)
     genf(out, "#define BUNDLE_H_");
     genf(out, "typedef struct {");
     genf(out, "    const char *file_path;");
+    genf(out, "    const char *content_type;");
+    genf(out, "    uint64_t hash;");
     genf(out, "    size_t offset;");
     genf(out, "    size_t size;");
     genf(out, "} Resource;");
-    genf(out, "size_t resources_count = %zu;", NOB_ARRAY_LEN(resources));
+    genf(out, "size_t resources_count = %zu;", resources.count);
     genf(out, "Resource resources[] = {");
-    for (size_t i = 0; i < NOB_ARRAY_LEN(resources); ++i) {
-        genf(out, "    {.file_path = \"%s\", .offset = %zu, .size = %zu},",
-             resources[i].file_path, resources[i].offset, resources[i].size);
+    for (size_t i = 0; i < resources.count; ++i) {
+        Resource *it = &resources.items[i];
+        genf(out, "    {.file_path = %s, .content_type = %s, .hash = 0x%016llxull, .offset = %zu, .size = %zu},",
+             c_string_literal_temp(it->file_path), c_string_literal_temp(it->content_type), (unsigned long long)it->hash, it->offset, it->size);
     }
     genf(out, "};");
-
-    genf(out, "unsigned char bundle[] = {");
-    size_t row_size = 20;
-    for (size_t i = 0; i < bundle.count; ) {
-        fprintf(out, "     ");
-        for (size_t col = 0; col < row_size && i < bundle.count; ++col, ++i) {
-            fprintf(out, "0x%02X, ", (unsigned char)bundle.items[i]);
-        }
-        genf(out, "");
+    genf(out, "typedef enum {");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(canned_responses); ++i) {
+        genf(out, "    CANNED_%s,", canned_responses[i].id);
+    }
+    genf(out, "    COUNT_CANNED_RESPONSES,");
+    genf(out, "} Canned_Response_Id;");
+    genf(out, "typedef struct {");
+    genf(out, "    size_t offset;");
+    genf(out, "    size_t size;");
+    genf(out, "} Canned_Response;");
+    genf(out, "Canned_Response canned_responses[COUNT_CANNED_RESPONSES] = {");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(canned_responses); ++i) {
+        genf(out, "    [CANNED_%s] = {.offset = %zu, .size = %zu},",
+             canned_responses[i].id, canned_responses[i].offset, canned_responses[i].size);
     }
     genf(out, "};");
+    genf(out, "typedef enum {");
+    genf(out, "    ROUTE_NONE,");
+    genf(out, "    ROUTE_STATIC,");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(routes); ++i) {
+        if (routes[i].handler) genf(out, "    ROUTE_%s,", routes[i].handler);
+    }
+    genf(out, "    COUNT_ROUTE_KINDS,");
+    genf(out, "} Route_Kind;");
+    genf(out, "typedef struct {");
+    genf(out, "    const char *uri;");
+    genf(out, "    size_t uri_len;");
+    genf(out, "    Route_Kind kind;");
+    genf(out, "    size_t offset; // ROUTE_STATIC only: prerendered response in the bundle");
+    genf(out, "    size_t size;");
+    genf(out, "    uint64_t hash; // ROUTE_STATIC only: the ETag of a resource, 0 if it has none");
+    genf(out, "} Route;");
+    genf(out, "#define ROUTES_SEED %uu", routes_seed);
+    genf(out, "#define ROUTES_CAPACITY %zu", routes_table.count);
+    genf(out, "Route routes[ROUTES_CAPACITY] = {");
+    for (size_t i = 0; i < routes_table.count; ++i) {
+        Route_Slot *it = &routes_table.items[i];
+        if (it->uri == NULL) continue;
+        genf(out, "    [%zu] = {.uri = %s, .uri_len = %zu, .kind = ROUTE_%s, .offset = %zu, .size = %zu, .hash = 0x%016llxull},",
+             i, c_string_literal_temp(it->uri), strlen(it->uri), it->kind, it->offset, it->size, (unsigned long long)it->hash);
+    }
+    genf(out, "};");
+    genf(out, "// Defined in "BUNDLE_OBJ_PATH);
+    genf(out, "extern const unsigned char bundle[];");
+    genf(out, "#define BUNDLE_SIZE %zu", bundle.count);
     genf(out, "#endif // BUNDLE_H_");
 
-    nob_log(NOB_INFO, "Generated %s", bundle_h_path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec)*1000.0 + (end.tv_nsec - start.tv_nsec)/1000000.0;
+    nob_log(NOB_INFO, "Generated %s and %s: %zu resources, %zu bytes in %.3fms",
+            step->output, BUNDLE_BIN_PATH, resources.count, bundle.count, elapsed_ms);
 
 defer:
     if (out) fclose(out);
     free(content.items);
     free(bundle.items);
+    free(routes_table.items);
     return result;
 }
 
+void command_bundle_obj(Build_Step *step, Cmd *cmd)
+{
+    builder_compiler(cmd);
+    cmd_append(cmd, "-c");
+    builder_output(cmd, step->tmp_output);
+    builder_inputs(cmd, step->input);
+}
+
+void command_tore(Build_Step *step, Cmd *cmd)
+{
+    char *git_hash = read_git_hash();
+    builder_compiler(cmd);
+    builder_common_flags(cmd, step->variant);
+    if (step->variant != VARIANT_ASAN) cmd_append(cmd, "-static");
+    // The linker has to understand the LLVM bitcode the objects consist of with -flto
+    if (step->variant >= VARIANT_RELEASE) cmd_append(cmd, "-fuse-ld=lld");
+    cmd_append(cmd, SQLITE3_FEATURES);
+    if (git_hash) {
+        cmd_append(cmd, temp_sprintf("-DGIT_HASH=\"%s\"", git_hash));
+        free(git_hash);
+    } else {
+        cmd_append(cmd, temp_sprintf("-DGIT_HASH=\"Unknown\""));
+    }
+    builder_output(cmd, step->tmp_output);
+    builder_inputs(cmd, step->input, sqlite3_obj_path(step->variant), BUNDLE_OBJ_PATH);
+}
+
+// The recorded use of tore the profile for -pgo is collected on and `./nob bench` measures. It is
+// replayed against a synthetic database imported into a fresh home folder: every round goes through
+// the steps once while `tore serve` answers the requests from the same database.
+typedef struct {
+    const char *name;
+    const char *args[4]; // the arguments of tore
+    const char *uri;     // or the request to `tore serve`
+    size_t repeat;
+} Workload_Step;
+
+Workload_Step workload[] = {
+    { .name = "dismiss",          .args = {"dismiss", "0"} },
+    { .name = "checkout",         .args = {"checkout"} },
+    { .name = "checkout cached",  .args = {"checkout"} },
+    { .name = "calendar",         .args = {"calendar"} },
+    { .name = "search",           .args = {"search", "rent"} },
+    { .name = "remind",           .args = {"remind", "workload", "2031-01-31", "1m"} },
+    { .name = "GET /",            .uri = "/",              .repeat = 20 },
+    { .name = "GET /calendar",    .uri = "/calendar",      .repeat = 20 },
+    { .name = "GET /search",      .uri = "/search?q=rent", .repeat = 20 },
+    { .name = "GET /favicon.ico", .uri = "/favicon.ico",   .repeat = 20 },
+};
+
+#define WORKLOAD_ROUNDS 10
+#define WORKLOAD_REMINDERS 1000
+#define WORKLOAD_NOTIFICATIONS 5000
+#define WORKLOAD_SERVE_PORT 6971
+
+const char *workload_titles[] = {
+    "pay rent", "dentist", "water the plants", "renew the passport",
+    "call mom", "backup the laptop", "standup", "send the invoice",
+};
+
+// A different workload needs a new profile, so the profile step is stamped with this
+const char *workload_stamp_temp(void)
+{
+    String_Builder sb = {0};
+    sb_append_cstr(&sb, temp_sprintf("rounds=%d reminders=%d notifications=%d\n", WORKLOAD_ROUNDS, WORKLOAD_REMINDERS, WORKLOAD_NOTIFICATIONS));
+    for (size_t i = 0; i < NOB_ARRAY_LEN(workload); ++i) {
+        Workload_Step *it = &workload[i];
+        if (it->uri) {
+            sb_append_cstr(&sb, temp_sprintf("GET %s x%zu\n", it->uri, it->repeat));
+            continue;
+        }
+        for (size_t j = 0; j < NOB_ARRAY_LEN(it->args) && it->args[j]; ++j) {
+            sb_append_cstr(&sb, temp_sprintf("%s ", it->args[j]));
+        }
+        sb_append_cstr(&sb, "\n");
+    }
+    sb_append_null(&sb);
+    const char *result = temp_strdup(sb.items);
+    free(sb.items);
+    return result;
+}
+
+const char *workload_time_temp(time_t t, const char *format)
+{
+    char buffer[32];
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(buffer, sizeof(buffer), format, &tm);
+    return temp_strdup(buffer);
+}
+
+// Half of the reminders are due already, so the first checkout has plenty to fire off, and most of
+// the notifications are dismissed long ago, so search goes through a long history.
+bool generate_workload_data(const char *file_path)
+{
+    bool result = true;
+    String_Builder sb = {0};
+    time_t now = time(NULL);
+    const time_t day = 24*60*60;
+
+    for (size_t i = 0; i < WORKLOAD_REMINDERS; ++i) {
+        size_t checkpoint = temp_save();
+        time_t created_at = now - (time_t)(i%365 + 60)*day;
+        time_t scheduled_at = now + ((time_t)(i%120) - 60)*day;
+        sb_append_cstr(&sb, temp_sprintf("{\"type\":\"reminder\",\"title\":\"%s #%zu\",\"created_at\":\"%s\",\"scheduled_at\":\"%s\"",
+                                         workload_titles[i%NOB_ARRAY_LEN(workload_titles)], i,
+                                         workload_time_temp(created_at, "%Y-%m-%d %H:%M:%S"),
+                                         workload_time_temp(scheduled_at, "%Y-%m-%d")));
+        if (i%4 != 0) sb_append_cstr(&sb, temp_sprintf(",\"period\":\"%zu%c\"", i%6 + 1, "dwmy"[i/4%4]));
+        sb_append_cstr(&sb, "}\n");
+        temp_rewind(checkpoint);
+    }
+    for (size_t i = 0; i < WORKLOAD_NOTIFICATIONS; ++i) {
+        size_t checkpoint = temp_save();
+        const char *created_at = workload_time_temp(now - (time_t)(i%730)*day, "%Y-%m-%d %H:%M:%S");
+        sb_append_cstr(&sb, temp_sprintf("{\"type\":\"notification\",\"title\":\"%s #%zu\",\"created_at\":\"%s\"",
+                                         workload_titles[i%NOB_ARRAY_LEN(workload_titles)], i, created_at));
+        if (i%10 != 0) sb_append_cstr(&sb, temp_sprintf(",\"dismissed_at\":\"%s\"", created_at));
+        sb_append_cstr(&sb, "}\n");
+        temp_rewind(checkpoint);
+    }
+    if (!write_entire_file(file_path, sb.items, sb.count)) return_defer(false);
+defer:
+    free(sb.items);
+    return result;
+}
+
+// Deletes the regular files of the folder, which is everything the workload leaves behind
+bool clear_folder(const char *folder)
+{
+    bool result = true;
+    File_Paths children = {0};
+    if (!mkdir_if_not_exists(folder)) return_defer(false);
+    if (!read_entire_dir(folder, &children)) return_defer(false);
+    for (size_t i = 0; i < children.count; ++i) {
+        const char *child_path = temp_sprintf("%s%s", folder, children.items[i]);
+        if (get_file_type(child_path) == FILE_REGULAR && !delete_file(child_path)) return_defer(false);
+    }
+defer:
+    free(children.items);
+    return result;
+}
+
+int workload_connect(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool workload_wait_for_server(uint16_t port)
+{
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        int fd = workload_connect(port);
+        if (fd >= 0) {
+            close(fd);
+            return true;
+        }
+        struct timespec delay = { .tv_nsec = 10*1000*1000 };
+        nanosleep(&delay, NULL);
+    }
+    nob_log(ERROR, "tore serve is not listening on port %d", port);
+    return false;
+}
+
+bool workload_request(uint16_t port, const char *uri)
+{
+    bool result = true;
+    int fd = workload_connect(port);
+    if (fd < 0) {
+        nob_log(ERROR, "Could not connect to tore serve on port %d: %s", port, strerror(errno));
+        return false;
+    }
+    const char *request = temp_sprintf("GET %s HTTP/1.0\r\n\r\n", uri);
+    if (write(fd, request, strlen(request)) != (ssize_t)strlen(request)) {
+        nob_log(ERROR, "Could not send request GET %s: %s", uri, strerror(errno));
+        return_defer(false);
+    }
+    char buffer[4096];
+    ssize_t n = 0;
+    size_t received = 0;
+    bool ok = false;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (received == 0) ok = n >= 12 && memcmp(buffer + 8, " 200", 4) == 0;
+        received += n;
+    }
+    if (!ok) {
+        nob_log(ERROR, "GET %s did not respond with 200", uri);
+        return_defer(false);
+    }
+defer:
+    close(fd);
+    return result;
+}
+
+Fd fd_open_for_append(const char *path)
+{
+    Fd fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        nob_log(ERROR, "Could not open file %s: %s", path, strerror(errno));
+        return INVALID_FD;
+    }
+    return fd;
+}
+
+// Runs the command with everything it prints appended to the log, because some commands of tore print
+// the reminders into stderr. The command is only started if proc is not NULL.
+bool run_logged(Cmd *cmd, const char *log_path, Fd *fdin, Proc *proc)
+{
+    Fd fdout = fd_open_for_append(log_path);
+    Fd fderr = fd_open_for_append(log_path);
+    if (fdout == INVALID_FD || fderr == INVALID_FD) {
+        if (fdin) fd_close(*fdin);
+        if (fdout != INVALID_FD) fd_close(fdout);
+        if (fderr != INVALID_FD) fd_close(fderr);
+        cmd->count = 0;
+        return false;
+    }
+    Nob_Cmd_Redirect redirect = { .fdin = fdin, .fdout = &fdout, .fderr = &fderr };
+    if (proc) {
+        *proc = cmd_run_async_redirect_and_reset(cmd, redirect);
+        return *proc != INVALID_PROC;
+    }
+    return cmd_run_sync_redirect_and_reset(cmd, redirect);
+}
+
+// CPU time spent by the finished child processes so far
+double children_cpu_secs(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec*1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec*1e-6;
+}
+
+// Replays the workload with the given build of tore in a fresh home folder. Records how long a single run
+// of every step took on average in every round into timings unless it is NULL. The commands are measured
+// in the CPU time of their process, which the load of the machine and the disk barely affect. The requests
+// to `tore serve` can only be measured in wall time, because the server keeps running between them.
+bool run_workload(const char *tore_bin, const char *home, double timings[NOB_ARRAY_LEN(workload)][WORKLOAD_ROUNDS])
+{
+    bool result = true;
+    Cmd cmd = {0};
+    Proc server = INVALID_PROC;
+    Log_Level log_level = minimal_log_level;
+    char *old_home = getenv("HOME") ? strdup(getenv("HOME")) : NULL;
+
+    const char *current_dir = get_current_dir_temp();
+    if (current_dir == NULL) return_defer(false);
+    if (!clear_folder(home)) return_defer(false);
+    const char *data_path = temp_sprintf("%sworkload.jsonl", home);
+    const char *log_path = temp_sprintf("%sworkload.log", home);
+    if (!generate_workload_data(data_path)) return_defer(false);
+    if (!set_environment_variable("HOME", temp_sprintf("%s/%s", current_dir, home))) return_defer(false);
+
+    // Logging every one of the hundreds of commands would bury the rest of the build
+    minimal_log_level = WARNING;
+    Fd fdin = fd_open_for_read(data_path);
+    if (fdin == INVALID_FD) return_defer(false);
+    cmd_append(&cmd, tore_bin, "import");
+    if (!run_logged(&cmd, log_path, &fdin, NULL)) {
+        nob_log(ERROR, "Could not import the workload data, see %s", log_path);
+        return_defer(false);
+    }
+
+    cmd_append(&cmd, tore_bin, "serve", temp_sprintf("%d", WORKLOAD_SERVE_PORT));
+    if (!run_logged(&cmd, log_path, NULL, &server)) return_defer(false);
+    if (!workload_wait_for_server(WORKLOAD_SERVE_PORT)) {
+        nob_log(ERROR, "See %s", log_path);
+        return_defer(false);
+    }
+
+    for (size_t round = 0; round < WORKLOAD_ROUNDS; ++round) {
+        for (size_t i = 0; i < NOB_ARRAY_LEN(workload); ++i) {
+            Workload_Step *it = &workload[i];
+            size_t repeat = it->repeat > 0 ? it->repeat : 1;
+            double started_at = it->uri ? now_secs() : children_cpu_secs();
+            for (size_t j = 0; j < repeat; ++j) {
+                if (it->uri) {
+                    if (!workload_request(WORKLOAD_SERVE_PORT, it->uri)) return_defer(false);
+                    continue;
+                }
+                da_append(&cmd, tore_bin);
+                for (size_t k = 0; k < NOB_ARRAY_LEN(it->args) && it->args[k]; ++k) da_append(&cmd, it->args[k]);
+                if (!run_logged(&cmd, log_path, NULL, NULL)) {
+                    nob_log(ERROR, "%s failed, see %s", it->name, log_path);
+                    return_defer(false);
+                }
+            }
+            double finished_at = it->uri ? now_secs() : children_cpu_secs();
+            if (timings) timings[i][round] = (finished_at - started_at)/repeat;
+        }
+    }
+
+defer:
+    minimal_log_level = log_level;
+    if (server != INVALID_PROC) {
+        // tore serve shuts down cleanly on SIGTERM, which is also when the instrumented one writes its profile
+        kill(server, SIGTERM);
+        if (!proc_wait(server)) result = false;
+    }
+    if (old_home) {
+        setenv("HOME", old_home, 1);
+        free(old_home);
+    }
+    free(cmd.items);
+    return result;
+}
+
+// Runs the workload with the instrumented tore and merges the profiles of all its processes into one
+bool collect_profile(Build_Step *step)
+{
+    bool result = true;
+    Cmd cmd = {0};
+    File_Paths children = {0};
+    const char *current_dir = get_current_dir_temp();
+    if (current_dir == NULL) return_defer(false);
+
+    // %p makes every process write its own profile instead of overwriting the one of the previous
+    if (!set_environment_variable("LLVM_PROFILE_FILE", temp_sprintf("%s/"PGO_FOLDER"tore-%%p.profraw", current_dir))) return_defer(false);
+    bool ok = run_workload(step->input, PGO_FOLDER, NULL);
+    unsetenv("LLVM_PROFILE_FILE");
+    if (!ok) return_defer(false);
+
+    cmd_append(&cmd, "llvm-profdata", "merge", "-o", step->tmp_output);
+    if (!read_entire_dir(PGO_FOLDER, &children)) return_defer(false);
+    size_t profiles = 0;
+    for (size_t i = 0; i < children.count; ++i) {
+        if (!sv_end_with(sv_from_cstr(children.items[i]), ".profraw")) continue;
+        cmd_append(&cmd, temp_sprintf(PGO_FOLDER"%s", children.items[i]));
+        profiles += 1;
+    }
+    if (profiles == 0) {
+        nob_log(ERROR, "%s wrote no profiles into "PGO_FOLDER". Is the profile runtime of compiler-rt installed?", step->input);
+        return_defer(false);
+    }
+    if (!cmd_run_sync_and_reset(&cmd)) return_defer(false);
+
+defer:
+    free(children.items);
+    free(cmd.items);
+    return result;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Compares the builds of tore that are there on the workload, so the effect of -release and -pgo
+// can be seen on the commands that matter. Every step is reported by the median of its rounds, so
+// a round disturbed by something else running on the machine does not skew it.
+bool bench_variants(void)
+{
+    Build_Variant variants[] = { VARIANT_DEBUG, VARIANT_RELEASE, VARIANT_PGO };
+    double timings[NOB_ARRAY_LEN(variants)][NOB_ARRAY_LEN(workload)][WORKLOAD_ROUNDS] = {0};
+    double medians[NOB_ARRAY_LEN(variants)][NOB_ARRAY_LEN(workload)] = {0};
+    bool benched[NOB_ARRAY_LEN(variants)] = {0};
+    size_t baseline = NOB_ARRAY_LEN(variants);
+    for (size_t v = 0; v < NOB_ARRAY_LEN(variants); ++v) {
+        const char *tore_bin = tore_bin_path(variants[v]);
+        if (file_exists(tore_bin) != 1) continue;
+        nob_log(INFO, "Running the workload with %s", tore_bin);
+        if (!run_workload(tore_bin, BUILD_FOLDER"bench/", timings[v])) return false;
+        for (size_t i = 0; i < NOB_ARRAY_LEN(workload); ++i) {
+            qsort(timings[v][i], WORKLOAD_ROUNDS, sizeof(timings[v][i][0]), compare_doubles);
+            medians[v][i] = timings[v][i][WORKLOAD_ROUNDS/2];
+        }
+        benched[v] = true;
+        if (baseline == NOB_ARRAY_LEN(variants)) baseline = v;
+    }
+    if (baseline == NOB_ARRAY_LEN(variants)) {
+        nob_log(ERROR, "Nothing to bench. Build tore first");
+        return false;
+    }
+
+    printf("%-18s", temp_sprintf("median of %d", WORKLOAD_ROUNDS));
+    for (size_t v = 0; v < NOB_ARRAY_LEN(variants); ++v) {
+        if (benched[v]) printf("%22s", tore_bin_path(variants[v]) + strlen(BUILD_FOLDER));
+    }
+    printf("\n");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(workload); ++i) {
+        printf("%-18s", workload[i].name);
+        for (size_t v = 0; v < NOB_ARRAY_LEN(variants); ++v) {
+            if (!benched[v]) continue;
+            const char *cell = temp_sprintf("%.3fms", medians[v][i]*1000);
+            if (v != baseline) cell = temp_sprintf("%s (x%.2f)", cell, medians[baseline][i]/medians[v][i]);
+            printf("%22s", cell);
+        }
+        printf(" %s\n", workload[i].uri ? "wall" : "cpu");
+    }
+    return true;
+}
+
 int main(int argc, char **argv)
 {
-    NOB_GO_REBUILD_URSELF_PLUS(argc, argv, "./src_build/flags.c");
+    NOB_GO_REBUILD_URSELF_PLUS(argc, argv, "./src_build/flags.c", "./src/route_hash.h");
 
     const char *program_name = shift(argv, argc);
     Nob_Cmd cmd = {0};
@@ -204,36 +1329,131 @@ int main(int argc, char **argv)
     }
 
     if (!nob_mkdir_if_not_exists(BUILD_FOLDER)) return 1;
-    if (!build_sqlite3(&cmd)) return 1;
-
-    // Templates 
-    builder_compiler(&cmd);
-    builder_common_flags(&cmd);
-    builder_output(&cmd, BUILD_FOLDER"tt");
-    builder_inputs(&cmd, SRC_BUILD_FOLDER"tt.c");
-    if (!cmd_run_sync_and_reset(&cmd)) return 1;
-    if (!compile_template(&cmd, SRC_FOLDER"index_page.h.tt", BUILD_FOLDER"index_page.h")) return 1;
-    if (!compile_template(&cmd, SRC_FOLDER"error_page.h.tt", BUILD_FOLDER"error_page.h")) return 1;
-
-    if (!generate_resource_bundle()) return 1;
-
-    char *git_hash = get_git_hash(&cmd);
-    builder_compiler(&cmd);
-    builder_common_flags(&cmd);
-    if (!build_flags[BF_ASAN].value) cmd_append(&cmd, "-static");
-    if (git_hash) {
-        cmd_append(&cmd, temp_sprintf("-DGIT_HASH=\"%s\"", git_hash));
-        free(git_hash);
-    } else {
-        cmd_append(&cmd, temp_sprintf("-DGIT_HASH=\"Unknown\""));
+
+    Build_Steps steps = {0};
+    size_t tt = build_step(&steps, (Build_Step) {
+        .name = "tt", .command = command_tool,
+        .input = SRC_BUILD_FOLDER"tt.c", .extra_inputs = {"nob.h"}, .output = BUILD_FOLDER"tt",
+    });
+    const char *templates[] = { "index_page", "search_page", "calendar_page" };
+    size_t template_steps[NOB_ARRAY_LEN(templates)];
+    for (size_t i = 0; i < NOB_ARRAY_LEN(templates); ++i) {
+        template_steps[i] = build_step(&steps, (Build_Step) {
+            .name = temp_sprintf("%s.h", templates[i]), .command = command_template, .stdout_is_output = true,
+            .input = temp_sprintf(SRC_FOLDER"%s.h.tt", templates[i]), .output = temp_sprintf(BUILD_FOLDER"%s.h", templates[i]),
+        });
+        build_step_depends(&steps, template_steps[i], tt);
     }
-    builder_output(&cmd, TORE_BIN_PATH);
-    builder_inputs(&cmd, SRC_FOLDER"tore.c", SQLITE3_OBJ_PATH);
-    if (!nob_cmd_run_sync_and_reset(&cmd)) return 1;
+    // Load generator for `tore serve`, see the usage of ./build/bench-http -h
+    build_step(&steps, (Build_Step) {
+        .name = "bench-http", .command = command_tool,
+        .input = SRC_BUILD_FOLDER"bench_http.c", .extra_inputs = {"nob.h"}, .output = BUILD_FOLDER"bench-http",
+    });
+    // Prerenders the error pages of the canned responses, see generate_resource_bundle(). Only the
+    // error_page tool includes its template, tore does not.
+    size_t error_page_h = build_step(&steps, (Build_Step) {
+        .name = "error_page.h", .command = command_template, .stdout_is_output = true,
+        .input = SRC_FOLDER"error_page.h.tt", .output = BUILD_FOLDER"error_page.h",
+    });
+    build_step_depends(&steps, error_page_h, tt);
+    size_t error_page = build_step(&steps, (Build_Step) {
+        .name = "error_page", .command = command_tool,
+        .input = SRC_BUILD_FOLDER"error_page.c", .extra_inputs = {"nob.h"}, .output = ERROR_PAGE_BIN_PATH,
+    });
+    build_step_depends(&steps, error_page, error_page_h);
+    size_t bundle_h = build_step(&steps, (Build_Step) {
+        .name = "bundle.h", .run = generate_resource_bundle,
+        .output = BUILD_FOLDER"bundle.h",
+    });
+    build_step_depends(&steps, bundle_h, error_page);
+    size_t bundle_o = build_step(&steps, (Build_Step) {
+        .name = "bundle.o", .command = command_bundle_obj,
+        .input = BUNDLE_ASM_PATH, .extra_inputs = {BUNDLE_BIN_PATH}, .output = BUNDLE_OBJ_PATH,
+    });
+    build_step_depends(&steps, bundle_o, bundle_h);
+    size_t git_hash = build_step(&steps, (Build_Step) {
+        .name = "git hash", .command = command_git_hash, .stdout_is_output = true,
+        .output = GIT_HASH_FILE, .always = true, .optional = true,
+    });
+
+    bool release = build_flags[BF_RELEASE].value;
+    bool pgo = build_flags[BF_PGO].value;
+    bool asan = build_flags[BF_ASAN].value;
+    // The tests run against the debug tore whatever else is built
+    bool test = argc > 0 && strcmp(argv[0], "test") == 0;
+    bool selected[COUNT_VARIANTS] = {
+        [VARIANT_DEBUG]        = build_flags[BF_ALL].value || test || (!asan && !release && !pgo),
+        [VARIANT_ASAN]         = build_flags[BF_ALL].value || asan,
+        [VARIANT_RELEASE]      = release,
+        [VARIANT_INSTRUMENTED] = pgo,
+        [VARIANT_PGO]          = pgo,
+    };
+    // Both come with LLVM, but distributions often package them apart from clang. Without them the
+    // build would only fail at the very end, on the link or on the profile.
+    if ((release || pgo) && !program_in_path("ld.lld")) {
+        const char *flag = pgo ? "-pgo" : "-release";
+        nob_log(ERROR, "%s links with lld, but ld.lld is not found in $PATH. Install lld or build without %s.", flag, flag);
+        return 1;
+    }
+    if (pgo && !program_in_path("llvm-profdata")) {
+        nob_log(ERROR, "-pgo merges the profiles with llvm-profdata, but it is not found in $PATH. Install llvm or build without -pgo.");
+        return 1;
+    }
+    size_t tore_steps[COUNT_VARIANTS] = {0};
+    for (Build_Variant variant = 0; variant < COUNT_VARIANTS; ++variant) {
+        if (!selected[variant]) continue;
+        size_t sqlite3 = build_step(&steps, (Build_Step) {
+            .name = sqlite3_obj_path(variant) + strlen(BUILD_FOLDER), .command = command_sqlite3,
+            .input = SRC_FOLDER"sqlite-amalgamation-3460100/sqlite3.c", .output = sqlite3_obj_path(variant),
+            .variant = variant,
+        });
+        size_t tore = build_step(&steps, (Build_Step) {
+            .name = tore_bin_path(variant) + strlen(BUILD_FOLDER), .command = command_tore,
+            .input = SRC_FOLDER"tore.c", .extra_inputs = {"nob.h", SRC_FOLDER"route_hash.h"}, .output = tore_bin_path(variant),
+            .variant = variant,
+        });
+        build_step_depends(&steps, tore, sqlite3);
+        for (size_t i = 0; i < NOB_ARRAY_LEN(templates); ++i) build_step_depends(&steps, tore, template_steps[i]);
+        build_step_depends(&steps, tore, bundle_h);
+        build_step_depends(&steps, tore, bundle_o);
+        build_step_depends(&steps, tore, git_hash);
+        if (test && variant == VARIANT_DEBUG) {
+            // The tests include tore.c as a whole, so they are built the same way as tore itself
+            size_t tests = build_step(&steps, (Build_Step) {
+                .name = TEST_BIN_PATH + strlen(BUILD_FOLDER), .command = command_tore,
+                .input = TESTS_FOLDER"tore_test.c", .extra_inputs = {"nob.h", SRC_FOLDER"tore.c", SRC_FOLDER"route_hash.h"},
+                .output = TEST_BIN_PATH, .variant = variant,
+            });
+            build_step_depends(&steps, tests, sqlite3);
+            for (size_t i = 0; i < NOB_ARRAY_LEN(templates); ++i) build_step_depends(&steps, tests, template_steps[i]);
+            build_step_depends(&steps, tests, bundle_h);
+            build_step_depends(&steps, tests, bundle_o);
+        }
+        if (variant == VARIANT_PGO) {
+            // The instrumented variant comes before this one, so its step is already there
+            size_t profile = build_step(&steps, (Build_Step) {
+                .name = "profile", .run = collect_profile, .stamp = workload_stamp_temp(),
+                .input = tore_bin_path(VARIANT_INSTRUMENTED), .output = PGO_PROFILE_PATH,
+            });
+            build_step_depends(&steps, profile, tore_steps[VARIANT_INSTRUMENTED]);
+            build_step_depends(&steps, sqlite3, profile);
+            build_step_depends(&steps, tore, profile);
+        }
+        tore_steps[variant] = tore;
+    }
+    if (!run_build_steps(&steps)) return 1;
 
     if (argc <= 0) return 0;
     const char *command_name = shift(argv, argc);
 
+    if (strcmp(command_name, "test") == 0) {
+        // NOTE: `./nob test bench` measures catching up on overdue Reminders and period_advance() instead, see tests/tore_test.c
+        cmd_append(&cmd, TEST_BIN_PATH, tore_bin_path(VARIANT_DEBUG));
+        da_append_many(&cmd, argv, argc);
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        return 0;
+    }
+
     if (strcmp(command_name, "run") == 0 || strcmp(command_name, "chroot") == 0) {
         // NOTE: this command runs the developed tore with some special
         // environment variables set so it does not damage your "production"
@@ -246,7 +1466,8 @@ int main(int argc, char **argv)
         if (current_dir == NULL) return 1;
         if (!set_environment_variable("HOME", temp_sprintf("%s/"BUILD_FOLDER, current_dir))) return 1;
         if (!set_environment_variable("TORE_TRACE_MIGRATION_QUERIES", "1")) return 1;
-        cmd_append(&cmd, TORE_BIN_PATH);
+        Build_Variant variant = pgo ? VARIANT_PGO : release ? VARIANT_RELEASE : asan ? VARIANT_ASAN : VARIANT_DEBUG;
+        cmd_append(&cmd, tore_bin_path(variant));
         da_append_many(&cmd, argv, argc);
         if (!nob_cmd_run_sync_and_reset(&cmd)) return 1;
         if (strcmp(command_name, "chroot") == 0) {
@@ -255,6 +1476,11 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (strcmp(command_name, "bench") == 0) {
+        if (!bench_variants()) return 1;
+        return 0;
+    }
+
     if (strcmp(command_name, "svg") == 0) {
         cmd_append(&cmd, "convert", 
                 "-background", "None", "./assets/images/tore.svg",
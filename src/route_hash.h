@@ -0,0 +1,26 @@
+#ifndef ROUTE_HASH_H_
+#define ROUTE_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The hash of the perfect hash table of routes. nob searches for a seed at build time that
+// makes it collision-free over all the known routes and generates the table into bundle.h.
+// tore uses the very same function at run time, so both sides must include this file.
+static inline uint32_t route_hash(const char *data, size_t count, uint32_t seed)
+{
+    // FNV-1a followed by the murmur3 finalizer so the low bits we mask with are well mixed
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < count; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+#endif // ROUTE_HASH_H_
@@ -1,26 +1,174 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <strings.h>
 #include <time.h>
 #include "sqlite3.h"
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <signal.h>
 
 #define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
 #include "nob.h"
 
+#include "route_hash.h"
 #include "bundle.h"
 
 #define TORE_FILENAME ".tore"
+#define TORE_ARCHIVE_FILENAME ".tore-archive"
+#define TORE_CONFIG_FILENAME ".torerc"
+#define TORE_ARCHIVE_SUFFIX "-archive"
+#define TORE_CHECKOUT_CACHE_SUFFIX "-checkout-cache"
 #define STR(x) STR2_ELECTRIC_BOOGALOO(x)
 #define STR2_ELECTRIC_BOOGALOO(x) #x
 #define DEFAULT_SERVE_PORT 6969
 #define DEFAULT_COMMAND "checkout"
+#define DEFAULT_ARCHIVE_AFTER_DAYS 90
+#define ARCHIVE_BATCH_SIZE 1000
+#define DEFAULT_BACKUP_PAGES_PER_STEP 256
+#define DEFAULT_BACKUP_PAUSE 10
+#define DEFAULT_CALENDAR_DAYS 28
+#define MAX_CALENDAR_DAYS (10*366)
 
 #define LOG_SQLITE3_ERROR(db) fprintf(stderr, "%s:%d: SQLITE3 ERROR: %s\n", __FILE__, __LINE__, sqlite3_errmsg(db))
 
+// Records the changes of every transaction of the databases opened by open_tore_db_at() into their
+// Changesets tables for `tore sync`, if they take part in a sync. `serve` may have the databases of
+// several users open, so there is a session per connection. Only the tables edited by the user are
+// recorded. NotificationGroups and the search index are maintained by the triggers on every side anyway.
+typedef struct {
+    sqlite3 *db;
+    sqlite3_session *session;
+} Sync_Recorder;
+
+typedef struct {
+    Sync_Recorder *items;
+    size_t count;
+    size_t capacity;
+} Sync_Recorders;
+
+static Sync_Recorders sync_recorders = {0};
+static const char *sync_recorded_tables[] = {"Reminders", "Notifications"};
+
+Sync_Recorder *sync_recorder_of(sqlite3 *db)
+{
+    for (size_t i = 0; i < sync_recorders.count; ++i) {
+        if (sync_recorders.items[i].db == db) return &sync_recorders.items[i];
+    }
+    return NULL;
+}
+
+sqlite3_session *sync_session_create(sqlite3 *db)
+{
+    sqlite3_session *session = NULL;
+    int ret = sqlite3session_create(db, "main", &session);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "ERROR: could not start recording the changes: %s\n", sqlite3_errstr(ret));
+        return NULL;
+    }
+    for (size_t i = 0; i < ARRAY_LEN(sync_recorded_tables); ++i) {
+        ret = sqlite3session_attach(session, sync_recorded_tables[i]);
+        if (ret != SQLITE_OK) {
+            fprintf(stderr, "ERROR: could not start recording the changes of %s: %s\n", sync_recorded_tables[i], sqlite3_errstr(ret));
+            sqlite3session_delete(session);
+            return NULL;
+        }
+    }
+    return session;
+}
+
+bool sync_recorder_start(sqlite3 *db)
+{
+    assert(sync_recorder_of(db) == NULL);
+    sqlite3_session *session = sync_session_create(db);
+    if (session == NULL) return false;
+    Sync_Recorder recorder = {
+        .db = db,
+        .session = session,
+    };
+    da_append(&sync_recorders, recorder);
+    return true;
+}
+
+void sync_recorder_stop(sqlite3 *db)
+{
+    Sync_Recorder *recorder = sync_recorder_of(db);
+    if (recorder == NULL) return;
+    sqlite3session_delete(recorder->session);
+    *recorder = sync_recorders.items[--sync_recorders.count];
+}
+
+// For the changes that must not be replicated: the ones that came from the other databases in
+// the first place, and archiving, which every database does on its own.
+void sync_recorder_pause(sqlite3 *db, bool paused)
+{
+    Sync_Recorder *recorder = sync_recorder_of(db);
+    if (recorder) sqlite3session_enable(recorder->session, !paused);
+}
+
+// Called right before COMMIT, so the changeset is saved atomically with the changes themselves.
+// The seq of a changeset is a Lamport clock: it's greater than the seq of any changeset this
+// database has seen so far, so applying them in the order of seq never applies a change before
+// the changes it was made on top of. See sync_apply_bundle()
+bool sync_recorder_flush(sqlite3 *db)
+{
+    Sync_Recorder *recorder = sync_recorder_of(db);
+    if (recorder == NULL) return true;
+
+    bool result = true;
+    void *changeset = NULL;
+    int size = 0;
+    sqlite3_stmt *stmt = NULL;
+
+    // NOTE: not sqlite3session_isempty(), because the session stops recording on errors and
+    // those are only reported here
+    int ret = sqlite3session_changeset(recorder->session, &size, &changeset);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "ERROR: could not record the changes: %s\n", sqlite3_errstr(ret));
+        return_defer(false);
+    }
+
+    if (size == 0) return_defer(true);
+
+    const char *sql =
+        "UPDATE SyncSite SET clock = clock + 1;\n"
+        "INSERT INTO SyncPeers (peer, site, seq) SELECT site, site, clock FROM SyncSite WHERE true\n"
+        "ON CONFLICT DO UPDATE SET seq = excluded.seq;\n";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "INSERT INTO Changesets (site, seq, changeset) SELECT site, clock, ?1 FROM SyncSite", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_blob(stmt, 1, changeset, size, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    // There is no way to clear a session, so a fresh one is started for the next transaction
+    sqlite3_session *session = sync_session_create(db);
+    if (session == NULL) return_defer(false);
+    sqlite3session_delete(recorder->session);
+    recorder->session = session;
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    sqlite3_free(changeset);
+    return result;
+}
+
 bool txn_begin(sqlite3 *db)
 {
     if (sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
@@ -32,6 +180,7 @@ bool txn_begin(sqlite3 *db)
 
 bool txn_commit(sqlite3 *db)
 {
+    if (!sync_recorder_flush(db)) return false;
     if (sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return false;
@@ -39,6 +188,125 @@ bool txn_commit(sqlite3 *db)
     return true;
 }
 
+// The triggers of NotificationGroups since Notifications have occurrences. They work the same way as the
+// ones of the migration that introduced NotificationGroups and also sum up the occurrences of the group.
+// Every migration that recreates Notifications recreates them, so this must never change.
+#define NOTIFICATION_GROUPS_TRIGGERS_SQL \
+    "CREATE TRIGGER NotificationGroups_insert AFTER INSERT ON Notifications\n" \
+    "WHEN new.dismissed_at IS NULL\n" \
+    "BEGIN\n" \
+    "    INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, occurrences, first_created_at, last_created_at)\n" \
+    "    VALUES (ifnull(new.reminder_id, -new.id), new.reminder_id, new.title, 1, new.occurrences, new.created_at, new.created_at)\n" \
+    "    ON CONFLICT (group_id) DO UPDATE SET\n" \
+    "        active_count = active_count + 1,\n" \
+    "        occurrences = occurrences + excluded.occurrences,\n" \
+    "        first_created_at = min(first_created_at, excluded.first_created_at),\n" \
+    "        last_created_at = max(last_created_at, excluded.last_created_at);\n" \
+    "    UPDATE NotificationGroups SET title = (\n" \
+    "        SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = new.reminder_id\n" \
+    "        ORDER BY created_at DESC, id DESC LIMIT 1)\n" \
+    "    WHERE group_id = new.reminder_id;\n" \
+    "END;\n" \
+    "CREATE TRIGGER NotificationGroups_undismiss AFTER UPDATE OF dismissed_at ON Notifications\n" \
+    "WHEN old.dismissed_at IS NOT NULL AND new.dismissed_at IS NULL\n" \
+    "BEGIN\n" \
+    "    INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, occurrences, first_created_at, last_created_at)\n" \
+    "    VALUES (ifnull(new.reminder_id, -new.id), new.reminder_id, new.title, 1, new.occurrences, new.created_at, new.created_at)\n" \
+    "    ON CONFLICT (group_id) DO UPDATE SET\n" \
+    "        active_count = active_count + 1,\n" \
+    "        occurrences = occurrences + excluded.occurrences,\n" \
+    "        first_created_at = min(first_created_at, excluded.first_created_at),\n" \
+    "        last_created_at = max(last_created_at, excluded.last_created_at);\n" \
+    "    UPDATE NotificationGroups SET title = (\n" \
+    "        SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = new.reminder_id\n" \
+    "        ORDER BY created_at DESC, id DESC LIMIT 1)\n" \
+    "    WHERE group_id = new.reminder_id;\n" \
+    "END;\n" \
+    "CREATE TRIGGER NotificationGroups_dismiss AFTER UPDATE OF dismissed_at ON Notifications\n" \
+    "WHEN old.dismissed_at IS NULL AND new.dismissed_at IS NOT NULL\n" \
+    "BEGIN\n" \
+    "    UPDATE NotificationGroups SET active_count = active_count - 1, occurrences = occurrences - old.occurrences\n" \
+    "    WHERE group_id = ifnull(old.reminder_id, -old.id);\n" \
+    "    DELETE FROM NotificationGroups WHERE group_id = ifnull(old.reminder_id, -old.id) AND active_count <= 0;\n" \
+    "    UPDATE NotificationGroups SET\n" \
+    "        title = (SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id\n" \
+    "                 ORDER BY created_at DESC, id DESC LIMIT 1),\n" \
+    "        first_created_at = (SELECT min(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id),\n" \
+    "        last_created_at = (SELECT max(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id)\n" \
+    "    WHERE group_id = old.reminder_id;\n" \
+    "END;\n" \
+    "CREATE TRIGGER NotificationGroups_delete AFTER DELETE ON Notifications\n" \
+    "WHEN old.dismissed_at IS NULL\n" \
+    "BEGIN\n" \
+    "    UPDATE NotificationGroups SET active_count = active_count - 1, occurrences = occurrences - old.occurrences\n" \
+    "    WHERE group_id = ifnull(old.reminder_id, -old.id);\n" \
+    "    DELETE FROM NotificationGroups WHERE group_id = ifnull(old.reminder_id, -old.id) AND active_count <= 0;\n" \
+    "    UPDATE NotificationGroups SET\n" \
+    "        title = (SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id\n" \
+    "                 ORDER BY created_at DESC, id DESC LIMIT 1),\n" \
+    "        first_created_at = (SELECT min(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id),\n" \
+    "        last_created_at = (SELECT max(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id)\n" \
+    "    WHERE group_id = old.reminder_id;\n" \
+    "END;\n"
+
+// Full-text index over the titles of Notifications and Reminders for `tore search`. The FTS5 tables
+// are external-content, so they store only the index and read the titles from the tables themselves.
+// The same migration is applied to ~/.tore-archive to make the archived history searchable too.
+#define SEARCH_MIGRATION_SQL \
+    "CREATE VIRTUAL TABLE NotificationsSearch USING fts5(\n" \
+    "    title, content = 'Notifications', content_rowid = 'id',\n" \
+    "    tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3'\n" \
+    ");\n" \
+    "CREATE TRIGGER NotificationsSearch_insert AFTER INSERT ON Notifications BEGIN\n" \
+    "    INSERT INTO NotificationsSearch (rowid, title) VALUES (new.id, new.title);\n" \
+    "END;\n" \
+    "CREATE TRIGGER NotificationsSearch_delete AFTER DELETE ON Notifications BEGIN\n" \
+    "    INSERT INTO NotificationsSearch (NotificationsSearch, rowid, title) VALUES ('delete', old.id, old.title);\n" \
+    "END;\n" \
+    "CREATE TRIGGER NotificationsSearch_update AFTER UPDATE OF title ON Notifications BEGIN\n" \
+    "    INSERT INTO NotificationsSearch (NotificationsSearch, rowid, title) VALUES ('delete', old.id, old.title);\n" \
+    "    INSERT INTO NotificationsSearch (rowid, title) VALUES (new.id, new.title);\n" \
+    "END;\n" \
+    "INSERT INTO NotificationsSearch (NotificationsSearch) VALUES ('rebuild');\n" \
+    "CREATE VIRTUAL TABLE RemindersSearch USING fts5(\n" \
+    "    title, content = 'Reminders', content_rowid = 'id',\n" \
+    "    tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3'\n" \
+    ");\n" \
+    "CREATE TRIGGER RemindersSearch_insert AFTER INSERT ON Reminders BEGIN\n" \
+    "    INSERT INTO RemindersSearch (rowid, title) VALUES (new.id, new.title);\n" \
+    "END;\n" \
+    "CREATE TRIGGER RemindersSearch_delete AFTER DELETE ON Reminders BEGIN\n" \
+    "    INSERT INTO RemindersSearch (RemindersSearch, rowid, title) VALUES ('delete', old.id, old.title);\n" \
+    "END;\n" \
+    "CREATE TRIGGER RemindersSearch_update AFTER UPDATE OF title ON Reminders BEGIN\n" \
+    "    INSERT INTO RemindersSearch (RemindersSearch, rowid, title) VALUES ('delete', old.id, old.title);\n" \
+    "    INSERT INTO RemindersSearch (rowid, title) VALUES (new.id, new.title);\n" \
+    "END;\n" \
+    "INSERT INTO RemindersSearch (RemindersSearch) VALUES ('rebuild');\n"
+
+// The periods of Reminders used to be stored as the modifiers of SQLite's date() like `+3 months`,
+// so stepping a Reminder parsed two strings per occurrence. Now they are the integers of Period
+// (0 = days, 1 = weeks, 2 = months, 3 = years) and the length, and the dates are stepped in C.
+// period_day is the day of the month the monthly and yearly Reminders are anchored to, so the ones
+// clamped to the end of a shorter month get back to their day afterwards. See period_advance().
+// The text periods never clamped (date() rolls 01-31 +1 month over to 03-02 or 03-03), so the day of
+// scheduled_at is all there is to migrate the anchor from. tests/tore_test.c checks that.
+// The same migration is applied to ~/.tore-archive.
+#define PERIOD_MIGRATION_SQL \
+    "ALTER TABLE Reminders ADD COLUMN period_unit INTEGER DEFAULT NULL;\n" \
+    "ALTER TABLE Reminders ADD COLUMN period_length INTEGER NOT NULL DEFAULT 0;\n" \
+    "ALTER TABLE Reminders ADD COLUMN period_day INTEGER NOT NULL DEFAULT 0;\n" \
+    "UPDATE Reminders SET\n" \
+    "    period_unit = CASE\n" \
+    "        WHEN period LIKE '+% days' THEN 0\n" \
+    "        WHEN period LIKE '+% months' THEN 2\n" \
+    "        WHEN period LIKE '+% years' THEN 3\n" \
+    "    END,\n" \
+    "    period_length = CAST(substr(period, 2) AS INTEGER),\n" \
+    "    period_day = CAST(strftime('%d', scheduled_at*86400, 'unixepoch') AS INTEGER)\n" \
+    "WHERE period IS NOT NULL;\n" \
+    "ALTER TABLE Reminders DROP COLUMN period;\n"
+
 const char *migrations[] = {
     // Initial scheme
     "CREATE TABLE IF NOT EXISTS Notifications (\n"
@@ -68,24 +336,259 @@ const char *migrations[] = {
     ");\n"
     "INSERT INTO Notifications (id, title, created_at, dismissed_at)\n"
     "SELECT id, title, created_at, dismissed_at FROM Notifications_old;\n"
-    "DROP TABLE Notifications_old;\n"
+    "DROP TABLE Notifications_old;\n",
+
+    // Log of the archivings. Used to decide when it's time for the automatic one.
+    "CREATE TABLE IF NOT EXISTS Archivings (\n"
+    "    archived_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,\n"
+    "    notifications INTEGER NOT NULL,\n"
+    "    reminders INTEGER NOT NULL\n"
+    ");\n",
+    // checkout asks on every run whether anything is old enough to archive. Without these the
+    // answer is a full scan of both tables. See archive_old_rows_if_due()
+    "CREATE INDEX Notifications_dismissed_at ON Notifications (dismissed_at) WHERE dismissed_at IS NOT NULL;\n"
+    "CREATE INDEX Reminders_finished_at ON Reminders (finished_at) WHERE finished_at IS NOT NULL;\n",
+
+    // Summary of the active Notification groups maintained by triggers, so listing them does not
+    // have to aggregate all the active Notifications every time. The title of a group is the one of its
+    // latest active Notification by (created_at, id) and the timestamps span only the active ones, whatever
+    // order the Notifications come and go in. A Notification without a Reminder is a group of its own,
+    // so only the groups of Reminders ever have to look at the other Notifications, and they do that with
+    // a seek on Notifications_active_group_id. See ACTUAL_NOTIFICATION_GROUPS_SQL
+    "CREATE TABLE IF NOT EXISTS NotificationGroups (\n"
+    "    group_id INTEGER PRIMARY KEY,\n"
+    "    reminder_id INTEGER DEFAULT NULL,\n"
+    "    title TEXT NOT NULL,\n"
+    "    active_count INTEGER NOT NULL,\n"
+    "    first_created_at DATETIME NOT NULL,\n"
+    "    last_created_at DATETIME NOT NULL\n"
+    ");\n"
+    "CREATE INDEX IF NOT EXISTS NotificationGroups_last_created_at ON NotificationGroups (last_created_at);\n"
+    "CREATE INDEX IF NOT EXISTS Notifications_active_group_id ON Notifications (ifnull(reminder_id, -id), created_at) WHERE dismissed_at IS NULL;\n"
+    "CREATE TRIGGER IF NOT EXISTS NotificationGroups_insert AFTER INSERT ON Notifications\n"
+    "WHEN new.dismissed_at IS NULL\n"
+    "BEGIN\n"
+    "    INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, first_created_at, last_created_at)\n"
+    "    VALUES (ifnull(new.reminder_id, -new.id), new.reminder_id, new.title, 1, new.created_at, new.created_at)\n"
+    "    ON CONFLICT (group_id) DO UPDATE SET\n"
+    "        active_count = active_count + 1,\n"
+    "        first_created_at = min(first_created_at, excluded.first_created_at),\n"
+    "        last_created_at = max(last_created_at, excluded.last_created_at);\n"
+    "    UPDATE NotificationGroups SET title = (\n"
+    "        SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = new.reminder_id\n"
+    "        ORDER BY created_at DESC, id DESC LIMIT 1)\n"
+    "    WHERE group_id = new.reminder_id;\n"
+    "END;\n"
+    "CREATE TRIGGER IF NOT EXISTS NotificationGroups_undismiss AFTER UPDATE OF dismissed_at ON Notifications\n"
+    "WHEN old.dismissed_at IS NOT NULL AND new.dismissed_at IS NULL\n"
+    "BEGIN\n"
+    "    INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, first_created_at, last_created_at)\n"
+    "    VALUES (ifnull(new.reminder_id, -new.id), new.reminder_id, new.title, 1, new.created_at, new.created_at)\n"
+    "    ON CONFLICT (group_id) DO UPDATE SET\n"
+    "        active_count = active_count + 1,\n"
+    "        first_created_at = min(first_created_at, excluded.first_created_at),\n"
+    "        last_created_at = max(last_created_at, excluded.last_created_at);\n"
+    "    UPDATE NotificationGroups SET title = (\n"
+    "        SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = new.reminder_id\n"
+    "        ORDER BY created_at DESC, id DESC LIMIT 1)\n"
+    "    WHERE group_id = new.reminder_id;\n"
+    "END;\n"
+    "CREATE TRIGGER IF NOT EXISTS NotificationGroups_dismiss AFTER UPDATE OF dismissed_at ON Notifications\n"
+    "WHEN old.dismissed_at IS NULL AND new.dismissed_at IS NOT NULL\n"
+    "BEGIN\n"
+    "    UPDATE NotificationGroups SET active_count = active_count - 1 WHERE group_id = ifnull(old.reminder_id, -old.id);\n"
+    "    DELETE FROM NotificationGroups WHERE group_id = ifnull(old.reminder_id, -old.id) AND active_count <= 0;\n"
+    "    UPDATE NotificationGroups SET\n"
+    "        title = (SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id\n"
+    "                 ORDER BY created_at DESC, id DESC LIMIT 1),\n"
+    "        first_created_at = (SELECT min(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id),\n"
+    "        last_created_at = (SELECT max(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id)\n"
+    "    WHERE group_id = old.reminder_id;\n"
+    "END;\n"
+    "CREATE TRIGGER IF NOT EXISTS NotificationGroups_delete AFTER DELETE ON Notifications\n"
+    "WHEN old.dismissed_at IS NULL\n"
+    "BEGIN\n"
+    "    UPDATE NotificationGroups SET active_count = active_count - 1 WHERE group_id = ifnull(old.reminder_id, -old.id);\n"
+    "    DELETE FROM NotificationGroups WHERE group_id = ifnull(old.reminder_id, -old.id) AND active_count <= 0;\n"
+    "    UPDATE NotificationGroups SET\n"
+    "        title = (SELECT title FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id\n"
+    "                 ORDER BY created_at DESC, id DESC LIMIT 1),\n"
+    "        first_created_at = (SELECT min(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id),\n"
+    "        last_created_at = (SELECT max(created_at) FROM Notifications WHERE dismissed_at IS NULL AND ifnull(reminder_id, -id) = old.reminder_id)\n"
+    "    WHERE group_id = old.reminder_id;\n"
+    "END;\n"
+    "INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, first_created_at, last_created_at)\n"
+    "SELECT group_id, reminder_id, latest_title, count(*), min(created_at), max(created_at)\n"
+    "FROM (SELECT ifnull(reminder_id, -id) AS group_id, reminder_id, created_at,\n"
+    "      first_value(title) OVER (PARTITION BY ifnull(reminder_id, -id) ORDER BY created_at DESC, id DESC) AS latest_title\n"
+    "      FROM Notifications WHERE dismissed_at IS NULL)\n"
+    "GROUP BY group_id;\n",
+
+    // Missed occurrences of a periodic Reminder may be coalesced into a single Notification that
+    // carries the amount of them (see fire_off_reminders()).
+    "ALTER TABLE Notifications ADD COLUMN occurrences INTEGER NOT NULL DEFAULT 1;\n"
+    "ALTER TABLE NotificationGroups ADD COLUMN occurrences INTEGER NOT NULL DEFAULT 0;\n"
+    "UPDATE NotificationGroups SET occurrences = active_count;\n"
+    "DROP TRIGGER NotificationGroups_insert;\n"
+    "DROP TRIGGER NotificationGroups_undismiss;\n"
+    "DROP TRIGGER NotificationGroups_dismiss;\n"
+    "DROP TRIGGER NotificationGroups_delete;\n"
+    NOTIFICATION_GROUPS_TRIGGERS_SQL,
+
+    // Timestamps are stored as seconds since the Unix Epoch and scheduled dates as days since the Unix Epoch,
+    // so they are compact and compared and sorted as plain integers. Converting them to localtime for
+    // displaying is done in C.
+    "CREATE TABLE Reminders_new (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at INTEGER NOT NULL DEFAULT (unixepoch()),\n"
+    "    scheduled_at INTEGER NOT NULL,\n"
+    "    period TEXT DEFAULT NULL,\n"
+    "    finished_at INTEGER DEFAULT NULL\n"
+    ");\n"
+    "INSERT INTO Reminders_new (id, title, created_at, scheduled_at, period, finished_at)\n"
+    "SELECT id, title, unixepoch(created_at), unixepoch(scheduled_at)/86400, period, unixepoch(finished_at) FROM Reminders;\n"
+    "DROP TABLE Reminders;\n"
+    "ALTER TABLE Reminders_new RENAME TO Reminders;\n"
+    "CREATE TABLE Notifications_new (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at INTEGER NOT NULL DEFAULT (unixepoch()),\n"
+    "    dismissed_at INTEGER DEFAULT NULL,\n"
+    "    reminder_id INTEGER DEFAULT NULL,\n"
+    "    occurrences INTEGER NOT NULL DEFAULT 1,\n"
+    "    FOREIGN KEY (reminder_id) REFERENCES Reminders(id)\n"
+    ");\n"
+    "INSERT INTO Notifications_new (id, title, created_at, dismissed_at, reminder_id, occurrences)\n"
+    "SELECT id, title, unixepoch(created_at), unixepoch(dismissed_at), reminder_id, occurrences FROM Notifications;\n"
+    "DROP TABLE Notifications;\n"
+    "ALTER TABLE Notifications_new RENAME TO Notifications;\n"
+    "DROP TABLE NotificationGroups;\n"
+    "CREATE TABLE NotificationGroups (\n"
+    "    group_id INTEGER PRIMARY KEY,\n"
+    "    reminder_id INTEGER DEFAULT NULL,\n"
+    "    title TEXT NOT NULL,\n"
+    "    active_count INTEGER NOT NULL,\n"
+    "    occurrences INTEGER NOT NULL,\n"
+    "    first_created_at INTEGER NOT NULL,\n"
+    "    last_created_at INTEGER NOT NULL\n"
+    ");\n"
+    "CREATE INDEX NotificationGroups_last_created_at ON NotificationGroups (last_created_at);\n"
+    "CREATE INDEX Notifications_active_group_id ON Notifications (ifnull(reminder_id, -id), created_at) WHERE dismissed_at IS NULL;\n"
+    "CREATE INDEX Notifications_dismissed_at ON Notifications (dismissed_at) WHERE dismissed_at IS NOT NULL;\n"
+    "CREATE INDEX Reminders_finished_at ON Reminders (finished_at) WHERE finished_at IS NOT NULL;\n"
+    NOTIFICATION_GROUPS_TRIGGERS_SQL
+    "INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, occurrences, first_created_at, last_created_at)\n"
+    "SELECT group_id, reminder_id, latest_title, count(*), sum(occurrences), min(created_at), max(created_at)\n"
+    "FROM (SELECT ifnull(reminder_id, -id) AS group_id, reminder_id, occurrences, created_at,\n"
+    "      first_value(title) OVER (PARTITION BY ifnull(reminder_id, -id) ORDER BY created_at DESC, id DESC) AS latest_title\n"
+    "      FROM Notifications WHERE dismissed_at IS NULL)\n"
+    "GROUP BY group_id;\n"
+    "CREATE TABLE Archivings_new (\n"
+    "    archived_at INTEGER NOT NULL DEFAULT (unixepoch()),\n"
+    "    notifications INTEGER NOT NULL,\n"
+    "    reminders INTEGER NOT NULL\n"
+    ");\n"
+    "INSERT INTO Archivings_new (archived_at, notifications, reminders)\n"
+    "SELECT unixepoch(archived_at), notifications, reminders FROM Archivings;\n"
+    "DROP TABLE Archivings;\n"
+    "ALTER TABLE Archivings_new RENAME TO Archivings;\n",
+    SEARCH_MIGRATION_SQL,
+    // Bookkeeping of `tore sync`. See sync_run()
+    "CREATE TABLE SyncSite (\n"
+    "    site INTEGER NOT NULL,\n"
+    "    clock INTEGER NOT NULL\n"
+    ");\n"
+    "CREATE TABLE Changesets (\n"
+    "    site INTEGER NOT NULL,\n"
+    "    seq INTEGER NOT NULL,\n"
+    "    changeset BLOB NOT NULL,\n"
+    "    PRIMARY KEY (site, seq)\n"
+    ") WITHOUT ROWID;\n"
+    "CREATE TABLE SyncPeers (\n"
+    "    peer INTEGER NOT NULL,\n"
+    "    site INTEGER NOT NULL,\n"
+    "    seq INTEGER NOT NULL,\n"
+    "    pruned INTEGER NOT NULL DEFAULT 0,\n"
+    "    PRIMARY KEY (peer, site)\n"
+    ") WITHOUT ROWID;\n",
+    // A Reminder may ask to be shown on checkout lead_days before it fires off. Both the due Reminders
+    // and the ones to warn about are found by a range seek, because checkout runs on every shell startup.
+    // See fire_off_reminders() and show_upcoming_reminders_into()
+    "ALTER TABLE Reminders ADD COLUMN lead_days INTEGER NOT NULL DEFAULT 0;\n"
+    "CREATE INDEX Reminders_active_scheduled_at ON Reminders (scheduled_at) WHERE finished_at IS NULL;\n"
+    "CREATE INDEX Reminders_active_warn_at ON Reminders (scheduled_at - lead_days) WHERE finished_at IS NULL;\n",
+    PERIOD_MIGRATION_SQL,
 };
 
-// TODO: can we just extract tore_path from db somehow?
-bool create_schema(sqlite3 *db, const char *tore_path)
+// Databases synced by `tore sync` insert rows independently of each other, so every one of them
+// allocates the ids of the new rows from its own range of 2^SITE_ID_BITS ids starting at
+// site << SITE_ID_BITS, and the rows never collide when the changes are exchanged. The databases
+// that do not take part in a sync have no SyncSite and keep using the range of the site 0.
+// Looking up the last id of the range is a single probe at the end of the range of the rowid.
+#define SITE_ID_BITS 32
+#define NEXT_ID_SQL(table)                                                                                        \
+    "(SELECT ifnull((SELECT id + 1 FROM "table" WHERE id >= base AND id < base + (1 << "STR(SITE_ID_BITS)") "     \
+    "ORDER BY id DESC LIMIT 1), base + 1) FROM (SELECT ifnull((SELECT site FROM SyncSite), 0) << "STR(SITE_ID_BITS)" AS base))"
+
+// Scheme of ~/.tore-archive. Dismissed Notifications and finished Reminders are moved there
+// from ~/.tore keeping their ids, so the history stays queryable.
+const char *archive_migrations[] = {
+    "CREATE TABLE IF NOT EXISTS Notifications (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at DATETIME NOT NULL,\n"
+    "    dismissed_at DATETIME NOT NULL,\n"
+    "    reminder_id INTEGER DEFAULT NULL,\n"
+    "    archived_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP\n"
+    ");\n",
+    "CREATE TABLE IF NOT EXISTS Reminders (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at DATETIME NOT NULL,\n"
+    "    scheduled_at DATE NOT NULL,\n"
+    "    period TEXT DEFAULT NULL,\n"
+    "    finished_at DATETIME NOT NULL,\n"
+    "    archived_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP\n"
+    ");\n",
+    "ALTER TABLE Notifications ADD COLUMN occurrences INTEGER NOT NULL DEFAULT 1;\n",
+
+    // Same integer timestamps as in ~/.tore
+    "CREATE TABLE Notifications_new (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at INTEGER NOT NULL,\n"
+    "    dismissed_at INTEGER NOT NULL,\n"
+    "    reminder_id INTEGER DEFAULT NULL,\n"
+    "    archived_at INTEGER NOT NULL DEFAULT (unixepoch()),\n"
+    "    occurrences INTEGER NOT NULL DEFAULT 1\n"
+    ");\n"
+    "INSERT INTO Notifications_new (id, title, created_at, dismissed_at, reminder_id, archived_at, occurrences)\n"
+    "SELECT id, title, unixepoch(created_at), unixepoch(dismissed_at), reminder_id, unixepoch(archived_at), occurrences FROM Notifications;\n"
+    "DROP TABLE Notifications;\n"
+    "ALTER TABLE Notifications_new RENAME TO Notifications;\n"
+    "CREATE TABLE Reminders_new (\n"
+    "    id INTEGER PRIMARY KEY ASC,\n"
+    "    title TEXT NOT NULL,\n"
+    "    created_at INTEGER NOT NULL,\n"
+    "    scheduled_at INTEGER NOT NULL,\n"
+    "    period TEXT DEFAULT NULL,\n"
+    "    finished_at INTEGER NOT NULL,\n"
+    "    archived_at INTEGER NOT NULL DEFAULT (unixepoch())\n"
+    ");\n"
+    "INSERT INTO Reminders_new (id, title, created_at, scheduled_at, period, finished_at, archived_at)\n"
+    "SELECT id, title, unixepoch(created_at), unixepoch(scheduled_at)/86400, period, unixepoch(finished_at), unixepoch(archived_at) FROM Reminders;\n"
+    "DROP TABLE Reminders;\n"
+    "ALTER TABLE Reminders_new RENAME TO Reminders;\n",
+    SEARCH_MIGRATION_SQL,
+    PERIOD_MIGRATION_SQL,
+};
+
+// Checks that the migrations applied to the database are a prefix of the expected ones and tells how many
+bool verify_migrations(sqlite3 *db, const char *tore_path, const char **migrations, size_t migrations_count, size_t *applied)
 {
     bool result = true;
     sqlite3_stmt *stmt = NULL;
-    if (!txn_begin(db)) return_defer(false);
-    const char *sql =
-        "CREATE TABLE IF NOT EXISTS Migrations (\n"
-        "    applied_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,\n"
-        "    query TEXT NOT NULL\n"
-        ");\n";
-    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
-        LOG_SQLITE3_ERROR(db);
-        return_defer(false);
-    }
 
     if (sqlite3_prepare_v2(db, "SELECT query FROM Migrations;", -1, &stmt, NULL)!= SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
@@ -95,7 +598,7 @@ bool create_schema(sqlite3 *db, const char *tore_path)
     size_t index = 0;
     int ret = sqlite3_step(stmt);
     for (; ret == SQLITE_ROW; ++index) {
-        if (index >= ARRAY_LEN(migrations)) {
+        if (index >= migrations_count) {
             fprintf(stderr, "ERROR: %s: Database scheme is too new. Contains more migrations applied than expected. Update your application.\n", tore_path);
             return_defer(false);
         }
@@ -113,11 +616,34 @@ bool create_schema(sqlite3 *db, const char *tore_path)
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
-    sqlite3_finalize(stmt);
-    stmt = NULL;
+    *applied = index;
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+// TODO: can we just extract tore_path from db somehow?
+bool create_schema(sqlite3 *db, const char *tore_path, const char **migrations, size_t migrations_count)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+    if (!txn_begin(db)) return_defer(false);
+    const char *sql =
+        "CREATE TABLE IF NOT EXISTS Migrations (\n"
+        "    applied_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,\n"
+        "    query TEXT NOT NULL\n"
+        ");\n";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    size_t index = 0;
+    if (!verify_migrations(db, tore_path, migrations, migrations_count, &index)) return_defer(false);
 
     bool tore_trace_migration_queries = getenv("TORE_TRACE_MIGRATION_QUERIES") != NULL;
-    for (; index < ARRAY_LEN(migrations); ++index) {
+    for (; index < migrations_count; ++index) {
         printf("INFO: %s: applying migration %zu\n", tore_path, index);
         if (tore_trace_migration_queries) printf("%s\n", migrations[index]);
         if (sqlite3_exec(db, migrations[index], NULL, NULL, NULL) != SQLITE_OK) {
@@ -151,53 +677,298 @@ defer:
     return result;
 }
 
+// A growable arena for the data loaded from the database. Unlike nob's temporary buffer it never
+// runs out: when the current chunk is full a new one is allocated. Rewinding keeps the chunks around,
+// so a long running `serve` reaches a steady state without calling malloc at all.
+#define ARENA_CHUNK_DEFAULT_CAPACITY (64*1024)
+
+typedef struct Arena_Chunk Arena_Chunk;
+struct Arena_Chunk {
+    Arena_Chunk *next;
+    size_t count;
+    size_t capacity;
+    char data[];
+};
+
+typedef struct {
+    Arena_Chunk *first;
+    Arena_Chunk *last; // the chunk allocations are made from. The chunks after it are empty.
+    // Open addressing hash set of the strings interned into this arena
+    const char **interned;
+    size_t interned_count;
+    size_t interned_capacity;
+} Arena;
+
 typedef struct {
-    int id;
-    const char *title;
-    const char *created_at;
-    int reminder_id;
-    int group_id;    // something that uniquely identifies a group of notifications and it is computed as ifnull(reminder_id, -id)
-} Notification;
+    Arena_Chunk *chunk;
+    size_t count;
+} Arena_Mark;
+
+void *arena_alloc(Arena *a, size_t size)
+{
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    while (a->last && a->last->count + size > a->last->capacity && a->last->next) {
+        a->last = a->last->next;
+    }
+    if (a->last == NULL || a->last->count + size > a->last->capacity) {
+        size_t capacity = size > ARENA_CHUNK_DEFAULT_CAPACITY ? size : ARENA_CHUNK_DEFAULT_CAPACITY;
+        Arena_Chunk *chunk = malloc(sizeof(Arena_Chunk) + capacity);
+        assert(chunk != NULL && "Buy more RAM lol");
+        chunk->next = NULL;
+        chunk->count = 0;
+        chunk->capacity = capacity;
+        if (a->last) {
+            // Splicing the new chunk right after the current one keeps the empty chunks after it reusable
+            chunk->next = a->last->next;
+            a->last->next = chunk;
+        } else {
+            a->first = chunk;
+        }
+        a->last = chunk;
+    }
+    void *result = a->last->data + a->last->count;
+    a->last->count += size;
+    return result;
+}
+
+const char *arena_strdup(Arena *a, const char *cstr)
+{
+    size_t n = strlen(cstr);
+    char *result = arena_alloc(a, n + 1);
+    memcpy(result, cstr, n + 1);
+    return result;
+}
+
+// Periodic Reminders produce lots of Notifications with the very same title. Interning stores each of them once.
+const char *arena_intern(Arena *a, const char *cstr)
+{
+    if (a->interned_count*2 >= a->interned_capacity) {
+        size_t new_capacity = a->interned_capacity ? a->interned_capacity*2 : 256;
+        const char **new_interned = calloc(new_capacity, sizeof(*new_interned));
+        assert(new_interned != NULL && "Buy more RAM lol");
+        for (size_t i = 0; i < a->interned_capacity; ++i) {
+            const char *it = a->interned[i];
+            if (it == NULL) continue;
+            size_t j = route_hash(it, strlen(it), 0) & (new_capacity - 1);
+            while (new_interned[j]) j = (j + 1) & (new_capacity - 1);
+            new_interned[j] = it;
+        }
+        free(a->interned);
+        a->interned = new_interned;
+        a->interned_capacity = new_capacity;
+    }
+
+    size_t i = route_hash(cstr, strlen(cstr), 0) & (a->interned_capacity - 1);
+    for (; a->interned[i]; i = (i + 1) & (a->interned_capacity - 1)) {
+        if (strcmp(a->interned[i], cstr) == 0) return a->interned[i];
+    }
+    a->interned[i] = arena_strdup(a, cstr);
+    a->interned_count += 1;
+    return a->interned[i];
+}
+
+Arena_Mark arena_save(Arena *a)
+{
+    return (Arena_Mark) {
+        .chunk = a->last,
+        .count = a->last ? a->last->count : 0,
+    };
+}
+
+void arena_rewind(Arena *a, Arena_Mark mark)
+{
+    Arena_Chunk *chunk = mark.chunk ? mark.chunk : a->first;
+    if (chunk) {
+        chunk->count = mark.count;
+        for (Arena_Chunk *it = chunk->next; it; it = it->next) it->count = 0;
+    }
+    a->last = chunk;
+    // The interned strings allocated after the mark are gone. Forgetting all of them is simpler than
+    // sorting out which ones survived, and only costs some duplicates afterwards.
+    if (a->interned) memset(a->interned, 0, a->interned_capacity*sizeof(*a->interned));
+    a->interned_count = 0;
+}
+
+void arena_reset(Arena *a)
+{
+    arena_rewind(a, (Arena_Mark) {0});
+}
+
+void arena_free(Arena *a)
+{
+    Arena_Chunk *it = a->first;
+    while (it) {
+        Arena_Chunk *next = it->next;
+        free(it);
+        it = next;
+    }
+    free(a->interned);
+    memset(a, 0, sizeof(*a));
+}
+
+// Days since 1970-01-01 of the civil date year-month-day in the proleptic Gregorian calendar.
+// Taken from http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399)/400;
+    unsigned yoe = (unsigned)(year - era*400);
+    unsigned doy = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1;
+    unsigned doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return era*146097 + (int64_t)doe - 719468;
+}
+
+// Inverse of days_from_civil().
+// Taken from http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+void civil_from_days(int64_t days, int64_t *year, unsigned *month, unsigned *day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096)/146097;
+    unsigned doe = (unsigned)(days - era*146097);
+    unsigned yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+    unsigned doy = doe - (365*yoe + yoe/4 - yoe/100);
+    unsigned mp = (5*doy + 2)/153;
+    *day = doy - (153*mp + 2)/5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int64_t)yoe + era*400 + (*month <= 2);
+}
+
+// Days since 1970-01-01 of the current local date. This is the only place where the current date is
+// converted to localtime. Everything else compares against the result as plain integers.
+int64_t today_local_days(void)
+{
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+const char *render_date_temp(int64_t days)
+{
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(days, &year, &month, &day);
+    return temp_sprintf("%04lld-%02u-%02u", (long long)year, month, day);
+}
+
+const char *render_days_until_temp(int64_t days)
+{
+    if (days == 0) return "today";
+    if (days == 1) return "tomorrow";
+    if (days == -1) return "yesterday";
+    if (days < 0) return temp_sprintf("%"PRIi64" days ago", -days);
+    return temp_sprintf("in %"PRIi64" days", days);
+}
+
+const char *render_timestamp_temp(int64_t timestamp)
+{
+    time_t t = (time_t)timestamp;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    return temp_strdup(buffer);
+}
+
+// Notifications_active_group_id is built on exactly this expression, the queries must spell it the same way.
+#define NOTIFICATION_GROUP_ID_SQL "ifnull(reminder_id, -id)"
+
+// The results of the loaders are stored column by column: a parallel array per field, so the printers
+// walk the memory linearly. The strings are copied into the Arena passed to the loader straight from
+// sqlite3_column_text(), one bump allocation each.
+
+// Copies the text of the column of the current row of stmt into the arena. Consecutive rows often have
+// the same text (the Notifications of a periodic Reminder), so previous is reused in that case. Unlike
+// arena_intern() this costs nothing for distinct strings beyond a single comparison.
+const char *arena_strdup_column(Arena *a, sqlite3_stmt *stmt, int column, const char *previous)
+{
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    size_t length = sqlite3_column_bytes(stmt, column);
+    if (text == NULL) return "";
+    if (previous && strncmp(previous, text, length + 1) == 0) return previous;
+    char *result = arena_alloc(a, length + 1);
+    memcpy(result, text, length + 1);
+    return result;
+}
+
+void *grow_column(void *column, size_t item_size, size_t capacity)
+{
+    void *result = realloc(column, item_size*capacity);
+    assert(result != NULL && "Buy more RAM lol");
+    return result;
+}
+
+#define GROW_COLUMN(columns, name) (columns)->name = grow_column((columns)->name, sizeof(*(columns)->name), (columns)->capacity)
 
 typedef struct {
-    Notification *items;
     size_t count;
     size_t capacity;
+    int64_t *id;
+    const char **title;
+    int64_t *created_at;
+    int64_t *reminder_id;
+    int64_t *group_id; // something that uniquely identifies a group of notifications. See NOTIFICATION_GROUP_ID_SQL
+    int *occurrences; // the amount of times the Reminder fired off into this Notification (see fire_off_reminders())
 } Notifications;
 
-bool load_active_notifications_of_group(sqlite3 *db, int group_id, Notifications *ns)
+void notifications_reserve_one(Notifications *ns)
+{
+    if (ns->count < ns->capacity) return;
+    ns->capacity = ns->capacity ? ns->capacity*2 : 256;
+    GROW_COLUMN(ns, id);
+    GROW_COLUMN(ns, title);
+    GROW_COLUMN(ns, created_at);
+    GROW_COLUMN(ns, reminder_id);
+    GROW_COLUMN(ns, group_id);
+    GROW_COLUMN(ns, occurrences);
+}
+
+void notifications_free(Notifications *ns)
+{
+    free(ns->id);
+    free(ns->title);
+    free(ns->created_at);
+    free(ns->reminder_id);
+    free(ns->group_id);
+    free(ns->occurrences);
+    memset(ns, 0, sizeof(*ns));
+}
+
+// The group of a Notification: its Reminder, or the Notification itself if it's standalone.
+// Notifications_active_group_id is built on exactly this expression, the queries must spell it the same way.
+#define NOTIFICATION_GROUP_ID_SQL "ifnull(reminder_id, -id)"
+
+// Must be a seek on Notifications_active_group_id. `tore check` verifies that.
+#define ACTIVE_NOTIFICATIONS_OF_GROUP_SQL \
+    "SELECT id, title, created_at, reminder_id, "NOTIFICATION_GROUP_ID_SQL", occurrences " \
+    "FROM Notifications WHERE dismissed_at IS NULL AND "NOTIFICATION_GROUP_ID_SQL" = ?1 ORDER BY created_at"
+
+bool load_active_notifications_of_group(sqlite3 *db, Arena *arena, int64_t group_id, Notifications *ns)
 {
     bool result = true;
     sqlite3_stmt *stmt = NULL;
 
-    int ret = sqlite3_prepare_v2(db,
-        "SELECT id, title, datetime(created_at, 'localtime') as ts, reminder_id, ifnull(reminder_id, -id) as group_id "
-        "FROM Notifications WHERE dismissed_at IS NULL AND group_id = ? ORDER BY ts;",
-        -1, &stmt, NULL);
+    int ret = sqlite3_prepare_v2(db, ACTIVE_NOTIFICATIONS_OF_GROUP_SQL, -1, &stmt, NULL);
     if (ret != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
-    if (sqlite3_bind_int(stmt, 1, group_id) != SQLITE_OK) {
+    if (sqlite3_bind_int64(stmt, 1, group_id) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
     for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
         int column = 0;
-        int id = sqlite3_column_int(stmt, column++);
-        const char *title = temp_strdup((const char *)sqlite3_column_text(stmt, column++));
-        const char *created_at = temp_strdup((const char *)sqlite3_column_text(stmt, column++));
-        int reminder_id = sqlite3_column_int(stmt, column++);
-        int group_id = sqlite3_column_int(stmt, column++);
-        da_append(ns, ((Notification) {
-            .id = id,
-            .title = title,
-            .created_at = created_at,
-            .reminder_id = reminder_id,
-            .group_id = group_id,
-        }));
+        notifications_reserve_one(ns);
+        size_t i = ns->count++;
+        ns->id[i]          = sqlite3_column_int64(stmt, column++);
+        ns->title[i]       = arena_strdup_column(arena, stmt, column++, i > 0 ? ns->title[i - 1] : NULL);
+        ns->created_at[i]  = sqlite3_column_int64(stmt, column++);
+        ns->reminder_id[i] = sqlite3_column_int64(stmt, column++);
+        ns->group_id[i]    = sqlite3_column_int64(stmt, column++);
+        ns->occurrences[i] = sqlite3_column_int(stmt, column++);
     }
 
     if (ret != SQLITE_DONE) {
@@ -211,20 +982,40 @@ defer:
 }
 
 typedef struct {
-    const char *title;       // TODO: maybe in case of group_id > 0 the title should be the title of the corresponding reminder?
-    const char *created_at;  // TODO: maybe in case of group_id > 0 the created_at should be the created_at of the latest notification?
-    int reminder_id;
-    int group_id;    // something that uniquely identifies a group of notifications and it is computed as ifnull(reminder_id, -id)
-    int group_count; // the amount of notificatiosn in the group (must be always > 0)
-} Grouped_Notification;
-
-typedef struct {
-    Grouped_Notification *items;
     size_t count;
     size_t capacity;
+    const char **title;   // TODO: maybe in case of group_id > 0 the title should be the title of the corresponding reminder?
+    int64_t *created_at; // created_at of the latest notification in the group
+    int64_t *reminder_id;
+    int64_t *group_id;   // something that uniquely identifies a group of notifications. See NOTIFICATION_GROUP_ID_SQL
+    int *group_count; // the amount of notificatiosn in the group (must be always > 0)
+    int *occurrences; // the amount of times the Reminders fired off in the group (>= group_count, see fire_off_reminders())
 } Grouped_Notifications;
 
-bool load_active_grouped_notifications(sqlite3 *db, Grouped_Notifications *notifs)
+void grouped_notifications_reserve_one(Grouped_Notifications *gns)
+{
+    if (gns->count < gns->capacity) return;
+    gns->capacity = gns->capacity ? gns->capacity*2 : 256;
+    GROW_COLUMN(gns, title);
+    GROW_COLUMN(gns, created_at);
+    GROW_COLUMN(gns, reminder_id);
+    GROW_COLUMN(gns, group_id);
+    GROW_COLUMN(gns, group_count);
+    GROW_COLUMN(gns, occurrences);
+}
+
+void grouped_notifications_free(Grouped_Notifications *gns)
+{
+    free(gns->title);
+    free(gns->created_at);
+    free(gns->reminder_id);
+    free(gns->group_id);
+    free(gns->group_count);
+    free(gns->occurrences);
+    memset(gns, 0, sizeof(*gns));
+}
+
+bool load_active_grouped_notifications(sqlite3 *db, Arena *arena, Grouped_Notifications *notifs)
 {
     bool result = true;
     sqlite3_stmt *stmt = NULL;
@@ -244,9 +1035,11 @@ bool load_active_grouped_notifications(sqlite3 *db, Grouped_Notifications *notif
     //   ```
     //   Which is a working solution, but all the other problems UUIDs address remain.
 
+    //   The groups themselves are maintained by triggers in NotificationGroups (see the migrations).
+
     int ret = sqlite3_prepare_v2(db,
-        "SELECT title, datetime(created_at, 'localtime') as ts, reminder_id, ifnull(reminder_id, -id) as group_id, count(*) as group_count "
-        "FROM Notifications WHERE dismissed_at IS NULL GROUP BY group_id ORDER BY ts;",
+        "SELECT title, last_created_at, reminder_id, group_id, active_count, occurrences "
+        "FROM NotificationGroups ORDER BY last_created_at;",
         -1, &stmt, NULL);
     if (ret != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
@@ -255,18 +1048,14 @@ bool load_active_grouped_notifications(sqlite3 *db, Grouped_Notifications *notif
 
     for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
         int column = 0;
-        const char *title = temp_strdup((const char *)sqlite3_column_text(stmt, column++));
-        const char *created_at = temp_strdup((const char *)sqlite3_column_text(stmt, column++));
-        int reminder_id = sqlite3_column_int(stmt, column++);
-        int group_id = sqlite3_column_int(stmt, column++);
-        int group_count = sqlite3_column_int(stmt, column++);
-        da_append(notifs, ((Grouped_Notification) {
-            .title = title,
-            .created_at = created_at,
-            .reminder_id = reminder_id,
-            .group_id = group_id,
-            .group_count = group_count,
-        }));
+        grouped_notifications_reserve_one(notifs);
+        size_t i = notifs->count++;
+        notifs->title[i]       = arena_strdup_column(arena, stmt, column++, NULL);
+        notifs->created_at[i]  = sqlite3_column_int64(stmt, column++);
+        notifs->reminder_id[i] = sqlite3_column_int64(stmt, column++);
+        notifs->group_id[i]    = sqlite3_column_int64(stmt, column++);
+        notifs->group_count[i] = sqlite3_column_int(stmt, column++);
+        notifs->occurrences[i] = sqlite3_column_int(stmt, column++);
     }
 
     if (ret != SQLITE_DONE) {
@@ -279,72 +1068,154 @@ defer:
     return result;
 }
 
-void display_grouped_notifications(Grouped_Notifications gns)
+void render_grouped_notifications(String_Builder *sb, Grouped_Notifications gns)
 {
     for (size_t i = 0; i < gns.count; ++i) {
-        Grouped_Notification *it = &gns.items[i];
-        assert(it->group_count > 0);
-        if (it->group_count == 1) {
-            printf("%zu: %s (%s)\n", i, it->title, it->created_at);
+        assert(gns.group_count[i] > 0);
+        size_t checkpoint = temp_save();
+        if (gns.occurrences[i] == 1) {
+            sb_append_cstr(sb, temp_sprintf("%zu: %s (%s)\n", i, gns.title[i], render_timestamp_temp(gns.created_at[i])));
         } else {
-            printf("%zu: [%d] %s (%s)\n", i, it->group_count, it->title, it->created_at);
+            sb_append_cstr(sb, temp_sprintf("%zu: [%d] %s (%s)\n", i, gns.occurrences[i], gns.title[i], render_timestamp_temp(gns.created_at[i])));
         }
+        temp_rewind(checkpoint);
     }
 }
 
-bool show_active_notifications(sqlite3 *db)
+// Renders the active notifications into out and prints them
+bool show_active_notifications_into(sqlite3 *db, String_Builder *out)
 {
     bool result = true;
+    Arena arena = {0};
     Grouped_Notifications gns = {0};
 
-    if (!load_active_grouped_notifications(db, &gns)) return_defer(false);
-    display_grouped_notifications(gns);
+    if (!load_active_grouped_notifications(db, &arena, &gns)) return_defer(false);
+    render_grouped_notifications(out, gns);
+    fwrite(out->items, 1, out->count, stdout);
 
 defer:
-    free(gns.items);
+    grouped_notifications_free(&gns);
+    arena_free(&arena);
     return result;
 }
 
-bool show_expanded_notifications_by_index(sqlite3 *db, size_t index)
-{
-    bool result = true;
-
-    Grouped_Notifications gns = {0};
-    Notifications ns = {0};
-
-    if (!load_active_grouped_notifications(db, &gns)) return_defer(false);
-    if (index >= gns.count) {
-        fprintf(stderr, "ERROR: invalid index\n");
-        return false;
-    }
-    if (!load_active_notifications_of_group(db, gns.items[index].group_id, &ns)) return_defer(false);
-
-    for (size_t i = 0; i < ns.count; ++i) {
-        Notification *it = &ns.items[i];
-        printf("%s (%s)\n", it->title, it->created_at);
-    }
-
-defer:
-    free(gns.items);
-    free(ns.items);
-    return result;
-}
+// The Reminders that fire off within the next upcoming_days days or within their own lead_days.
+// Must be a seek on Reminders_active_warn_at. `tore check` verifies that. The unary + keeps SQLite
+// from picking Reminders_active_scheduled_at for the lower bound, which would scan all the future.
+#define UPCOMING_REMINDERS_SQL \
+    "SELECT title, scheduled_at FROM Reminders " \
+    "WHERE finished_at IS NULL AND scheduled_at - lead_days <= ?1 + ?2 AND +scheduled_at > ?1 " \
+    "ORDER BY scheduled_at - lead_days"
 
-bool dismiss_grouped_notification_by_group_id(sqlite3 *db, int group_id)
+bool show_upcoming_reminders_into(sqlite3 *db, int64_t today, int64_t upcoming_days, String_Builder *out)
 {
     bool result = true;
     sqlite3_stmt *stmt = NULL;
+    size_t start = out->count;
 
-    int ret = sqlite3_prepare_v2(db,
-            "UPDATE Notifications SET dismissed_at = CURRENT_TIMESTAMP "
-            "WHERE dismissed_at is NULL AND ifnull(reminder_id, -id) = ?", -1,
-            &stmt, NULL);
-    if (ret != SQLITE_OK) {
+    if (sqlite3_prepare_v2(db, UPCOMING_REMINDERS_SQL, -1, &stmt, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
-
-    if (sqlite3_bind_int(stmt, 1, group_id) != SQLITE_OK) {
+    if (sqlite3_bind_int64(stmt, 1, today) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 2, upcoming_days) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        const char *title = (const char *)sqlite3_column_text(stmt, 0);
+        int64_t scheduled_at = sqlite3_column_int64(stmt, 1);
+        size_t checkpoint = temp_save();
+        sb_append_cstr(out, temp_sprintf("Upcoming: %s (%s, %s)\n", title, render_days_until_temp(scheduled_at - today), render_date_temp(scheduled_at)));
+        temp_rewind(checkpoint);
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    fwrite(out->items + start, 1, out->count - start, stdout);
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool show_active_notifications(sqlite3 *db)
+{
+    String_Builder out = {0};
+    bool result = show_active_notifications_into(db, &out);
+    free(out.items);
+    return result;
+}
+
+bool show_expanded_notifications_by_index(sqlite3 *db, size_t index)
+{
+    bool result = true;
+
+    Arena arena = {0};
+    Grouped_Notifications gns = {0};
+    Notifications ns = {0};
+
+    if (!load_active_grouped_notifications(db, &arena, &gns)) return_defer(false);
+    if (index >= gns.count) {
+        fprintf(stderr, "ERROR: invalid index\n");
+        return_defer(false);
+    }
+    if (!load_active_notifications_of_group(db, &arena, gns.group_id[index], &ns)) return_defer(false);
+
+    for (size_t i = 0; i < ns.count; ++i) {
+        size_t checkpoint = temp_save();
+        if (ns.occurrences[i] == 1) {
+            printf("%s (%s)\n", ns.title[i], render_timestamp_temp(ns.created_at[i]));
+        } else {
+            printf("[%d] %s (%s)\n", ns.occurrences[i], ns.title[i], render_timestamp_temp(ns.created_at[i]));
+        }
+        temp_rewind(checkpoint);
+    }
+
+defer:
+    grouped_notifications_free(&gns);
+    notifications_free(&ns);
+    arena_free(&arena);
+    return result;
+}
+
+typedef struct {
+    int64_t *items;
+    size_t count;
+    size_t capacity;
+} Group_Ids;
+
+// Must be a seek on Notifications_active_group_id. `tore check` verifies that.
+#define DISMISS_GROUPS_SQL \
+    "UPDATE Notifications SET dismissed_at = unixepoch() " \
+    "WHERE dismissed_at IS NULL AND "NOTIFICATION_GROUP_ID_SQL" IN (SELECT value FROM json_each(?1))"
+
+// Dismisses all the provided groups in a single UPDATE. The group ids are passed as a JSON array.
+bool dismiss_grouped_notifications_by_group_ids(sqlite3 *db, Group_Ids group_ids, int *how_many_dismissed)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+    String_Builder json = {0};
+
+    sb_append_cstr(&json, "[");
+    for (size_t i = 0; i < group_ids.count; ++i) {
+        if (i > 0) sb_append_cstr(&json, ",");
+        sb_append_cstr(&json, temp_sprintf("%"PRIi64, group_ids.items[i]));
+    }
+    sb_append_cstr(&json, "]");
+
+    int ret = sqlite3_prepare_v2(db, DISMISS_GROUPS_SQL, -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    if (sqlite3_bind_text(stmt, 1, json.items, json.count, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
@@ -354,29 +1225,73 @@ bool dismiss_grouped_notification_by_group_id(sqlite3 *db, int group_id)
         return_defer(false);
     }
 
+    if (how_many_dismissed) *how_many_dismissed += sqlite3_changes(db);
+
 defer:
     if (stmt) sqlite3_finalize(stmt);
+    free(json.items);
     return result;
 }
 
+bool dismiss_all_notifications(sqlite3 *db, int *how_many_dismissed)
+{
+    if (sqlite3_exec(db, "UPDATE Notifications SET dismissed_at = unixepoch() WHERE dismissed_at IS NULL", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return false;
+    }
+    if (how_many_dismissed) *how_many_dismissed += sqlite3_changes(db);
+    return true;
+}
+
+// Parses either a single index like `3` or an inclusive range of indices like `3-40`
+bool parse_index_range(const char *arg, int *begin, int *end)
+{
+    char *endptr = NULL;
+    long a = strtol(arg, &endptr, 10);
+    if (endptr == arg || a < 0 || a > INT_MAX) return false;
+    long b = a;
+    if (*endptr == '-') {
+        const char *second = endptr + 1;
+        b = strtol(second, &endptr, 10);
+        if (endptr == second || b < a || b > INT_MAX) return false;
+    }
+    if (*endptr != '\0') return false;
+    *begin = a;
+    *end = b;
+    return true;
+}
+
 bool dismiss_grouped_notifications_by_indices_from_args(sqlite3 *db, int *how_many_dismissed, int argc, char **argv)
 {
     bool result = true;
 
+    Arena arena = {0};
     Grouped_Notifications gns = {0};
-    if (!load_active_grouped_notifications(db, &gns)) return_defer(false);
+    Group_Ids group_ids = {0};
+    if (!load_active_grouped_notifications(db, &arena, &gns)) return_defer(false);
     while (argc > 0) {
-        int index = atoi(shift(argv, argc));
-        if (!(0 <= index && (size_t)index < gns.count)) {
-            fprintf(stderr, "WARNING: %d is not a valid index of an active notification\n", index);
+        const char *arg = shift(argv, argc);
+        int begin, end;
+        if (!parse_index_range(arg, &begin, &end)) {
+            fprintf(stderr, "WARNING: %s is not a valid index or range of indices\n", arg);
             continue;
         }
-        if (!dismiss_grouped_notification_by_group_id(db, gns.items[index].group_id)) return_defer(false);
-        if (how_many_dismissed) *how_many_dismissed += gns.items[index].group_count;
+        for (int index = begin; index <= end; ++index) {
+            if ((size_t)index >= gns.count) {
+                fprintf(stderr, "WARNING: %d is not a valid index of an active notification\n", index);
+                break;
+            }
+            da_append(&group_ids, gns.group_id[index]);
+        }
+    }
+    if (group_ids.count > 0) {
+        if (!dismiss_grouped_notifications_by_group_ids(db, group_ids, how_many_dismissed)) return_defer(false);
     }
 
 defer:
-    free(gns.items);
+    free(group_ids.items);
+    grouped_notifications_free(&gns);
+    arena_free(&arena);
     return result;
 }
 
@@ -385,7 +1300,7 @@ bool create_notification_with_title(sqlite3 *db, const char *title)
     bool result = true;
     sqlite3_stmt *stmt = NULL;
 
-    if (sqlite3_prepare_v2(db, "INSERT INTO Notifications (title) VALUES (?)", -1, &stmt, NULL) != SQLITE_OK) {
+    if (sqlite3_prepare_v2(db, "INSERT INTO Notifications (id, title) VALUES ("NEXT_ID_SQL("Notifications")", ?)", -1, &stmt, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
@@ -404,42 +1319,64 @@ defer:
 }
 
 typedef struct {
-    int id;
-    const char *title;
-    const char *scheduled_at;
-    const char *period;
-} Reminder;
-
-typedef struct {
-    Reminder *items;
     size_t count;
     size_t capacity;
+    int64_t *id;
+    const char **title;
+    int64_t *scheduled_at; // days since 1970-01-01
+    int *period_unit;      // Period, PERIOD_NONE if the Reminder is not periodic
+    int64_t *period_length;
+    unsigned *period_day;  // the day of the month the monthly and yearly Reminders are anchored to
+    int64_t *lead_days;    // how many days before scheduled_at checkout starts showing it
 } Reminders;
 
-bool load_active_reminders(sqlite3 *db, Reminders *reminders)
+void reminders_reserve_one(Reminders *rs)
+{
+    if (rs->count < rs->capacity) return;
+    rs->capacity = rs->capacity ? rs->capacity*2 : 256;
+    GROW_COLUMN(rs, id);
+    GROW_COLUMN(rs, title);
+    GROW_COLUMN(rs, scheduled_at);
+    GROW_COLUMN(rs, period_unit);
+    GROW_COLUMN(rs, period_length);
+    GROW_COLUMN(rs, period_day);
+    GROW_COLUMN(rs, lead_days);
+}
+
+void reminders_free(Reminders *rs)
+{
+    free(rs->id);
+    free(rs->title);
+    free(rs->scheduled_at);
+    free(rs->period_unit);
+    free(rs->period_length);
+    free(rs->period_day);
+    free(rs->lead_days);
+    memset(rs, 0, sizeof(*rs));
+}
+
+bool load_active_reminders(sqlite3 *db, Arena *arena, Reminders *reminders)
 {
     bool result = true;
 
     sqlite3_stmt *stmt = NULL;
 
-    int ret = sqlite3_prepare_v2(db, "SELECT id, title, scheduled_at, period FROM Reminders WHERE finished_at IS NULL ORDER BY scheduled_at DESC", -1, &stmt, NULL);
+    int ret = sqlite3_prepare_v2(db, "SELECT id, title, scheduled_at, ifnull(period_unit, -1), period_length, period_day, lead_days FROM Reminders WHERE finished_at IS NULL ORDER BY scheduled_at DESC", -1, &stmt, NULL);
     if (ret != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
     for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
-        int id = sqlite3_column_int(stmt, 0);
-        const char *title = temp_strdup((const char *)sqlite3_column_text(stmt, 1));
-        const char *scheduled_at = temp_strdup((const char *)sqlite3_column_text(stmt, 2));
-        const char *period = (const char *)sqlite3_column_text(stmt, 3);
-        if (period != NULL) period = temp_strdup(period);
-        da_append(reminders, ((Reminder) {
-            .id = id,
-            .title = title,
-            .scheduled_at = scheduled_at,
-            .period = period,
-        }));
+        reminders_reserve_one(reminders);
+        size_t i = reminders->count++;
+        reminders->id[i]            = sqlite3_column_int64(stmt, 0);
+        reminders->title[i]         = arena_strdup_column(arena, stmt, 1, NULL);
+        reminders->scheduled_at[i]  = sqlite3_column_int64(stmt, 2);
+        reminders->period_unit[i]   = sqlite3_column_int(stmt, 3);
+        reminders->period_length[i] = sqlite3_column_int64(stmt, 4);
+        reminders->period_day[i]    = sqlite3_column_int(stmt, 5);
+        reminders->lead_days[i]     = sqlite3_column_int64(stmt, 6);
     }
 
     if (ret != SQLITE_DONE) {
@@ -483,26 +1420,147 @@ Period period_by_tore_modifier(const char *modifier)
     return PERIOD_NONE;
 }
 
-const char *render_period_as_sqlite3_datetime_modifier_temp(Period period, unsigned long period_length)
+// The Period as `remind` accepts it, like 2w. The Reminders are exported that way.
+static_assert(PERIOD_DAY == 0 && PERIOD_WEEK == 1 && PERIOD_MONTH == 2 && PERIOD_YEAR == 3, "The Periods are stored in the database");
+#define PERIOD_NOTATION_SQL "period_length || substr('dwmy', period_unit + 1, 1)"
+
+const char *render_period_temp(Period unit, int64_t length)
+{
+    const char *name = tore_period_modifiers[unit].name;
+    if (length == 1) return temp_sprintf("%.*s", (int)strlen(name) - 1, name);
+    return temp_sprintf("%"PRIi64" %s", length, name);
+}
+
+unsigned days_in_month(int64_t year, unsigned month)
+{
+    if (month == 2) return 28 + (year%4 == 0 && (year%100 != 0 || year%400 == 0));
+    // 31 days in the odd months until July and in the even ones since August
+    return 30 + ((month + (month >> 3)) & 1);
+}
+
+// Steps the date by the period. The monthly and yearly periods keep the day of the month anchor_day
+// (or the one of days if it's 0) and clamp it to the end of the shorter months, so a Reminder anchored
+// to the 31st fires off on 2024-01-31, 2024-02-29, 2024-03-31 and so on. Years are 12 months.
+int64_t period_advance(int64_t days, Period unit, int64_t length, unsigned anchor_day)
 {
-    switch (period) {
-    case PERIOD_NONE:  return NULL;
-    case PERIOD_DAY:   return temp_sprintf("+%lu days",   period_length);
-    case PERIOD_WEEK:  return temp_sprintf("+%lu days",   period_length*7);
-    case PERIOD_MONTH: return temp_sprintf("+%lu months", period_length);
-    case PERIOD_YEAR:  return temp_sprintf("+%lu years",  period_length);
+    switch (unit) {
+    case PERIOD_DAY:  return days + length;
+    case PERIOD_WEEK: return days + length*7;
+    case PERIOD_MONTH:
+    case PERIOD_YEAR: {
+        int64_t year;
+        unsigned month, day;
+        civil_from_days(days, &year, &month, &day);
+        if (anchor_day == 0) anchor_day = day;
+        int64_t months = year*12 + (month - 1) + (unit == PERIOD_YEAR ? length*12 : length);
+        year = months >= 0 ? months/12 : (months - 11)/12;
+        month = (unsigned)(months - year*12) + 1;
+        unsigned last = days_in_month(year, month);
+        return days_from_civil(year, month, anchor_day < last ? anchor_day : last);
+    }
+    case PERIOD_NONE:
     case COUNT_PERIODS:
-    default: UNREACHABLE("render_period_as_sqlite3_datetime_modifier_temp");
+    default: UNREACHABLE("period_advance");
+    }
+}
+
+// The occurrences of the Reminders within a range of days, sorted by day
+typedef struct {
+    size_t count;
+    size_t capacity;
+    int64_t *day;       // days since 1970-01-01
+    uint32_t *reminder; // index in the Reminders the occurrences were expanded from
+} Occurrences;
+
+void occurrences_reserve(Occurrences *os, size_t count)
+{
+    if (count <= os->capacity) return;
+    while (os->capacity < count) os->capacity = os->capacity ? os->capacity*2 : 256;
+    GROW_COLUMN(os, day);
+    GROW_COLUMN(os, reminder);
+}
+
+void occurrences_free(Occurrences *os)
+{
+    free(os->day);
+    free(os->reminder);
+    memset(os, 0, sizeof(*os));
+}
+
+// Expands all the Reminders over the days [from, to) in one pass without asking SQLite for anything.
+// The Reminders that repeat every N days or weeks jump straight into the range. The rest step from their
+// scheduled_at, which is never in the past for longer than until the next checkout, so that's at most
+// one step per month of the range. The result is sorted by counting the occurrences per day, which
+// is linear, because the range is a calendar and not that long.
+void expand_occurrences(Reminders reminders, int64_t from, int64_t to, Occurrences *os, Occurrences *scratch)
+{
+    os->count = 0;
+    scratch->count = 0;
+    if (to <= from) return;
+
+    for (size_t i = 0; i < reminders.count; ++i) {
+        int64_t day = reminders.scheduled_at[i];
+        Period unit = reminders.period_unit[i];
+        int64_t length = reminders.period_length[i];
+
+        if (unit == PERIOD_NONE || length <= 0) {
+            if (from <= day && day < to) {
+                occurrences_reserve(scratch, scratch->count + 1);
+                scratch->day[scratch->count] = day;
+                scratch->reminder[scratch->count] = i;
+                scratch->count += 1;
+            }
+            continue;
+        }
+
+        if (unit == PERIOD_DAY || unit == PERIOD_WEEK) {
+            if (unit == PERIOD_WEEK) length *= 7;
+            if (day < from) day += (from - day + length - 1)/length*length;
+            if (day >= to) continue;
+            size_t n = (to - day + length - 1)/length;
+            occurrences_reserve(scratch, scratch->count + n);
+            for (size_t k = 0; k < n; ++k, day += length) {
+                scratch->day[scratch->count + k] = day;
+                scratch->reminder[scratch->count + k] = i;
+            }
+            scratch->count += n;
+            continue;
+        }
+
+        for (; day < to; day = period_advance(day, unit, length, reminders.period_day[i])) {
+            if (day < from) continue;
+            occurrences_reserve(scratch, scratch->count + 1);
+            scratch->day[scratch->count] = day;
+            scratch->reminder[scratch->count] = i;
+            scratch->count += 1;
+        }
+    }
+
+    size_t days = to - from;
+    size_t *starts = calloc(days + 1, sizeof(*starts));
+    assert(starts != NULL && "Buy more RAM lol");
+    for (size_t i = 0; i < scratch->count; ++i) starts[scratch->day[i] - from + 1] += 1;
+    for (size_t d = 0; d < days; ++d) starts[d + 1] += starts[d];
+    occurrences_reserve(os, scratch->count);
+    for (size_t i = 0; i < scratch->count; ++i) {
+        size_t j = starts[scratch->day[i] - from]++;
+        os->day[j] = scratch->day[i];
+        os->reminder[j] = scratch->reminder[i];
     }
+    os->count = scratch->count;
+    free(starts);
 }
 
-bool create_new_reminder(sqlite3 *db, const char *title, const char *scheduled_at, Period period, unsigned long period_length)
+bool create_new_reminder(sqlite3 *db, const char *title, int64_t scheduled_at, Period period, unsigned long period_length, int64_t lead_days)
 {
     bool result = true;
 
     sqlite3_stmt *stmt = NULL;
 
-    if (sqlite3_prepare_v2(db, "INSERT INTO Reminders (title, scheduled_at, period) VALUES (?, ?, ?)", -1, &stmt, NULL) != SQLITE_OK) {
+    const char *sql =
+        "INSERT INTO Reminders (id, title, scheduled_at, period_unit, period_length, period_day, lead_days) "
+        "VALUES ("NEXT_ID_SQL("Reminders")", ?, ?, ?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
@@ -510,12 +1568,27 @@ bool create_new_reminder(sqlite3 *db, const char *title, const char *scheduled_a
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
-    if (sqlite3_bind_text(stmt, 2, scheduled_at, strlen(scheduled_at), NULL) != SQLITE_OK) {
+    if (sqlite3_bind_int64(stmt, 2, scheduled_at) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int ret = period == PERIOD_NONE ? sqlite3_bind_null(stmt, 3) : sqlite3_bind_int(stmt, 3, period);
+    if (ret != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 4, period == PERIOD_NONE ? 0 : period_length) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(scheduled_at, &year, &month, &day);
+    if (sqlite3_bind_int(stmt, 5, period == PERIOD_NONE ? 0 : day) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
-    const char *rendered_period = render_period_as_sqlite3_datetime_modifier_temp(period, period_length);
-    if (sqlite3_bind_text(stmt, 3, rendered_period, rendered_period ? strlen(rendered_period) : 0, NULL) != SQLITE_OK) {
+    if (sqlite3_bind_int64(stmt, 6, lead_days) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
@@ -529,36 +1602,142 @@ defer:
     return result;
 }
 
-// NOTE: The general policy of the application is that all the date times are stored in GMT, but before displaying them and/or making logical decisions upon them they are converted to localtime.
-bool fire_off_reminders(sqlite3 *db)
+// Must be a seek on Reminders_active_scheduled_at. `tore check` verifies that.
+#define DUE_REMINDERS_SQL \
+    "SELECT id, scheduled_at, ifnull(period_unit, -1), period_length, period_day " \
+    "FROM Reminders WHERE scheduled_at <= ?1 AND finished_at IS NULL"
+
+typedef enum {
+    CATCH_UP_EACH,     // every missed occurrence of a periodic Reminder becomes its own Notification
+    CATCH_UP_COALESCE, // all the missed occurrences of a periodic Reminder become one Notification with their count
+} Catch_Up_Mode;
+
+// NOTE: The general policy of the application is that all the timestamps are stored as seconds since the Unix Epoch
+// and converted to localtime only for displaying. The scheduled dates of Reminders are local dates stored as days since
+// the Unix Epoch and compared against today_local_days().
+bool fire_off_reminders(sqlite3 *db, Catch_Up_Mode catch_up, int64_t today)
 {
     bool result = true;
-
     sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *insert = NULL;
+
+    const char *sql =
+        "CREATE TEMP TABLE IF NOT EXISTS DueReminders (reminder_id INTEGER PRIMARY KEY, occurrences INTEGER NOT NULL, next_scheduled_at INTEGER);\n"
+        "DELETE FROM temp.DueReminders;\n";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    // Counting all the occurrences of the due Reminders up to today in one pass. So if you did not
+    // run tore for two weeks a daily Reminder catches up on all 14 days at once.
+    // Periods measured in days and weeks are caught up in a closed form. Periods measured in months
+    // and years are stepped through, which is at most 12 steps per Reminder per year of missed time.
+    // NOTE: A period that does not move the date forward (like 0d) yields only one occurrence.
+    if (sqlite3_prepare_v2(db, "INSERT INTO temp.DueReminders (reminder_id, occurrences, next_scheduled_at) VALUES (?, ?, ?)", -1, &insert, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, DUE_REMINDERS_SQL, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 1, today) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        int64_t scheduled_at = sqlite3_column_int64(stmt, 1);
+        Period unit = sqlite3_column_int(stmt, 2);
+        int64_t length = sqlite3_column_int64(stmt, 3);
+        unsigned anchor_day = sqlite3_column_int(stmt, 4);
+
+        int64_t occurrences = 1;
+        int64_t next = scheduled_at;
+        if (unit == PERIOD_DAY || unit == PERIOD_WEEK) {
+            int64_t days = unit == PERIOD_WEEK ? length*7 : length;
+            if (days > 0) {
+                occurrences = (today - scheduled_at)/days + 1;
+                next = scheduled_at + occurrences*days;
+            }
+        } else if (unit != PERIOD_NONE) {
+            for (;;) {
+                int64_t prev = next;
+                next = period_advance(prev, unit, length, anchor_day);
+                if (next <= prev || next > today) break;
+                occurrences += 1;
+            }
+        }
+
+        if (sqlite3_bind_int64(insert, 1, sqlite3_column_int64(stmt, 0)) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_bind_int64(insert, 2, occurrences) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        ret = unit == PERIOD_NONE ? sqlite3_bind_null(insert, 3) : sqlite3_bind_int64(insert, 3, next);
+        if (ret != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(insert);
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
 
     // Creating new notifications from fired off reminders
-    const char *sql = "INSERT INTO Notifications (title, reminder_id) SELECT title, id FROM Reminders WHERE scheduled_at <= date('now', 'localtime') AND finished_at IS NULL";
+    switch (catch_up) {
+    case CATCH_UP_EACH:
+        sql =
+            "WITH RECURSIVE Each (reminder_id, left) AS (\n"
+            "    SELECT reminder_id, occurrences FROM temp.DueReminders\n"
+            "    UNION ALL\n"
+            "    SELECT reminder_id, left - 1 FROM Each WHERE left > 1\n"
+            ")\n"
+            "INSERT INTO Notifications (id, title, reminder_id)\n"
+            "SELECT "NEXT_ID_SQL("Notifications")" + row_number() OVER () - 1, r.title, r.id FROM Each JOIN Reminders r ON r.id = Each.reminder_id";
+        break;
+    case CATCH_UP_COALESCE:
+        sql =
+            "INSERT INTO Notifications (id, title, reminder_id, occurrences)\n"
+            "SELECT "NEXT_ID_SQL("Notifications")" + row_number() OVER () - 1, r.title, r.id, d.occurrences\n"
+            "FROM temp.DueReminders d JOIN Reminders r ON r.id = d.reminder_id";
+        break;
+    default: UNREACHABLE("fire_off_reminders");
+    }
     if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
     // Finish all the non-periodic reminders
-    sql = "UPDATE Reminders SET finished_at = CURRENT_TIMESTAMP WHERE scheduled_at <= date('now', 'localtime') AND finished_at IS NULL AND period is NULL";
+    sql = "UPDATE Reminders SET finished_at = unixepoch() WHERE id IN (SELECT reminder_id FROM temp.DueReminders) AND period_unit IS NULL";
     if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
-    // Reschedule all the period reminders
-    sql = "UPDATE Reminders SET scheduled_at = date(scheduled_at, period) WHERE scheduled_at <= date('now', 'localtime') AND finished_at IS NULL AND period is NOT NULL";
+    // Reschedule all the period reminders right after their last occurrence
+    sql =
+        "UPDATE Reminders SET scheduled_at = (SELECT next_scheduled_at FROM temp.DueReminders WHERE reminder_id = Reminders.id) "
+        "WHERE id IN (SELECT reminder_id FROM temp.DueReminders) AND period_unit IS NOT NULL";
     if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
 defer:
-    sqlite3_finalize(stmt);
+    if (insert) sqlite3_finalize(insert);
+    if (stmt) sqlite3_finalize(stmt);
     return result;
 }
 
@@ -566,37 +1745,43 @@ bool show_active_reminders(sqlite3 *db)
 {
     bool result = true;
 
+    Arena arena = {0};
     Reminders reminders = {0};
 
-    // TODO: show in how many days the reminder fires off
-    if (!load_active_reminders(db, &reminders)) return_defer(false);
+    if (!load_active_reminders(db, &arena, &reminders)) return_defer(false);
+    int64_t today = today_local_days();
     for (size_t i = 0; i < reminders.count; ++i) {
-        Reminder *it = &reminders.items[i];
-        if (it->period) {
-            fprintf(stderr, "%zu: %s (Scheduled at %s every %s)\n", i, it->title, it->scheduled_at, it->period);
+        size_t checkpoint = temp_save();
+        const char *when = render_days_until_temp(reminders.scheduled_at[i] - today);
+        const char *lead = reminders.lead_days[i] > 0 ? temp_sprintf(", shown %"PRIi64" days ahead", reminders.lead_days[i]) : "";
+        if (reminders.period_unit[i] != PERIOD_NONE) {
+            const char *period = render_period_temp(reminders.period_unit[i], reminders.period_length[i]);
+            fprintf(stderr, "%zu: %s (Scheduled at %s every %s, %s%s)\n", i, reminders.title[i], render_date_temp(reminders.scheduled_at[i]), period, when, lead);
         } else {
-            fprintf(stderr, "%zu: %s (Scheduled at %s)\n", i, it->title, it->scheduled_at);
+            fprintf(stderr, "%zu: %s (Scheduled at %s, %s%s)\n", i, reminders.title[i], render_date_temp(reminders.scheduled_at[i]), when, lead);
         }
+        temp_rewind(checkpoint);
     }
 
 defer:
-    free(reminders.items);
+    reminders_free(&reminders);
+    arena_free(&arena);
     return result;
 }
 
-bool remove_reminder_by_id(sqlite3 *db, int id)
+bool remove_reminder_by_id(sqlite3 *db, int64_t id)
 {
     bool result = true;
 
     sqlite3_stmt *stmt = NULL;
 
-    int ret = sqlite3_prepare_v2(db, "UPDATE Reminders SET finished_at = CURRENT_TIMESTAMP WHERE id = ?", -1, &stmt, NULL);
+    int ret = sqlite3_prepare_v2(db, "UPDATE Reminders SET finished_at = unixepoch() WHERE id = ?", -1, &stmt, NULL);
     if (ret != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
 
-    if (sqlite3_bind_int(stmt, 1, id) != SQLITE_OK) {
+    if (sqlite3_bind_int64(stmt, 1, id) != SQLITE_OK) {
         LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
@@ -615,16 +1800,18 @@ bool remove_reminder_by_number(sqlite3 *db, int number)
 {
     bool result = true;
 
+    Arena arena = {0};
     Reminders reminders = {0};
-    if (!load_active_reminders(db, &reminders)) return_defer(false);
+    if (!load_active_reminders(db, &arena, &reminders)) return_defer(false);
     if (!(0 <= number && (size_t)number < reminders.count)) {
         fprintf(stderr, "ERROR: %d is not a valid index of a reminder\n", number);
         return_defer(false);
     }
-    if (!remove_reminder_by_id(db, reminders.items[number].id)) return_defer(false);
+    if (!remove_reminder_by_id(db, reminders.id[number])) return_defer(false);
 
 defer:
-    free(reminders.items);
+    reminders_free(&reminders);
+    arena_free(&arena);
     return result;
 }
 
@@ -642,6 +1829,21 @@ bool verify_date_format(const char *date)
     return !(*format || *date);
 }
 
+// Parses YYYY-MM-DD into days since 1970-01-01. Rejects the dates that do not exist like 2023-02-29.
+bool parse_date(const char *date, int64_t *days)
+{
+    if (!verify_date_format(date)) return false;
+    int64_t year = strtol(date, NULL, 10);
+    unsigned month = strtoul(date + 5, NULL, 10);
+    unsigned day = strtoul(date + 8, NULL, 10);
+    if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+    *days = days_from_civil(year, month, day);
+    int64_t actual_year;
+    unsigned actual_month, actual_day;
+    civil_from_days(*days, &actual_year, &actual_month, &actual_day);
+    return actual_year == year && actual_month == month && actual_day == day;
+}
+
 // Taken from https://stackoverflow.com/a/7382028
 void sb_append_html_escaped_buf(String_Builder *sb, const char *buf, size_t size)
 {
@@ -657,515 +1859,3714 @@ void sb_append_html_escaped_buf(String_Builder *sb, const char *buf, size_t size
     }
 }
 
-void render_index_page(String_Builder *sb, Grouped_Notifications notifs, Reminders reminders)
+// Unlike temp_sprintf() does not depend on the temporary buffer, so a page with any amount of numbers can be rendered
+void sb_append_int(String_Builder *sb, int x)
+{
+    char buffer[16];
+    int n = snprintf(buffer, sizeof(buffer), "%d", x);
+    sb_append_buf(sb, buffer, n);
+}
+
+// base is the prefix of the links on the page. See serve_request()
+void render_index_page(String_Builder *sb, String_View base, Grouped_Notifications notifs, Reminders reminders)
 {
 #define OUT(buf, size) sb_append_buf(sb, buf, size)
 #define ESCAPED_OUT(buf, size) sb_append_html_escaped_buf(sb, buf, size)
-#define INT(x) sb_append_cstr(sb, temp_sprintf("%d", (x)))
+#define INT(x) sb_append_int(sb, (x))
 #include "index_page.h"
 #undef INT
 #undef OUT
 #undef ESCAPED_OUT
 }
 
-void render_error_page(String_Builder *sb, int error_code, const char *error_name)
-{
-#define OUT(buf, size) sb_append_buf(sb, buf, size)
-#define ERROR_CODE sb_append_cstr(sb, temp_sprintf("%d", error_code));
-#define ERROR_NAME sb_append_cstr(sb, error_name);
-#include "error_page.h"
-#undef ERROR_CODE
-#undef ERROR_NAME
-}
-
-sqlite3 *open_tore_db(void)
+const char *home_file_path_temp(const char *file_name)
 {
-    sqlite3 *result = NULL;
-
     const char *home_path = getenv("HOME");
     if (home_path == NULL) {
-        fprintf(stderr, "ERROR: No $HOME environment variable is setup. We need it to find the location of ~/"TORE_FILENAME" database.\n");
-        return_defer(NULL);
+        fprintf(stderr, "ERROR: No $HOME environment variable is setup. We need it to find the location of ~/%s.\n", file_name);
+        return NULL;
     }
+    return temp_sprintf("%s/%s", home_path, file_name);
+}
 
-    const char *tore_path = temp_sprintf("%s/"TORE_FILENAME, home_path);
+// Tuning of the SQLite connection. One profile is used for the short-lived commands that are
+// run from the shell and where the startup latency is all that matters, another one for the
+// long-running `serve`. A field set to -1 (0 for cache_size, which can be negative) leaves the
+// SQLite default alone.
+typedef struct {
+    int64_t cache_size;   // PRAGMA cache_size: pages if positive, KiB if negative
+    int64_t mmap_size;    // PRAGMA mmap_size in bytes
+    int synchronous;      // PRAGMA synchronous: 0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA
+    int temp_store;       // PRAGMA temp_store: 0 DEFAULT, 1 FILE, 2 MEMORY
+    int busy_timeout;     // sqlite3_busy_timeout() in milliseconds
+} Db_Profile;
 
-    int ret = sqlite3_open(tore_path, &result);
-    if (ret != SQLITE_OK) {
-        fprintf(stderr, "ERROR: %s: %s\n", tore_path, sqlite3_errstr(ret));
-        return_defer(NULL);
-    }
+typedef enum {
+    PROFILE_CLI,
+    PROFILE_SERVE,
+    COUNT_PROFILES,
+} Profile_Kind;
+
+static const char *profile_names[COUNT_PROFILES] = {
+    [PROFILE_CLI]   = "cli",
+    [PROFILE_SERVE] = "serve",
+};
 
-    if (!create_schema(result, tore_path)) {
-        sqlite3_close(result);
-        return_defer(NULL);
-    }
+// Everything that can be configured in ~/.torerc. The file is read once in main() before any
+// command runs. The strings are malloc-ed, because the temporary buffer is reset by `serve`.
+typedef struct {
+    const char *database_path; // NULL means ~/.tore
+    Catch_Up_Mode catch_up;    // how checkout fires off the missed occurrences of periodic Reminders
+    Db_Profile profiles[COUNT_PROFILES];
+    Profile_Kind profile;      // the profile of the current command, picked by main()
+    uint16_t serve_port;
+    int serve_backlog;
+    const char *serve_tenants;     // NULL means `serve` serves only the database above. See serve_run()
+    int serve_max_open_tenants;
+    int serve_tenant_idle_timeout; // in seconds
+    int backup_pages_per_step;
+    int backup_pause;              // in milliseconds
+    int upcoming_days;             // checkout shows the Reminders firing off within that many days
+} Config;
+
+static Config config = {
+    .profiles = {
+        // The temporary tables of fire_off_reminders() are small and should not touch the disk.
+        // The busy timeout lets the CLI wait for `serve` or a concurrent checkout instead of failing.
+        [PROFILE_CLI] = {
+            .cache_size   = 0,
+            .mmap_size    = -1,
+            .synchronous  = -1,
+            .temp_store   = 2,
+            .busy_timeout = 5000,
+        },
+        // The server keeps the connection open, so a bigger page cache and mapping the file pay off.
+        [PROFILE_SERVE] = {
+            .cache_size   = -16*1024,
+            .mmap_size    = 64*1024*1024,
+            .synchronous  = -1,
+            .temp_store   = 2,
+            .busy_timeout = 5000,
+        },
+    },
+    .catch_up = CATCH_UP_EACH,
+    .profile = PROFILE_CLI,
+    .serve_port = DEFAULT_SERVE_PORT,
+    .serve_backlog = 69,
+    .serve_max_open_tenants = 32,
+    .serve_tenant_idle_timeout = 5*60,
+    .backup_pages_per_step = DEFAULT_BACKUP_PAGES_PER_STEP,
+    .backup_pause = DEFAULT_BACKUP_PAUSE,
+};
 
-defer:
-    return result;
+const char *tore_db_path_temp(void)
+{
+    if (config.database_path) return config.database_path;
+    return home_file_path_temp(TORE_FILENAME);
 }
 
-typedef struct Command {
-    const char *name;
-    const char *description;
-    const char *signature;
-    const char *category;
-    bool (*run)(struct Command *self, const char *program_name, int argc, char **argv);
-} Command;
+// The archive and the cache of checkout live next to the database
+const char *tore_db_sibling_path_temp(const char *suffix)
+{
+    const char *tore_path = tore_db_path_temp();
+    if (tore_path == NULL) return NULL;
+    return temp_sprintf("%s%s", tore_path, suffix);
+}
 
-typedef enum {
-    DESCRIPTION_SHORT,
-    DESCRIPTION_FULL,
-} Description_Type;
+bool parse_config_int(String_View value, int64_t min, int64_t max, int64_t *out)
+{
+    const char *cstr = temp_sv_to_cstr(value);
+    char *endptr = NULL;
+    errno = 0;
+    long long x = strtoll(cstr, &endptr, 10);
+    if (*cstr == '\0' || *endptr != '\0' || errno != 0 || x < min || x > max) return false;
+    *out = x;
+    return true;
+}
 
-void command_describe(Command command, const char *program_name, int pad, Description_Type description_type)
+// Accepts either one of the names (case insensitive, like SQLite does) or their index
+bool parse_config_enum(String_View value, const char **names, size_t names_count, int *out)
 {
-    printf("%*s%s %s", pad, "", program_name, command.name);
-    if (command.signature) printf(" %s", command.signature);
-    printf("\n");
-    if (command.description) {
-        switch (description_type) {
-        case DESCRIPTION_SHORT: {
-            String_View description = sv_from_cstr(command.description);
-            String_View short_description = sv_chop_by_delim(&description, '\n');
-            printf("%*s    "SV_Fmt"\n", pad, "", SV_Arg(short_description));
-        } break;
-        case DESCRIPTION_FULL: {
-            String_View description = sv_from_cstr(command.description);
-            while (description.count > 0) {
-                String_View line = sv_chop_by_delim(&description, '\n');
-                printf("%*s    "SV_Fmt"\n", pad, "", SV_Arg(line));
-            }
-        } break;
-        default: UNREACHABLE("description_type");
+    for (size_t i = 0; i < names_count; ++i) {
+        if (value.count == strlen(names[i]) && strncasecmp(value.data, names[i], value.count) == 0) {
+            *out = i;
+            return true;
         }
     }
-    if (command.category)    printf("%*s    Category: %s\n", pad, "", command.category);
+    int64_t x = 0;
+    if (!parse_config_int(value, 0, names_count - 1, &x)) return false;
+    *out = x;
+    return true;
 }
 
-bool version_run(Command *self, const char *program_name, int argc, char **argv)
+bool parse_db_profile_field(Db_Profile *profile, String_View key, String_View value, bool *known)
 {
-    UNUSED(self);
-    UNUSED(program_name);
-    UNUSED(argc);
-    UNUSED(argv);
-    fprintf(stderr, "TORE GIT HASH:     "GIT_HASH"\n");
-    fprintf(stderr, "SQLITE3 VERSION:   "SQLITE_VERSION"\n");
+    static const char *synchronous_names[] = {"OFF", "NORMAL", "FULL", "EXTRA"};
+    static const char *temp_store_names[] = {"DEFAULT", "FILE", "MEMORY"};
+    int64_t x = 0;
+    *known = true;
+    if (sv_eq(key, sv_from_cstr("cache_size"))) {
+        if (!parse_config_int(value, INT32_MIN, INT32_MAX, &x) || x == 0) return false;
+        profile->cache_size = x;
+    } else if (sv_eq(key, sv_from_cstr("mmap_size"))) {
+        if (!parse_config_int(value, 0, INT64_MAX, &x)) return false;
+        profile->mmap_size = x;
+    } else if (sv_eq(key, sv_from_cstr("synchronous"))) {
+        return parse_config_enum(value, synchronous_names, ARRAY_LEN(synchronous_names), &profile->synchronous);
+    } else if (sv_eq(key, sv_from_cstr("temp_store"))) {
+        return parse_config_enum(value, temp_store_names, ARRAY_LEN(temp_store_names), &profile->temp_store);
+    } else if (sv_eq(key, sv_from_cstr("busy_timeout"))) {
+        if (!parse_config_int(value, 0, INT_MAX, &x)) return false;
+        profile->busy_timeout = x;
+    } else {
+        *known = false;
+    }
     return true;
 }
 
-bool checkout_run(Command *self, const char *program_name, int argc, char **argv)
+// Expands the leading ~/ of a path
+const char *config_path_strdup(String_View value)
+{
+    if (nob_sv_starts_with(value, sv_from_cstr("~/"))) {
+        const char *expanded = home_file_path_temp(temp_sv_to_cstr(sv_from_parts(value.data + 2, value.count - 2)));
+        if (expanded == NULL) return NULL;
+        return strdup(expanded);
+    }
+    return strdup(temp_sv_to_cstr(value));
+}
+
+// ~/.torerc is a tiny INI file:
+//
+//     database = ~/.tore
+//     catch_up = each
+//
+//     [cli]
+//     temp_store = MEMORY
+//
+//     [serve]
+//     port = 6969
+//     cache_size = -16384
+//
+// The keys outside of any section are global: database, catch_up (each or coalesce), upcoming_days,
+// backup_pages_per_step and backup_pause. Both [cli] and [serve] accept cache_size, mmap_size,
+// synchronous, temp_store and busy_timeout. [serve] additionally accepts port, backlog, tenants,
+// max_open_tenants and tenant_idle_timeout.
+// Lines starting with # or ; are comments. A missing file is not an error.
+bool load_config(void)
+{
+    bool result = true;
+    String_Builder sb = {0};
+
+    const char *config_path = home_file_path_temp(TORE_CONFIG_FILENAME);
+    if (config_path == NULL) return_defer(false);
+    int exists = file_exists(config_path);
+    if (exists < 0) return_defer(false);
+    if (exists == 0) return_defer(true);
+    if (!read_entire_file(config_path, &sb)) return_defer(false);
+
+    String_View content = sb_to_sv(sb);
+    String_View section = {0};
+    for (size_t row = 1; content.count > 0; ++row) {
+        String_View line = sv_trim(sv_chop_by_delim(&content, '\n'));
+        if (line.count == 0 || *line.data == '#' || *line.data == ';') continue;
+
+        if (*line.data == '[') {
+            if (line.data[line.count - 1] != ']') {
+                fprintf(stderr, "%s:%zu: ERROR: unclosed section name\n", config_path, row);
+                return_defer(false);
+            }
+            section = sv_trim(sv_from_parts(line.data + 1, line.count - 2));
+            if (!sv_eq(section, sv_from_cstr(profile_names[PROFILE_CLI])) && !sv_eq(section, sv_from_cstr(profile_names[PROFILE_SERVE]))) {
+                fprintf(stderr, "%s:%zu: ERROR: unknown section `"SV_Fmt"`. Expected [%s] or [%s]\n", config_path, row, SV_Arg(section), profile_names[PROFILE_CLI], profile_names[PROFILE_SERVE]);
+                return_defer(false);
+            }
+            continue;
+        }
+
+        String_View key = sv_trim(sv_chop_by_delim(&line, '='));
+        String_View value = sv_trim(line);
+        if (key.count == 0 || value.count == 0) {
+            fprintf(stderr, "%s:%zu: ERROR: expected `key = value`\n", config_path, row);
+            return_defer(false);
+        }
+
+        bool known = true;
+        bool valid = true;
+        if (section.count == 0) {
+            int64_t x = 0;
+            if (sv_eq(key, sv_from_cstr("database"))) {
+                config.database_path = config_path_strdup(value);
+                if (config.database_path == NULL) return_defer(false);
+            } else if (sv_eq(key, sv_from_cstr("catch_up"))) {
+                static const char *catch_up_names[] = {
+                    [CATCH_UP_EACH]     = "each",
+                    [CATCH_UP_COALESCE] = "coalesce",
+                };
+                int catch_up = 0;
+                valid = parse_config_enum(value, catch_up_names, ARRAY_LEN(catch_up_names), &catch_up);
+                if (valid) config.catch_up = catch_up;
+            } else if (sv_eq(key, sv_from_cstr("upcoming_days"))) {
+                valid = parse_config_int(value, 0, 366, &x);
+                if (valid) config.upcoming_days = x;
+            } else if (sv_eq(key, sv_from_cstr("backup_pages_per_step"))) {
+                valid = parse_config_int(value, 1, INT_MAX, &x);
+                if (valid) config.backup_pages_per_step = x;
+            } else if (sv_eq(key, sv_from_cstr("backup_pause"))) {
+                valid = parse_config_int(value, 0, INT_MAX, &x);
+                if (valid) config.backup_pause = x;
+            } else {
+                known = false;
+            }
+        } else {
+            Profile_Kind kind = sv_eq(section, sv_from_cstr(profile_names[PROFILE_SERVE])) ? PROFILE_SERVE : PROFILE_CLI;
+            valid = parse_db_profile_field(&config.profiles[kind], key, value, &known);
+            if (!known && kind == PROFILE_SERVE) {
+                int64_t x = 0;
+                known = true;
+                if (sv_eq(key, sv_from_cstr("port"))) {
+                    valid = parse_config_int(value, 1, UINT16_MAX, &x);
+                    if (valid) config.serve_port = x;
+                } else if (sv_eq(key, sv_from_cstr("backlog"))) {
+                    valid = parse_config_int(value, 1, INT_MAX, &x);
+                    if (valid) config.serve_backlog = x;
+                } else if (sv_eq(key, sv_from_cstr("tenants"))) {
+                    config.serve_tenants = config_path_strdup(value);
+                    if (config.serve_tenants == NULL) return_defer(false);
+                } else if (sv_eq(key, sv_from_cstr("max_open_tenants"))) {
+                    valid = parse_config_int(value, 1, 4096, &x);
+                    if (valid) config.serve_max_open_tenants = x;
+                } else if (sv_eq(key, sv_from_cstr("tenant_idle_timeout"))) {
+                    valid = parse_config_int(value, 1, INT_MAX, &x);
+                    if (valid) config.serve_tenant_idle_timeout = x;
+                } else {
+                    known = false;
+                }
+            }
+        }
+
+        if (!known) {
+            fprintf(stderr, "%s:%zu: ERROR: unknown key `"SV_Fmt"`\n", config_path, row, SV_Arg(key));
+            return_defer(false);
+        }
+        if (!valid) {
+            fprintf(stderr, "%s:%zu: ERROR: invalid value `"SV_Fmt"` of `"SV_Fmt"`\n", config_path, row, SV_Arg(value), SV_Arg(key));
+            return_defer(false);
+        }
+    }
+
+defer:
+    free(sb.items);
+    return result;
+}
+
+bool apply_db_profile(sqlite3 *db, const Db_Profile *profile)
+{
+    if (profile->busy_timeout >= 0 && sqlite3_busy_timeout(db, profile->busy_timeout) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return false;
+    }
+
+    String_Builder sql = {0};
+    if (profile->cache_size != 0)   sb_append_cstr(&sql, temp_sprintf("PRAGMA cache_size = %"PRIi64";\n", profile->cache_size));
+    if (profile->mmap_size >= 0)    sb_append_cstr(&sql, temp_sprintf("PRAGMA mmap_size = %"PRIi64";\n", profile->mmap_size));
+    if (profile->synchronous >= 0)  sb_append_cstr(&sql, temp_sprintf("PRAGMA synchronous = %d;\n", profile->synchronous));
+    if (profile->temp_store >= 0)   sb_append_cstr(&sql, temp_sprintf("PRAGMA temp_store = %d;\n", profile->temp_store));
+    sb_append_null(&sql);
+    bool result = true;
+    if (sqlite3_exec(db, sql.items, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        result = false;
+    }
+    free(sql.items);
+    return result;
+}
+
+// The site of this database in `tore sync` or 0 if it does not take part in a sync
+bool query_sync_site(sqlite3 *db, int64_t *site)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT site FROM SyncSite", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW) {
+        *site = sqlite3_column_int64(stmt, 0);
+    } else if (ret == SQLITE_DONE) {
+        *site = 0;
+    } else {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+// Must be closed with close_tore_db(), which also stops recording its changes for `tore sync`
+sqlite3 *open_tore_db_at(const char *tore_path)
+{
+    sqlite3 *result = NULL;
+
+    int ret = sqlite3_open(tore_path, &result);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "ERROR: %s: %s\n", tore_path, sqlite3_errstr(ret));
+        return_defer(NULL);
+    }
+
+    if (!apply_db_profile(result, &config.profiles[config.profile])) {
+        sqlite3_close(result);
+        return_defer(NULL);
+    }
+
+    // NOTE: only takes effect on a freshly created database. Existing ones are converted by
+    // `tore archive`, because that requires a full VACUUM. See convert_to_incremental_auto_vacuum().
+    // Setting it writes the header of the database even if it does not change anything, which
+    // would invalidate the cache of checkout on every run. So it is only set when it's not yet.
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(result, "PRAGMA auto_vacuum;", -1, &stmt, NULL) != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(result);
+        sqlite3_finalize(stmt);
+        sqlite3_close(result);
+        return_defer(NULL);
+    }
+    int auto_vacuum = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if (auto_vacuum != 2 && sqlite3_exec(result, "PRAGMA auto_vacuum = INCREMENTAL;", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(result);
+        sqlite3_close(result);
+        return_defer(NULL);
+    }
+
+    if (!create_schema(result, tore_path, migrations, ARRAY_LEN(migrations))) {
+        sqlite3_close(result);
+        return_defer(NULL);
+    }
+
+    int64_t site = 0;
+    if (!query_sync_site(result, &site) || (site != 0 && !sync_recorder_start(result))) {
+        sqlite3_close(result);
+        return_defer(NULL);
+    }
+
+defer:
+    return result;
+}
+
+// For `serve`, which only reads. Nothing is created, migrated or even set in the header of the database,
+// because with --tenants it's the databases of the other users. A database with a different schema is
+// refused instead of being migrated. Running any tore command of the same version on it migrates it.
+sqlite3 *open_tore_db_readonly_at(const char *tore_path)
+{
+    sqlite3 *result = NULL;
+
+    int ret = sqlite3_open_v2(tore_path, &result, SQLITE_OPEN_READONLY, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "ERROR: %s: %s\n", tore_path, sqlite3_errstr(ret));
+        sqlite3_close(result);
+        return NULL;
+    }
+
+    size_t applied = 0;
+    if (!apply_db_profile(result, &config.profiles[config.profile]) ||
+        !verify_migrations(result, tore_path, migrations, ARRAY_LEN(migrations), &applied)) {
+        sqlite3_close(result);
+        return NULL;
+    }
+    if (applied != ARRAY_LEN(migrations)) {
+        fprintf(stderr, "ERROR: %s: Database scheme is out of date. %zu of %zu migrations are applied. Refusing to migrate it read-only.\n",
+                tore_path, applied, ARRAY_LEN(migrations));
+        sqlite3_close(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+sqlite3 *open_tore_db(void)
+{
+    const char *tore_path = tore_db_path_temp();
+    if (tore_path == NULL) return NULL;
+    return open_tore_db_at(tore_path);
+}
+
+void close_tore_db(sqlite3 *db)
+{
+    sync_recorder_stop(db);
+    sqlite3_close(db);
+}
+
+// The archive of a database lives next to it. `serve` may have the databases of several users
+// open, so the path is derived from the connection rather than from the config.
+const char *archive_path_of_db_temp(sqlite3 *db)
+{
+    return temp_sprintf("%s"TORE_ARCHIVE_SUFFIX, sqlite3_db_filename(db, "main"));
+}
+
+// Creates ~/.tore-archive if needed, brings its scheme up to date and attaches it to db as `archive`.
+// NOTE: ATTACH does not work within a transaction.
+bool attach_archive_db(sqlite3 *db)
+{
+    bool result = true;
+    sqlite3 *archive = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    const char *archive_path = archive_path_of_db_temp(db);
+    // ATTACH opens the archive with the flags of db, so a read-only db only gets to read the archive.
+    // The schema is merely verified in that case. See open_tore_db_readonly_at()
+    bool readonly = sqlite3_db_readonly(db, "main") == 1;
+
+    int ret = sqlite3_open_v2(archive_path, &archive, readonly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "ERROR: %s: %s\n", archive_path, sqlite3_errstr(ret));
+        return_defer(false);
+    }
+    if (readonly) {
+        size_t applied = 0;
+        if (!verify_migrations(archive, archive_path, archive_migrations, ARRAY_LEN(archive_migrations), &applied)) return_defer(false);
+        if (applied != ARRAY_LEN(archive_migrations)) {
+            fprintf(stderr, "ERROR: %s: Database scheme is out of date. %zu of %zu migrations are applied. Refusing to migrate it read-only.\n",
+                    archive_path, applied, ARRAY_LEN(archive_migrations));
+            return_defer(false);
+        }
+    } else {
+        if (!create_schema(archive, archive_path, archive_migrations, ARRAY_LEN(archive_migrations))) return_defer(false);
+    }
+
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS archive", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_text(stmt, 1, archive_path, strlen(archive_path), NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (archive) sqlite3_close(archive);
+    return result;
+}
+
+bool detach_archive_db(sqlite3 *db)
+{
+    if (sqlite3_exec(db, "DETACH DATABASE archive;", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const char *kind;    // "notification" or "reminder"
+    int64_t id;
+    const char *snippet; // title with the matched terms between SEARCH_MATCH_BEGIN and SEARCH_MATCH_END
+    int64_t created_at;
+    bool archived;
+} Search_Result;
+
+typedef struct {
+    Search_Result *items;
+    size_t count;
+    size_t capacity;
+} Search_Results;
+
+#define SEARCH_MATCH_BEGIN "\x01"
+#define SEARCH_MATCH_END   "\x02"
+#define SEARCH_RESULTS_LIMIT 50
+// Ranking has to score every match, which is too slow for the common words on a long history.
+// So only this many of the most recent matches of each table are ranked.
+#define SEARCH_CANDIDATES_LIMIT 5000
+
+// Turns whatever the user typed into an FTS5 query so the FTS5 syntax never leaks into the UI:
+// every word is quoted and all of them must be present. The last word is matched as a prefix,
+// because it is usually the one still being typed. Prefix queries are slower, so the rest are exact.
+// Returns NULL if there are no words.
+const char *search_match_query_temp(const char *query)
+{
+    String_Builder sb = {0};
+    String_View rest = sv_from_cstr(query);
+    for (;;) {
+        rest = sv_trim_left(rest);
+        if (rest.count == 0) break;
+        size_t n = 0;
+        while (n < rest.count && !isspace(rest.data[n])) n += 1;
+        if (sb.count > 0) sb_append_cstr(&sb, " ");
+        sb_append_cstr(&sb, "\"");
+        for (size_t i = 0; i < n; ++i) {
+            if (rest.data[i] == '"') da_append(&sb, '"');
+            da_append(&sb, rest.data[i]);
+        }
+        sb_append_cstr(&sb, "\"");
+        rest = sv_from_parts(rest.data + n, rest.count - n);
+    }
+    if (sb.count > 0) sb_append_cstr(&sb, "*");
+    if (sb.count == 0) return NULL;
+    sb_append_null(&sb);
+    const char *result = temp_strdup(sb.items);
+    free(sb.items);
+    return result;
+}
+
+// One arm of the search query: the SEARCH_CANDIDATES_LIMIT most recent matches of a table.
+// FTS5 walks its index backwards by rowid for that, so it stops early instead of visiting all the matches.
+const char *search_arm_sql_temp(const char *schema, const char *table, const char *kind)
+{
+    return temp_sprintf(
+        "SELECT * FROM ("
+        "    SELECT '%s', t.id, snippet(%sSearch, 0, '"SEARCH_MATCH_BEGIN"', '"SEARCH_MATCH_END"', '...', 16), "
+        "           t.created_at, %sSearch.rank AS score, %d "
+        "    FROM %s.%sSearch JOIN %s.%s AS t ON t.id = %sSearch.rowid "
+        "    WHERE %sSearch MATCH ?1 ORDER BY %sSearch.rowid DESC LIMIT ?3"
+        ")",
+        kind, table, table, strcmp(schema, "archive") == 0,
+        schema, table, schema, table, table, table, table);
+}
+
+// Searches the titles of Notifications and Reminders, including the archive if it is attached.
+// The candidates are ordered by bm25 relevance.
+bool search_history(sqlite3 *db, Arena *arena, const char *query, bool with_archive, Search_Results *results)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    const char *match = search_match_query_temp(query);
+    if (match == NULL) return_defer(true);
+
+    const char *sql = temp_sprintf("%s UNION ALL %s",
+        search_arm_sql_temp("main", "Notifications", "notification"),
+        search_arm_sql_temp("main", "Reminders", "reminder"));
+    if (with_archive) {
+        sql = temp_sprintf("%s UNION ALL %s UNION ALL %s", sql,
+            search_arm_sql_temp("archive", "Notifications", "notification"),
+            search_arm_sql_temp("archive", "Reminders", "reminder"));
+    }
+    sql = temp_sprintf("%s ORDER BY score LIMIT ?2", sql);
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_text(stmt, 1, match, strlen(match), NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int(stmt, 2, SEARCH_RESULTS_LIMIT) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int(stmt, 3, SEARCH_CANDIDATES_LIMIT) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        int column = 0;
+        const char *kind = arena_intern(arena, (const char *)sqlite3_column_text(stmt, column++));
+        int64_t id = sqlite3_column_int64(stmt, column++);
+        const char *snippet = arena_strdup(arena, (const char *)sqlite3_column_text(stmt, column++));
+        int64_t created_at = sqlite3_column_int64(stmt, column++);
+        column++; // score
+        bool archived = sqlite3_column_int(stmt, column++);
+        da_append(results, ((Search_Result) {
+            .kind = kind,
+            .id = id,
+            .snippet = snippet,
+            .created_at = created_at,
+            .archived = archived,
+        }));
+    }
+
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool archive_db_exists(sqlite3 *db)
+{
+    return file_exists(archive_path_of_db_temp(db)) == 1;
+}
+
+void sb_append_html_highlighted(String_Builder *sb, const char *snippet)
+{
+    for (const char *p = snippet; *p; ++p) {
+        if (*p == SEARCH_MATCH_BEGIN[0]) {
+            sb_append_cstr(sb, "<mark>");
+        } else if (*p == SEARCH_MATCH_END[0]) {
+            sb_append_cstr(sb, "</mark>");
+        } else {
+            sb_append_html_escaped_buf(sb, p, 1);
+        }
+    }
+}
+
+void render_search_page(String_Builder *sb, String_View base, const char *query, Search_Results results)
+{
+#define OUT(buf, size) sb_append_buf(sb, buf, size)
+#define ESCAPED_OUT(buf, size) sb_append_html_escaped_buf(sb, buf, size)
+#define HIGHLIGHTED_OUT(snippet) sb_append_html_highlighted(sb, snippet)
+#define INT(x) sb_append_int(sb, (x))
+#include "search_page.h"
+#undef INT
+#undef HIGHLIGHTED_OUT
+#undef OUT
+#undef ESCAPED_OUT
+}
+
+// Moves the rows selected by batch_sql (which must fill up temp.ArchiveBatch) from main into
+// archive in batches of ARCHIVE_BATCH_SIZE rows, each one in its own transaction, so the
+// writers of the database are never blocked for long.
+bool archive_rows_in_batches(sqlite3 *db, const char *batch_sql, const char *move_sql, const char *delete_sql, int64_t older_than, int *how_many)
+{
+    bool result = true;
+    sqlite3_stmt *batch = NULL;
+    sqlite3_stmt *move = NULL;
+    sqlite3_stmt *delete = NULL;
+    bool txn = false;
+
+    if (sqlite3_prepare_v2(db, batch_sql, -1, &batch, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(batch, 1, older_than) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int(batch, 2, ARCHIVE_BATCH_SIZE) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, move_sql, -1, &move, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, delete_sql, -1, &delete, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    for (;;) {
+        if (!txn_begin(db)) return_defer(false);
+        txn = true;
+        if (sqlite3_exec(db, "DELETE FROM temp.ArchiveBatch;", NULL, NULL, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(batch) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(batch);
+        int count = sqlite3_changes(db);
+        if (count == 0) break;
+        if (sqlite3_step(move) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(move);
+        if (sqlite3_step(delete) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(delete);
+        if (!txn_commit(db)) return_defer(false);
+        txn = false;
+        *how_many += count;
+    }
+
+defer:
+    if (txn) {
+        if (result) {
+            result = txn_commit(db);
+        } else {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        }
+    }
+    if (batch) sqlite3_finalize(batch);
+    if (move) sqlite3_finalize(move);
+    if (delete) sqlite3_finalize(delete);
+    return result;
+}
+
+// Converting an existing database to incremental auto_vacuum requires a full VACUUM, but only once.
+// It rewrites the whole file, so it is left to the explicit `tore archive` and never done on checkout.
+// Until then the incremental_vacuum of archive_old_rows() is a no-op and the freed pages are just reused.
+bool convert_to_incremental_auto_vacuum(sqlite3 *db)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_prepare_v2(db, "PRAGMA main.auto_vacuum;", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int auto_vacuum = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (auto_vacuum != 2) {
+        printf("INFO: converting the database to incremental auto_vacuum. This is done only once.\n");
+        if (sqlite3_exec(db, "PRAGMA main.auto_vacuum = INCREMENTAL; VACUUM;", NULL, NULL, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+// NOTE: The row with the maximum id of a table is never archived. SQLite assigns new ids as max(id) + 1,
+// so keeping it in place guarantees that the ids of new rows never collide with the archived ones.
+bool archive_old_rows(sqlite3 *db, int days, int *notifications_archived, int *reminders_archived)
+{
+    bool result = true;
+    bool attached = false;
+    sqlite3_stmt *stmt = NULL;
+    int64_t older_than = (int64_t)time(NULL) - (int64_t)days*24*60*60;
+    // Every database archives on its own, so moving the rows out is not replicated by `tore sync`
+    sync_recorder_pause(db, true);
+
+    if (!attach_archive_db(db)) return_defer(false);
+    attached = true;
+
+    if (sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS ArchiveBatch (id INTEGER PRIMARY KEY);", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    if (!archive_rows_in_batches(db,
+            "INSERT INTO temp.ArchiveBatch (id) "
+            "SELECT id FROM main.Notifications WHERE dismissed_at < ?1 "
+            "AND id < (SELECT max(id) FROM main.Notifications) LIMIT ?2",
+            "INSERT INTO archive.Notifications (id, title, created_at, dismissed_at, reminder_id, occurrences) "
+            "SELECT id, title, created_at, dismissed_at, reminder_id, occurrences FROM main.Notifications WHERE id IN temp.ArchiveBatch",
+            "DELETE FROM main.Notifications WHERE id IN temp.ArchiveBatch",
+            older_than, notifications_archived)) return_defer(false);
+
+    if (!archive_rows_in_batches(db,
+            "INSERT INTO temp.ArchiveBatch (id) "
+            "SELECT id FROM main.Reminders WHERE finished_at < ?1 "
+            "AND id < (SELECT max(id) FROM main.Reminders) LIMIT ?2",
+            "INSERT INTO archive.Reminders (id, title, created_at, scheduled_at, period_unit, period_length, period_day, finished_at) "
+            "SELECT id, title, created_at, scheduled_at, period_unit, period_length, period_day, finished_at FROM main.Reminders WHERE id IN temp.ArchiveBatch",
+            "DELETE FROM main.Reminders WHERE id IN temp.ArchiveBatch",
+            older_than, reminders_archived)) return_defer(false);
+
+    if (sqlite3_prepare_v2(db, "INSERT INTO main.Archivings (notifications, reminders) VALUES (?, ?)", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int(stmt, 1, *notifications_archived) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int(stmt, 2, *reminders_archived) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    // Give the freed pages back to the file system
+    if (sqlite3_exec(db, "PRAGMA main.incremental_vacuum;", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+defer:
+    sync_recorder_pause(db, false);
+    if (stmt) sqlite3_finalize(stmt);
+    if (attached && !detach_archive_db(db)) result = false;
+    return result;
+}
+
+#define ARCHIVABLE_NOTIFICATIONS_SQL "SELECT 1 FROM Notifications WHERE dismissed_at < ?1"
+#define ARCHIVABLE_REMINDERS_SQL "SELECT 1 FROM Reminders WHERE finished_at < ?1"
+
+// The automatic archiving policy: at most once a day move everything that was dismissed or finished
+// more than DEFAULT_ARCHIVE_AFTER_DAYS ago. The archive is not even touched if there is nothing to move.
+// This runs on every checkout, so every part of the probe is an index seek: the last Archiving by rowid
+// and the partial indexes on dismissed_at and finished_at.
+bool archive_old_rows_if_due(sqlite3 *db)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    const char *sql =
+        "SELECT ifnull((SELECT archived_at FROM Archivings ORDER BY rowid DESC LIMIT 1), 0) <= unixepoch() - 24*60*60 "
+        "AND (EXISTS ("ARCHIVABLE_NOTIFICATIONS_SQL") OR EXISTS ("ARCHIVABLE_REMINDERS_SQL"))";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int64_t older_than = (int64_t)time(NULL) - (int64_t)DEFAULT_ARCHIVE_AFTER_DAYS*24*60*60;
+    if (sqlite3_bind_int64(stmt, 1, older_than) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    bool due = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    if (due) {
+        int notifications_archived = 0;
+        int reminders_archived = 0;
+        if (!archive_old_rows(db, DEFAULT_ARCHIVE_AFTER_DAYS, &notifications_archived, &reminders_archived)) return_defer(false);
+        if (notifications_archived > 0 || reminders_archived > 0) {
+            printf("INFO: Archived %d notifications and %d reminders into %s\n", notifications_archived, reminders_archived, tore_db_sibling_path_temp(TORE_ARCHIVE_SUFFIX));
+        }
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+typedef struct Command {
+    const char *name;
+    const char *description;
+    const char *signature;
+    const char *category;
+    bool (*run)(struct Command *self, const char *program_name, int argc, char **argv);
+} Command;
+
+typedef enum {
+    DESCRIPTION_SHORT,
+    DESCRIPTION_FULL,
+} Description_Type;
+
+void command_describe(Command command, const char *program_name, int pad, Description_Type description_type)
+{
+    printf("%*s%s %s", pad, "", program_name, command.name);
+    if (command.signature) printf(" %s", command.signature);
+    printf("\n");
+    if (command.description) {
+        switch (description_type) {
+        case DESCRIPTION_SHORT: {
+            String_View description = sv_from_cstr(command.description);
+            String_View short_description = sv_chop_by_delim(&description, '\n');
+            printf("%*s    "SV_Fmt"\n", pad, "", SV_Arg(short_description));
+        } break;
+        case DESCRIPTION_FULL: {
+            String_View description = sv_from_cstr(command.description);
+            while (description.count > 0) {
+                String_View line = sv_chop_by_delim(&description, '\n');
+                printf("%*s    "SV_Fmt"\n", pad, "", SV_Arg(line));
+            }
+        } break;
+        default: UNREACHABLE("description_type");
+        }
+    }
+    if (command.category)    printf("%*s    Category: %s\n", pad, "", command.category);
+}
+
+bool version_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    UNUSED(self);
+    UNUSED(program_name);
+    UNUSED(argc);
+    UNUSED(argv);
+    fprintf(stderr, "TORE GIT HASH:     "GIT_HASH"\n");
+    fprintf(stderr, "SQLITE3 VERSION:   "SQLITE_VERSION"\n");
+    return true;
+}
+
+// The output of checkout only depends on the content of ~/.tore and on the current day (which
+// Reminders are due). Both are cheap to check without opening the database, so the last output
+// is kept in ~/.tore-checkout-cache along with the state it was computed from. SQLite increments
+// the "file change counter" in the header of the database on every committed write transaction
+// in the rollback journal mode, and in the WAL mode the writes go to ~/.tore-wal instead, so any
+// mutation invalidates the cache automatically. The size and mtime of the files are checked too
+// in case the database gets replaced by something else entirely.
+#define CHECKOUT_CACHE_MAGIC "TORECO01"
+
+typedef struct {
+    char magic[8];
+    char git_hash[48];        // the output format may change between the versions of tore
+    uint32_t change_counter;  // offset 24 of the database header
+    int32_t upcoming_days;    // from ~/.torerc, changes the output without touching the database
+    uint64_t db_dev;
+    uint64_t db_ino;
+    int64_t db_size;
+    int64_t db_mtime_ns;
+    int64_t wal_size;         // -1 if there is no WAL
+    int64_t wal_mtime_ns;
+    int64_t today;            // days since 1970-01-01 in the local time
+    uint64_t output_size;     // the rendered mailbox follows the key
+} Checkout_Cache_Key;
+
+bool checkout_cache_debug(void)
+{
+    return getenv("TORE_DEBUG_CHECKOUT_CACHE") != NULL;
+}
+
+int64_t stat_mtime_ns(struct stat *st)
+{
+    return (int64_t)st->st_mtim.tv_sec*1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Computes the key of the current state of ~/.tore. Returns false if the state is not cacheable:
+// the database does not exist yet or there is a hot journal that the next opening will roll back.
+bool checkout_cache_key(Checkout_Cache_Key *key)
+{
+    bool result = true;
+    int fd = -1;
+
+    const char *tore_path = tore_db_path_temp();
+    if (tore_path == NULL) return_defer(false);
+
+    struct stat st;
+    if (stat(temp_sprintf("%s-journal", tore_path), &st) == 0 && st.st_size > 0) return_defer(false);
+
+    memset(key, 0, sizeof(*key));
+    memcpy(key->magic, CHECKOUT_CACHE_MAGIC, sizeof(key->magic));
+    strncpy(key->git_hash, GIT_HASH, sizeof(key->git_hash) - 1);
+    key->today = today_local_days();
+    key->upcoming_days = config.upcoming_days;
+
+    fd = open(tore_path, O_RDONLY);
+    if (fd < 0) return_defer(false);
+    if (fstat(fd, &st) < 0) return_defer(false);
+    unsigned char counter[4];
+    if (pread(fd, counter, sizeof(counter), 24) != sizeof(counter)) return_defer(false);
+    key->change_counter = ((uint32_t)counter[0] << 24) | ((uint32_t)counter[1] << 16) | ((uint32_t)counter[2] << 8) | (uint32_t)counter[3];
+    key->db_dev = st.st_dev;
+    key->db_ino = st.st_ino;
+    key->db_size = st.st_size;
+    key->db_mtime_ns = stat_mtime_ns(&st);
+
+    if (stat(temp_sprintf("%s-wal", tore_path), &st) == 0) {
+        key->wal_size = st.st_size;
+        key->wal_mtime_ns = stat_mtime_ns(&st);
+    } else {
+        key->wal_size = -1;
+    }
+
+defer:
+    if (fd >= 0) close(fd);
+    return result;
+}
+
+// Prints the cached output of checkout if it was computed from the state described by key.
+// Does not touch the database at all.
+bool checkout_from_cache(Checkout_Cache_Key key)
+{
+    bool result = true;
+    bool debug = checkout_cache_debug();
+    int fd = -1;
+    void *data = MAP_FAILED;
+    size_t size = 0;
+
+    const char *cache_path = tore_db_sibling_path_temp(TORE_CHECKOUT_CACHE_SUFFIX);
+    if (cache_path == NULL) return_defer(false);
+    fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: miss (no cache file)\n");
+        return_defer(false);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(key)) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: miss (invalid cache file)\n");
+        return_defer(false);
+    }
+    size = st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return_defer(false);
+
+    Checkout_Cache_Key cached;
+    memcpy(&cached, data, sizeof(cached));
+    uint64_t output_size = cached.output_size;
+    cached.output_size = 0;
+    if (memcmp(&cached, &key, sizeof(key)) != 0 || output_size != size - sizeof(key)) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: miss (stale)\n");
+        return_defer(false);
+    }
+
+    if (debug) fprintf(stderr, "DEBUG: checkout cache: hit (change counter %u)\n", key.change_counter);
+    fwrite((const char *)data + sizeof(key), 1, output_size, stdout);
+
+defer:
+    if (data != MAP_FAILED) munmap(data, size);
+    if (fd >= 0) close(fd);
+    return result;
+}
+
+// Must be called after the database is closed. The output is only saved if the database is still
+// in the state it was in before checkout opened it: if checkout fired off some Reminders, or some
+// other process wrote in between, the next checkout recomputes the output and caches it instead.
+void checkout_cache_save(Checkout_Cache_Key key_before, String_Builder output)
+{
+    bool debug = checkout_cache_debug();
+    Checkout_Cache_Key key;
+    if (!checkout_cache_key(&key)) return;
+    if (memcmp(&key, &key_before, sizeof(key)) != 0) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: not saved (database changed during checkout)\n");
+        return;
+    }
+    key.output_size = output.count;
+
+    const char *cache_path = tore_db_sibling_path_temp(TORE_CHECKOUT_CACHE_SUFFIX);
+    if (cache_path == NULL) return;
+    // Written next to the cache and renamed over it, so a concurrent checkout never sees a torn file
+    const char *tmp_path = temp_sprintf("%s.%d", cache_path, getpid());
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: could not write %s: %s\n", tmp_path, strerror(errno));
+        return;
+    }
+    fwrite(&key, sizeof(key), 1, f);
+    fwrite(output.items, 1, output.count, f);
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    // NOTE: not rename(), because nob redefines it into a version that logs every call
+    if (ok && renameat(AT_FDCWD, tmp_path, AT_FDCWD, cache_path) == 0) {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: saved (change counter %u)\n", key.change_counter);
+    } else {
+        if (debug) fprintf(stderr, "DEBUG: checkout cache: could not write %s\n", cache_path);
+        remove(tmp_path);
+    }
+}
+
+bool checkout_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    UNUSED(self);
+    UNUSED(program_name);
+    UNUSED(argc);
+    UNUSED(argv);
+    Checkout_Cache_Key cache_key;
+    bool cacheable = checkout_cache_key(&cache_key);
+    if (cacheable) {
+        if (checkout_from_cache(cache_key)) return true;
+    } else if (checkout_cache_debug()) {
+        fprintf(stderr, "DEBUG: checkout cache: miss (database is not in a cacheable state)\n");
+    }
+
+    bool result = true;
+    String_Builder output = {0};
+    sqlite3 *db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+    int64_t today = today_local_days();
+    if (!fire_off_reminders(db, config.catch_up, today)) return_defer(false);
+    if (!show_active_notifications_into(db, &output)) return_defer(false);
+    if (!show_upcoming_reminders_into(db, today, config.upcoming_days, &output)) return_defer(false);
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        if (result) result = archive_old_rows_if_due(db);
+        close_tore_db(db);
+    }
+    if (result && cacheable) checkout_cache_save(cache_key, output);
+    free(output.items);
+    return result;
+}
+
+// The summary in NotificationGroups recomputed from scratch
+#define ACTUAL_NOTIFICATION_GROUPS_SQL \
+    "SELECT group_id, reminder_id, latest_title, count(*), sum(occurrences), min(created_at), max(created_at) " \
+    "FROM (SELECT "NOTIFICATION_GROUP_ID_SQL" AS group_id, reminder_id, occurrences, created_at, " \
+    "      first_value(title) OVER (PARTITION BY "NOTIFICATION_GROUP_ID_SQL" ORDER BY created_at DESC, id DESC) AS latest_title " \
+    "      FROM Notifications WHERE dismissed_at IS NULL) " \
+    "GROUP BY group_id"
+
+bool check_notification_groups(sqlite3 *db, int *inconsistent_groups)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    const char *sql =
+        "WITH Actual AS ("ACTUAL_NOTIFICATION_GROUPS_SQL"), "
+        "     Summary AS (SELECT group_id, reminder_id, title, active_count, occurrences, first_created_at, last_created_at FROM NotificationGroups) "
+        "SELECT (SELECT count(*) FROM (SELECT * FROM Actual EXCEPT SELECT * FROM Summary)) + "
+        "       (SELECT count(*) FROM (SELECT * FROM Summary EXCEPT SELECT * FROM Actual))";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    *inconsistent_groups = sqlite3_column_int(stmt, 0);
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool rebuild_notification_groups(sqlite3 *db)
+{
+    const char *sql =
+        "DELETE FROM NotificationGroups;"
+        "INSERT INTO NotificationGroups (group_id, reminder_id, title, active_count, occurrences, first_created_at, last_created_at) "
+        ACTUAL_NOTIFICATION_GROUPS_SQL";";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return false;
+    }
+    return true;
+}
+
+// Verifies that the queries on the hot paths of `expand`, `dismiss` and `checkout` are still index seeks.
+// Nothing stops SQLite from choosing a full scan after a schema change, so we ask it.
+bool check_query_plan(sqlite3 *db, const char *name, const char *sql, const char *index, bool *ok)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_prepare_v2(db, temp_sprintf("EXPLAIN QUERY PLAN %s", sql), -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    bool uses_index = false;
+    bool scans = false;
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+        if (strstr(detail, index)) uses_index = true;
+        if (strncmp(detail, "SCAN ", 5) == 0 && strstr(detail, "VIRTUAL TABLE") == NULL) scans = true;
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    if (uses_index && !scans) {
+        printf("%s: OK\n", name);
+    } else {
+        printf("%s: does not use %s\n", name, index);
+        *ok = false;
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool check_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    UNUSED(self);
+    UNUSED(program_name);
+    UNUSED(argc);
+    UNUSED(argv);
+    bool result = true;
+    bool plans_ok = true;
+    sqlite3 *db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+
+    int inconsistent_groups = 0;
+    if (!check_notification_groups(db, &inconsistent_groups)) return_defer(false);
+    if (inconsistent_groups > 0) {
+        printf("NotificationGroups: %d inconsistent rows. Rebuilding...\n", inconsistent_groups);
+        if (!rebuild_notification_groups(db)) return_defer(false);
+    } else {
+        printf("NotificationGroups: OK\n");
+    }
+
+    if (!check_query_plan(db, "expand", ACTIVE_NOTIFICATIONS_OF_GROUP_SQL, "Notifications_active_group_id", &plans_ok)) return_defer(false);
+    if (!check_query_plan(db, "dismiss", DISMISS_GROUPS_SQL, "Notifications_active_group_id", &plans_ok)) return_defer(false);
+    if (!check_query_plan(db, "archive notifications", ARCHIVABLE_NOTIFICATIONS_SQL, "Notifications_dismissed_at", &plans_ok)) return_defer(false);
+    if (!check_query_plan(db, "archive reminders", ARCHIVABLE_REMINDERS_SQL, "Reminders_finished_at", &plans_ok)) return_defer(false);
+    if (!check_query_plan(db, "fire off", DUE_REMINDERS_SQL, "Reminders_active_scheduled_at", &plans_ok)) return_defer(false);
+    if (!check_query_plan(db, "upcoming", UPCOMING_REMINDERS_SQL, "Reminders_active_warn_at", &plans_ok)) return_defer(false);
+
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    return result && plans_ok;
+}
+
+bool archive_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+
+    int days = DEFAULT_ARCHIVE_AFTER_DAYS;
+    if (argc > 0) {
+        const char *unparsed_days = shift(argv, argc);
+        char *endptr = NULL;
+        days = strtol(unparsed_days, &endptr, 10);
+        if (endptr == unparsed_days || *endptr != '\0' || days < 0) {
+            fprintf(stderr, "Usage:\n");
+            command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+            fprintf(stderr, "ERROR: `%s` is not a valid amount of days\n", unparsed_days);
+            return_defer(false);
+        }
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!convert_to_incremental_auto_vacuum(db)) return_defer(false);
+
+    int notifications_archived = 0;
+    int reminders_archived = 0;
+    if (!archive_old_rows(db, days, &notifications_archived, &reminders_archived)) return_defer(false);
+    printf("Archived %d notifications and %d reminders into %s\n", notifications_archived, reminders_archived, tore_db_sibling_path_temp(TORE_ARCHIVE_SUFFIX));
+
+defer:
+    if (db) close_tore_db(db);
+    return result;
+}
+
+// Copies the database page by page with the online backup API, so `serve` and the other commands
+// keep working while it runs. Every step holds the read lock only for `pages_per_step` pages and
+// then sleeps for `pause_ms` to leave the disk to everybody else. If another connection writes
+// into the database in the middle, SQLite restarts the copy on the next step, so the snapshot is
+// always consistent.
+bool backup_db_into(sqlite3 *db, const char *backup_path, int pages_per_step, int pause_ms)
+{
+    bool result = true;
+    sqlite3 *backup = NULL;
+    sqlite3_backup *copy = NULL;
+
+    if (sqlite3_open(backup_path, &backup) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(backup);
+        return_defer(false);
+    }
+    copy = sqlite3_backup_init(backup, "main", db, "main");
+    if (copy == NULL) {
+        LOG_SQLITE3_ERROR(backup);
+        return_defer(false);
+    }
+
+    bool progress = isatty(STDERR_FILENO);
+    for (;;) {
+        int ret = sqlite3_backup_step(copy, pages_per_step);
+        if (ret == SQLITE_DONE) break;
+        if (ret != SQLITE_OK && ret != SQLITE_BUSY && ret != SQLITE_LOCKED) {
+            fprintf(stderr, "%sERROR: could not back up into %s: %s\n", progress ? "\n" : "", backup_path, sqlite3_errstr(ret));
+            return_defer(false);
+        }
+        if (progress) {
+            int total = sqlite3_backup_pagecount(copy);
+            fprintf(stderr, "\rBacked up %d/%d pages", total - sqlite3_backup_remaining(copy), total);
+        }
+        if (pause_ms > 0) sqlite3_sleep(pause_ms);
+    }
+    if (progress) fprintf(stderr, "\rBacked up %d/%d pages\n", sqlite3_backup_pagecount(copy), sqlite3_backup_pagecount(copy));
+
+defer:
+    if (copy && sqlite3_backup_finish(copy) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(backup);
+        result = false;
+    }
+    if (backup) sqlite3_close(backup);
+    return result;
+}
+
+// Whether the program is found in one of the folders of $PATH, the way execvp() looks it up
+bool program_in_path(const char *program)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL) path = "/usr/bin:/bin";
+    String_View dirs = sv_from_cstr(path);
+    while (dirs.count > 0) {
+        String_View dir = sv_chop_by_delim(&dirs, ':');
+        if (dir.count == 0) dir = sv_from_cstr(".");
+        if (access(temp_sprintf(SV_Fmt"/%s", SV_Arg(dir), program), X_OK) == 0) return true;
+    }
+    return false;
+}
+
+// gzip stores the CRC-32 of the content in the trailer of the file. The compressed snapshot is
+// tested right away, and can be tested again any time later with `gzip -t`.
+bool compress_backup(const char *backup_path, const char *compressed_path)
+{
+    Cmd cmd = {0};
+    Fd fdout = fd_open_for_write(compressed_path);
+    if (fdout == INVALID_FD) return false;
+
+    // nob logs every command it runs, which is noise for the user of tore
+    Log_Level log_level = minimal_log_level;
+    minimal_log_level = WARNING;
+    cmd_append(&cmd, "gzip", "-c", "-n", backup_path);
+    bool result = cmd_run_sync_redirect_and_reset(&cmd, (Cmd_Redirect) {
+        .fdout = &fdout,
+    });
+    if (result) {
+        cmd_append(&cmd, "gzip", "-t", compressed_path);
+        result = cmd_run_sync_and_reset(&cmd);
+    }
+    minimal_log_level = log_level;
+    free(cmd.items);
+    return result;
+}
+
+// The snapshot appears under its name only once it's complete
+bool backup_snapshot(sqlite3 *db, const char *dest, bool compress, int pages_per_step, int pause_ms)
+{
+    bool result = true;
+    const char *tmp_path = temp_sprintf("%s.tmp", dest);
+    const char *compressed_tmp_path = NULL;
+
+    if (remove(tmp_path) < 0 && errno != ENOENT) {
+        fprintf(stderr, "ERROR: could not remove %s: %s\n", tmp_path, strerror(errno));
+        return false;
+    }
+    if (!backup_db_into(db, tmp_path, pages_per_step, pause_ms)) return_defer(false);
+
+    const char *snapshot_path = tmp_path;
+    if (compress) {
+        compressed_tmp_path = temp_sprintf("%s.tmp.gz", dest);
+        if (!compress_backup(tmp_path, compressed_tmp_path)) return_defer(false);
+        snapshot_path = compressed_tmp_path;
+    }
+    // NOTE: not rename(), because nob redefines it into a version that logs every call
+    if (renameat(AT_FDCWD, snapshot_path, AT_FDCWD, dest) < 0) {
+        fprintf(stderr, "ERROR: could not rename %s to %s: %s\n", snapshot_path, dest, strerror(errno));
+        return_defer(false);
+    }
+
+defer:
+    remove(tmp_path);
+    if (compressed_tmp_path) remove(compressed_tmp_path);
+    return result;
+}
+
+bool backup_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    sqlite3 *archive = NULL;
+
+    const char *dest = NULL;
+    bool compress = false;
+    int pages_per_step = config.backup_pages_per_step;
+    int pause_ms = config.backup_pause;
+    while (argc > 0) {
+        const char *arg = shift(argv, argc);
+        if (strcmp(arg, "--compress") == 0) {
+            compress = true;
+        } else if (strcmp(arg, "--step") == 0 || strcmp(arg, "--pause") == 0) {
+            int64_t x = 0;
+            if (argc <= 0 || !parse_config_int(sv_from_cstr(argv[0]), strcmp(arg, "--step") == 0 ? 1 : 0, INT_MAX, &x)) {
+                fprintf(stderr, "Usage:\n");
+                command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+                fprintf(stderr, "ERROR: %s expects a number\n", arg);
+                return_defer(false);
+            }
+            shift(argv, argc);
+            if (strcmp(arg, "--step") == 0) {
+                pages_per_step = x;
+            } else {
+                pause_ms = x;
+            }
+        } else if (dest == NULL) {
+            dest = arg;
+        } else {
+            fprintf(stderr, "Usage:\n");
+            command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+            fprintf(stderr, "ERROR: unexpected argument `%s`\n", arg);
+            return_defer(false);
+        }
+    }
+    if (dest == NULL) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected the path of the backup\n");
+        return_defer(false);
+    }
+    // Before copying anything, rather than after a long copy that then can't be compressed
+    if (compress && !program_in_path("gzip")) {
+        fprintf(stderr, "ERROR: --compress needs gzip, but it is not found in $PATH. Install gzip or back up without --compress.\n");
+        return_defer(false);
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+
+    if (!backup_snapshot(db, dest, compress, pages_per_step, pause_ms)) return_defer(false);
+    printf("Backed up %s into %s\n", sqlite3_db_filename(db, "main"), dest);
+
+    // The archived history is a database of its own, so it gets a snapshot of its own next to the main one.
+    // See attach_archive_db()
+    if (archive_db_exists(db)) {
+        const char *archive_path = archive_path_of_db_temp(db);
+        const char *archive_dest = temp_sprintf("%s"TORE_ARCHIVE_SUFFIX, dest);
+        int ret = sqlite3_open_v2(archive_path, &archive, SQLITE_OPEN_READONLY, NULL);
+        if (ret != SQLITE_OK) {
+            fprintf(stderr, "ERROR: %s: %s\n", archive_path, sqlite3_errstr(ret));
+            return_defer(false);
+        }
+        if (!backup_snapshot(archive, archive_dest, compress, pages_per_step, pause_ms)) return_defer(false);
+        printf("Backed up %s into %s\n", archive_path, archive_dest);
+    }
+
+defer:
+    if (archive) sqlite3_close(archive);
+    if (db) close_tore_db(db);
+    return result;
+}
+
+static const char *weekday_names[7] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+// 1970-01-01 was a Thursday
+const char *weekday_name(int64_t days)
+{
+    return weekday_names[((days%7 + 7)%7 + 3)%7];
+}
+
+// The range of days [*from, *to) of `calendar` and /calendar:
+//   (nothing)               - the next DEFAULT_CALENDAR_DAYS days starting today
+//   YYYY                    - the year
+//   YYYY-MM                 - the month
+//   YYYY-MM-DD [YYYY-MM-DD] - from the day until the other one inclusive or for DEFAULT_CALENDAR_DAYS days
+//   <period>                - the notation of `remind` like 3m, from today
+// The range is at most MAX_CALENDAR_DAYS long.
+bool parse_calendar_range(const char *first, const char *second, int64_t today, int64_t *from, int64_t *to)
+{
+    if (first == NULL || *first == '\0') {
+        *from = today;
+        *to = today + DEFAULT_CALENDAR_DAYS;
+        return true;
+    }
+
+    size_t n = strlen(first);
+    if (n == 4 && verify_date_format(temp_sprintf("%s-01-01", first))) {
+        if (!parse_date(temp_sprintf("%s-01-01", first), from)) return false;
+        *to = period_advance(*from, PERIOD_YEAR, 1, 0);
+    } else if (n == 7 && verify_date_format(temp_sprintf("%s-01", first))) {
+        if (!parse_date(temp_sprintf("%s-01", first), from)) return false;
+        *to = period_advance(*from, PERIOD_MONTH, 1, 0);
+    } else if (parse_date(first, from)) {
+        *to = *from + DEFAULT_CALENDAR_DAYS;
+    } else {
+        char *endptr = NULL;
+        unsigned long length = strtoul(first, &endptr, 10);
+        Period unit = endptr == first ? PERIOD_NONE : period_by_tore_modifier(endptr);
+        if (unit == PERIOD_NONE || length == 0 || length > 1000) return false;
+        *from = today;
+        *to = period_advance(today, unit, length, 0);
+        return (second == NULL || *second == '\0') && *to - *from <= MAX_CALENDAR_DAYS;
+    }
+
+    if (second != NULL && *second != '\0') {
+        if (n != 10 || !parse_date(second, to) || *to < *from) return false;
+        *to += 1;
+    }
+    return *to - *from <= MAX_CALENDAR_DAYS;
+}
+
+void render_calendar(String_Builder *sb, Reminders reminders, Occurrences os, int64_t today)
+{
+    for (size_t i = 0; i < os.count; ++i) {
+        if (i == 0 || os.day[i] != os.day[i - 1]) {
+            sb_append_cstr(sb, temp_sprintf("%s %s%s\n", weekday_name(os.day[i]), render_date_temp(os.day[i]), os.day[i] == today ? " (today)" : ""));
+        }
+        sb_append_cstr(sb, "    ");
+        sb_append_cstr(sb, reminders.title[os.reminder[i]]);
+        sb_append_cstr(sb, "\n");
+    }
+}
+
+// base is the prefix of the links on the page. See serve_request()
+void render_calendar_page(String_Builder *sb, String_View base, const char *range, int64_t from, int64_t to, int64_t today, Reminders reminders, Occurrences os)
+{
+#define OUT(buf, size) sb_append_buf(sb, buf, size)
+#define ESCAPED_OUT(buf, size) sb_append_html_escaped_buf(sb, buf, size)
+#define INT(x) sb_append_int(sb, (x))
+#include "calendar_page.h"
+#undef INT
+#undef OUT
+#undef ESCAPED_OUT
+}
+
+bool calendar_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    Arena arena = {0};
+    Reminders reminders = {0};
+    Occurrences os = {0};
+    Occurrences scratch = {0};
+    String_Builder sb = {0};
+
+    int64_t today = today_local_days();
+    int64_t from, to;
+    const char *first = argc > 0 ? argv[0] : NULL;
+    const char *second = argc > 1 ? argv[1] : NULL;
+    if (argc > 2 || !parse_calendar_range(first, second, today, &from, &to)) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: invalid range\n");
+        return_defer(false);
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+    if (!load_active_reminders(db, &arena, &reminders)) return_defer(false);
+    expand_occurrences(reminders, from, to, &os, &scratch);
+    printf("%s .. %s\n", render_date_temp(from), render_date_temp(to - 1));
+    if (os.count == 0) {
+        printf("Nothing scheduled\n");
+    } else {
+        render_calendar(&sb, reminders, os, today);
+        fwrite(sb.items, 1, sb.count, stdout);
+    }
+
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    reminders_free(&reminders);
+    arena_free(&arena);
+    occurrences_free(&os);
+    occurrences_free(&scratch);
+    free(sb.items);
+    return result;
+}
+
+bool dismiss_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected indices\n");
+        return_defer(false);
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+
+    int how_many_dismissed = 0;
+    if (argc == 1 && strcmp(argv[0], "--all") == 0) {
+        if (!dismiss_all_notifications(db, &how_many_dismissed)) return_defer(false);
+    } else {
+        if (!dismiss_grouped_notifications_by_indices_from_args(db, &how_many_dismissed, argc, argv)) return_defer(false);
+    }
+    if (!show_active_notifications(db)) return_defer(false);
+    printf("Dismissed %d notifications\n", how_many_dismissed);
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    return result;
+}
+
+// Per-request scratch buffers of `serve`, reused across all the requests and tenants
+typedef struct {
+    Arena arena; // everything loaded from the database for the current request
+    Grouped_Notifications notifs;
+    Reminders reminders;
+    Occurrences occurrences;
+    Occurrences occurrences_scratch;
+    Search_Results results;
+    String_Builder request;
+    String_Builder param; // the decoded query parameter of the route, see query_param()
+    String_Builder response;
+    String_Builder body;
+} Serve_Context;
+
+void sc_reset(Serve_Context *sc)
+{
+    sc->notifs.count = 0;
+    sc->reminders.count = 0;
+    sc->occurrences.count = 0;
+    sc->occurrences_scratch.count = 0;
+    sc->results.count = 0;
+    arena_reset(&sc->arena);
+    sc->body.count = 0;
+    sc->response.count = 0;
+    sc->request.count = 0;
+    sc->param.count = 0;
+}
+
+// Wraps sc->body into a complete HTTP response in sc->response
+String_View sc_finish_response(Serve_Context *sc, const char *content_type)
+{
+    sb_append_cstr(&sc->response, "HTTP/1.0 200\r\n");
+    sb_append_cstr(&sc->response, temp_sprintf("Content-Type: %s\r\n", content_type));
+    sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
+    sb_append_cstr(&sc->response, "Connection: close\r\n");
+    sb_append_cstr(&sc->response, "\r\n");
+    sb_append_buf(&sc->response, sc->body.items, sc->body.count);
+    return sb_to_sv(sc->response);
+}
+
+// In the multi-tenant mode `serve` serves the databases of several users out of one directory:
+// the database of the tenant `name` is <tenants>/<name>/.tore, so pointing it to /home serves
+// everyone's ~/.tore. A request picks its tenant either with the /u/<name>/ prefix of the path
+// or with the X-Tore-Tenant header (for a reverse proxy that knows who the user is).
+//
+// Opening a database means verifying its schema and attaching the archive, which is
+// way more expensive than rendering a page. So the connections are kept open in a pool of at
+// most config.serve_max_open_tenants slots. When the pool is full the least recently used tenant
+// is closed, and the tenants idle for longer than config.serve_tenant_idle_timeout are closed too,
+// so `serve` does not keep the files of the users who went home open forever.
+#define TENANT_NAME_CAPACITY 64
+#define TENANT_PATH_PREFIX "/u/"
+#define TENANT_HEADER "X-Tore-Tenant"
+#define SINGLE_TENANT_NAME "default"
+
+// Summed up over all the tenants since the startup. /metrics is reachable by everyone who can reach
+// `serve`, so it does not tell who the tenants are or what each of them is doing.
+typedef struct {
+    size_t requests;
+    size_t index_cache_hits;
+    size_t opens;
+    size_t evictions;
+} Serve_Metrics;
+
+typedef struct {
+    sqlite3 *db;          // NULL if the slot is free
+    bool archive_attached;
+    char name[TENANT_NAME_CAPACITY + 1];
+    uint64_t last_used;   // Tenant_Pool.tick of the last request, for picking the least recently used one
+    time_t last_used_at;  // for closing the idle ones
+    // The last rendered index page. Serving does not write anything, so it stays valid until some
+    // other connection commits to the database, which is exactly what PRAGMA data_version reports.
+    bool index_cached;
+    int64_t index_data_version;
+    String_Builder index_response;
+} Tenant;
+
+typedef struct {
+    const char *dir;      // NULL in the single-tenant mode
+    Tenant *slots;
+    size_t capacity;
+    uint64_t tick;
+    Serve_Metrics metrics;
+} Tenant_Pool;
+
+bool tenant_name_valid(String_View name)
+{
+    if (name.count == 0 || name.count > TENANT_NAME_CAPACITY) return false;
+    for (size_t i = 0; i < name.count; ++i) {
+        char x = name.data[i];
+        if (!(isalnum((unsigned char)x) || x == '_' || x == '-' || (x == '.' && i > 0))) return false;
+    }
+    return true;
+}
+
+void tenant_close(Tenant_Pool *pool, Tenant *tenant)
+{
+    assert(tenant->db != NULL);
+    close_tore_db(tenant->db);
+    tenant->db = NULL;
+    tenant->archive_attached = false;
+    tenant->index_cached = false;
+    tenant->index_response.count = 0;
+    pool->metrics.evictions += 1;
+}
+
+bool tenant_open(Tenant_Pool *pool, Tenant *tenant, const char *tore_path, String_View name)
+{
+    assert(tenant->db == NULL);
+    tenant->db = open_tore_db_readonly_at(tore_path);
+    if (tenant->db == NULL) return false;
+    assert(name.count <= TENANT_NAME_CAPACITY);
+    memcpy(tenant->name, name.data, name.count);
+    tenant->name[name.count] = '\0';
+    pool->metrics.opens += 1;
+    if (archive_db_exists(tenant->db)) {
+        if (!attach_archive_db(tenant->db)) {
+            close_tore_db(tenant->db);
+            tenant->db = NULL;
+            return false;
+        }
+        tenant->archive_attached = true;
+    }
+    return true;
+}
+
+// Finds the open database of the tenant or opens it, evicting the least recently used one if needed.
+// Returns NULL if there is no such tenant, or if its database could not be opened, which is reported in failed.
+Tenant *tenant_acquire(Tenant_Pool *pool, String_View name, bool *failed)
+{
+    *failed = false;
+    Tenant *tenant = NULL;
+    if (pool->dir == NULL) {
+        tenant = &pool->slots[0];
+    } else {
+        if (!tenant_name_valid(name)) return NULL;
+        Tenant *lru = NULL;
+        for (size_t i = 0; i < pool->capacity && tenant == NULL; ++i) {
+            Tenant *it = &pool->slots[i];
+            if (it->db == NULL) {
+                if (lru == NULL || lru->db != NULL) lru = it;
+            } else if (sv_eq(name, sv_from_cstr(it->name))) {
+                tenant = it;
+            } else if (lru == NULL || (lru->db != NULL && it->last_used < lru->last_used)) {
+                lru = it;
+            }
+        }
+
+        if (tenant == NULL) {
+            // Merely requesting a tenant must not create files, so only the existing databases are served
+            const char *tore_path = temp_sprintf("%s/"SV_Fmt"/"TORE_FILENAME, pool->dir, SV_Arg(name));
+            if (file_exists(tore_path) != 1) return NULL;
+            if (lru->db != NULL) tenant_close(pool, lru);
+            if (!tenant_open(pool, lru, tore_path, name)) {
+                *failed = true;
+                return NULL;
+            }
+            tenant = lru;
+        }
+    }
+
+    tenant->last_used = ++pool->tick;
+    tenant->last_used_at = time(NULL);
+    pool->metrics.requests += 1;
+    return tenant;
+}
+
+void tenant_pool_close_idle(Tenant_Pool *pool, time_t now)
+{
+    if (pool->dir == NULL) return;
+    for (size_t i = 0; i < pool->capacity; ++i) {
+        Tenant *it = &pool->slots[i];
+        if (it->db != NULL && now - it->last_used_at >= config.serve_tenant_idle_timeout) {
+            tenant_close(pool, it);
+        }
+    }
+}
+
+bool query_data_version(sqlite3 *db, int64_t *version)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    *version = sqlite3_column_int64(stmt, 0);
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+void render_metrics(String_Builder *sb, Tenant_Pool *pool)
+{
+    size_t open = 0;
+    for (size_t i = 0; i < pool->capacity; ++i) {
+        if (pool->slots[i].db != NULL) open += 1;
+    }
+    sb_append_cstr(sb, "# requests index_cache_hits opens evictions open_tenants max_open_tenants\n");
+    sb_append_cstr(sb, temp_sprintf("%zu %zu %zu %zu %zu %zu\n", pool->metrics.requests, pool->metrics.index_cache_hits,
+                                    pool->metrics.opens, pool->metrics.evictions, open, pool->capacity));
+}
+
+// The table of routes is a perfect hash generated by nob, so looking up a route is a single
+// probe plus a single comparison regardless of the amount of routes and resources.
+Route *find_route(String_View uri)
+{
+    Route *route = &routes[route_hash(uri.data, uri.count, ROUTES_SEED) & (ROUTES_CAPACITY - 1)];
+    if (route->kind == ROUTE_NONE) return NULL;
+    if (!sv_eq(uri, sv_from_parts(route->uri, route->uri_len))) return NULL;
+    return route;
+}
+
+// The ETags of the resources are the hashes of their content that nob puts into the prerendered
+// responses. If-None-Match is a list of them, possibly weak (W/"...") or just *.
+bool etag_matches(String_View if_none_match, uint64_t hash)
+{
+    const char *etag = temp_sprintf("\"%016llx\"", (unsigned long long)hash);
+    while (if_none_match.count > 0) {
+        String_View it = sv_trim(sv_chop_by_delim(&if_none_match, ','));
+        if (nob_sv_starts_with(it, sv_from_cstr("W/"))) it = sv_from_parts(it.data + 2, it.count - 2);
+        if (sv_eq(it, sv_from_cstr("*")) || sv_eq(it, sv_from_cstr(etag))) return true;
+    }
+    return false;
+}
+
+String_View canned_response(Canned_Response_Id id)
+{
+    assert(0 <= id && id < COUNT_CANNED_RESPONSES);
+    return sv_from_parts((const char*)&bundle[canned_responses[id].offset], canned_responses[id].size);
+}
+
+void write_response(int client_fd, String_View response)
+{
+    while (response.count > 0) {
+        ssize_t transfered = write(client_fd, response.data, response.count);
+        if (transfered < 0) {
+            fprintf(stderr, "ERROR: Could not write response: %s\n", strerror(errno));
+            return;
+        }
+        response.data += transfered;
+        response.count -= transfered;
+    }
+}
+
+// A request is the request line and a few headers. Anything that does not end within this many bytes
+// is answered with 413 without being parsed, so a single client can't make the server hold an
+// arbitrary amount of memory.
+#define SERVE_MAX_REQUEST_SIZE (16*1024)
+
+int hex_digit_value(char x)
+{
+    if ('0' <= x && x <= '9') return x - '0';
+    if ('a' <= x && x <= 'f') return x - 'a' + 10;
+    if ('A' <= x && x <= 'F') return x - 'A' + 10;
+    return -1;
+}
+
+// Finds the parameter `name` in the query string of a URI and decodes it from application/x-www-form-urlencoded
+// into value. value always ends up NUL-terminated, and empty if there is no such parameter. It is owned by
+// the caller (see Serve_Context), so it is reused from request to request instead of going to the temporary storage.
+void query_param(String_View query, const char *name, String_Builder *value)
+{
+    value->count = 0;
+    while (query.count > 0) {
+        String_View param = sv_chop_by_delim(&query, '&');
+        String_View key = sv_chop_by_delim(&param, '=');
+        if (!sv_eq(key, sv_from_cstr(name))) continue;
+
+        for (size_t i = 0; i < param.count; ++i) {
+            if (param.data[i] == '+') {
+                da_append(value, ' ');
+            } else if (param.data[i] == '%' && i + 2 < param.count &&
+                       hex_digit_value(param.data[i + 1]) >= 0 && hex_digit_value(param.data[i + 2]) >= 0) {
+                da_append(value, (char)(hex_digit_value(param.data[i + 1])*16 + hex_digit_value(param.data[i + 2])));
+                i += 2;
+            } else {
+                da_append(value, param.data[i]);
+            }
+        }
+        break;
+    }
+    sb_append_null(value);
+}
+
+void serve_request(Serve_Context *sc, Tenant_Pool *pool, int client_fd)
+{
+    // TODO: log queries
+
+    // <Status-Line>\r\n<Header>\r\n<Header>\r\n<Header>\r\n<Header>\r\n<Header>\r\n\r\n
+    char buffer[1024];
+    size_t cur = 0;
+    String_View suffix = sv_from_parts("\r\n\r\n", 4);
+    bool finish = false;
+    ssize_t n = 0;
+    do {
+        n = read(client_fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        sb_append_buf(&sc->request, buffer, n);
+        for (; cur < sc->request.count && !finish; cur += 1) {
+            finish = nob_sv_starts_with(sv_from_parts(sc->request.items + cur, sc->request.count - cur), suffix);
+        }
+        if (!finish && sc->request.count > SERVE_MAX_REQUEST_SIZE) {
+            write_response(client_fd, canned_response(CANNED_REQUEST_ENTITY_TOO_LARGE));
+            return;
+        }
+    } while (!finish);
+
+    if (n < 0) {
+        fprintf(stderr, "ERROR: could not read request: %s", strerror(errno));
+        return;
+    }
+
+    String_View request = sb_to_sv(sc->request);
+    String_View status_line = sv_trim(sv_chop_by_delim(&request, '\n'));
+    String_View method = sv_trim(sv_chop_by_delim(&status_line, ' '));
+    UNUSED(method);
+    String_View uri =  sv_trim(sv_chop_by_delim(&status_line, ' '));
+    String_View path = sv_chop_by_delim(&uri, '?');
+
+    String_View tenant_header = {0};
+    String_View if_none_match = {0};
+    while (request.count > 0) {
+        String_View header = sv_trim(sv_chop_by_delim(&request, '\n'));
+        String_View name = sv_trim(sv_chop_by_delim(&header, ':'));
+        if (name.count == strlen(TENANT_HEADER) && strncasecmp(name.data, TENANT_HEADER, name.count) == 0) {
+            tenant_header = sv_trim(header);
+        } else if (name.count == strlen("If-None-Match") && strncasecmp(name.data, "If-None-Match", name.count) == 0) {
+            if_none_match = sv_trim(header);
+        }
+    }
+
+    String_View tenant_name = sv_from_cstr(SINGLE_TENANT_NAME);
+    String_View base = {0}; // the prefix of the links on the rendered pages
+    if (pool->dir != NULL) {
+        tenant_name = tenant_header;
+        if (nob_sv_starts_with(path, sv_from_cstr(TENANT_PATH_PREFIX))) {
+            String_View rest = sv_from_parts(path.data + strlen(TENANT_PATH_PREFIX), path.count - strlen(TENANT_PATH_PREFIX));
+            tenant_name = sv_chop_by_delim(&rest, '/');
+            base = sv_from_parts(path.data, tenant_name.data + tenant_name.count - path.data);
+            path = sv_from_parts(base.data + base.count, path.data + path.count - (base.data + base.count));
+            if (path.count == 0) path = sv_from_cstr("/");
+        }
+    }
+
+    // Fixed responses (status line, headers and body) are prerendered by nob into the bundle
+    // so serving them is a single write of a constant buffer.
+    String_View response = canned_response(CANNED_NOT_FOUND);
+    Route *route = find_route(path);
+    Tenant *tenant = NULL;
+    if (route && (route->kind == ROUTE_INDEX || route->kind == ROUTE_SEARCH || route->kind == ROUTE_CALENDAR)) {
+        bool failed = false;
+        tenant = tenant_acquire(pool, tenant_name, &failed);
+        if (tenant == NULL) {
+            route = NULL;
+            if (failed) response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+        }
+    }
+    if (tenant && !txn_begin(tenant->db)) return;
+    if (route) {
+        switch (route->kind) {
+        case ROUTE_STATIC: {
+            if (route->hash != 0 && etag_matches(if_none_match, route->hash)) {
+                sb_append_cstr(&sc->response, "HTTP/1.0 304 Not Modified\r\n");
+                sb_append_cstr(&sc->response, temp_sprintf("ETag: \"%016llx\"\r\n", (unsigned long long)route->hash));
+                sb_append_cstr(&sc->response, "Connection: close\r\n");
+                sb_append_cstr(&sc->response, "\r\n");
+                response = sb_to_sv(sc->response);
+                break;
+            }
+            response = sv_from_parts((const char*)&bundle[route->offset], route->size);
+        } break;
+        case ROUTE_INDEX: {
+            int64_t data_version = 0;
+            if (!query_data_version(tenant->db, &data_version)) {
+                response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+                break;
+            }
+            if (tenant->index_cached && tenant->index_data_version == data_version) {
+                pool->metrics.index_cache_hits += 1;
+                response = sb_to_sv(tenant->index_response);
+                break;
+            }
+            if (!load_active_grouped_notifications(tenant->db, &sc->arena, &sc->notifs)) {
+                response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+                break;
+            }
+            if (!load_active_reminders(tenant->db, &sc->arena, &sc->reminders)) {
+                response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+                break;
+            }
+            render_index_page(&sc->body, base, sc->notifs, sc->reminders);
+            response = sc_finish_response(sc, "text/html");
+            tenant->index_response.count = 0;
+            sb_append_buf(&tenant->index_response, response.data, response.count);
+            tenant->index_data_version = data_version;
+            tenant->index_cached = true;
+        } break;
+        case ROUTE_SEARCH: {
+            query_param(uri, "q", &sc->param);
+            if (!search_history(tenant->db, &sc->arena, sc->param.items, tenant->archive_attached, &sc->results)) {
+                response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+                break;
+            }
+            render_search_page(&sc->body, base, sc->param.items, sc->results);
+            response = sc_finish_response(sc, "text/html; charset=utf-8");
+        } break;
+        case ROUTE_CALENDAR: {
+            query_param(uri, "range", &sc->param);
+            // The range is split in place for parse_calendar_range() and put back together for the page
+            char *second = strchr(sc->param.items, ' ');
+            if (second) *second++ = '\0';
+            int64_t today = today_local_days();
+            int64_t from, to;
+            bool valid = parse_calendar_range(sc->param.items, second, today, &from, &to);
+            if (second) second[-1] = ' ';
+            if (!valid) {
+                response = canned_response(CANNED_BAD_REQUEST);
+                break;
+            }
+            if (!load_active_reminders(tenant->db, &sc->arena, &sc->reminders)) {
+                response = canned_response(CANNED_INTERNAL_SERVER_ERROR);
+                break;
+            }
+            expand_occurrences(sc->reminders, from, to, &sc->occurrences, &sc->occurrences_scratch);
+            render_calendar_page(&sc->body, base, sc->param.items, from, to, today, sc->reminders, sc->occurrences);
+            response = sc_finish_response(sc, "text/html; charset=utf-8");
+        } break;
+        case ROUTE_METRICS: {
+            render_metrics(&sc->body, pool);
+            response = sc_finish_response(sc, "text/plain");
+        } break;
+        case ROUTE_NONE:
+        case COUNT_ROUTE_KINDS:
+        default: UNREACHABLE("serve_request");
+        }
+    }
+    if (tenant) txn_commit(tenant->db);
+
+    write_response(client_fd, response);
+}
+
+// Set by SIGINT/SIGTERM. The serve loop notices it on the next wake up and shuts down cleanly,
+// so the databases are closed properly (and an instrumented build gets to write its profile).
+static volatile sig_atomic_t serve_stopping = 0;
+
+void serve_stop(int signo)
+{
+    UNUSED(signo);
+    serve_stopping = 1;
+}
+
+bool serve_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    UNUSED(self);
+    UNUSED(program_name);
+    bool result = true;
+    int server_fd = -1;
+    Serve_Context sc = {0};
+    Tenant_Pool pool = {
+        .dir = config.serve_tenants,
+        .capacity = config.serve_tenants ? (size_t)config.serve_max_open_tenants : 1,
+    };
+    uint16_t port = config.serve_port;
+    while (argc > 0) {
+        const char *arg = shift(argv, argc);
+        if (strcmp(arg, "--tenants") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: no directory is provided for %s\n", arg);
+                return_defer(false);
+            }
+            pool.dir = shift(argv, argc);
+            pool.capacity = config.serve_max_open_tenants;
+        } else {
+            port = atoi(arg);
+        }
+    }
+    pool.slots = calloc(pool.capacity, sizeof(*pool.slots));
+    assert(pool.slots != NULL && "Buy more RAM lol");
+
+    // In the single-tenant mode the only database is opened upfront, so a broken one is reported right away.
+    // It's our own, so it is created and migrated first like by any other command and then served read-only.
+    if (pool.dir == NULL) {
+        sqlite3 *db = open_tore_db();
+        if (db == NULL) return_defer(false);
+        sqlite3_close(db);
+        const char *tore_path = tore_db_path_temp();
+        if (tore_path == NULL) return_defer(false);
+        if (!tenant_open(&pool, &pool.slots[0], tore_path, sv_from_cstr(SINGLE_TENANT_NAME))) return_defer(false);
+    }
+    // NOTE: We are intentionally not listening to the external addresses, because we are using a
+    // custom scuffed implementation of HTTP protocol, which is incomplete and possibly insecure.
+    // The `serve` command is meant to be used only locally by a single person. At least for now.
+    // We are doing it for the sake of simplicity, 'cause we don't have to ship an entire proper
+    // HTTP server. Though, if you really want to, you can always slap some reverse proxy like nginx
+    // on top of the `serve`.
+    const char *addr = "127.0.0.1";
+
+    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        fprintf(stderr, "ERROR: Could not create socket epicly: %s\n", strerror(errno));
+        return_defer(false);
+    }
+
+    int option = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = inet_addr(addr);
+
+    ssize_t err = bind(server_fd, (struct sockaddr*) &server_addr, sizeof(server_addr));
+    if (err != 0) {
+        fprintf(stderr, "ERROR: Could not bind socket epicly: %s\n", strerror(errno));
+        return_defer(false);
+    }
+
+    err = listen(server_fd, config.serve_backlog);
+    if (err != 0) {
+        fprintf(stderr, "ERRO: Could not listen to socket, it's too quiet: %s\n", strerror(errno));
+        return_defer(false);
+    }
+
+    printf("Listening to http://%s:%d/\n", addr, port);
+    if (pool.dir) printf("Serving the tenants from %s/<name>/"TORE_FILENAME" at http://%s:%d"TENANT_PATH_PREFIX"<name>/\n", pool.dir, addr, port);
+
+    // No SA_RESTART, so the signal interrupts the poll() below instead of waiting for the next request
+    struct sigaction sa = { .sa_handler = serve_stop };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!serve_stopping) {
+        // Waking up every now and then even without any requests to close the idle tenants
+        struct pollfd pfd = { .fd = server_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, pool.dir ? 1000 : -1);
+        tenant_pool_close_idle(&pool, time(NULL));
+        if (serve_stopping) break;
+        if (ready < 0 && errno != EINTR) {
+            fprintf(stderr, "ERROR: Could not poll the socket: %s\n", strerror(errno));
+            return_defer(false);
+        }
+        if (ready <= 0) continue;
+
+        struct sockaddr_in client_addr;
+        socklen_t client_addrlen = 0;
+        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addrlen);
+        if (client_fd < 0) {
+            fprintf(stderr, "ERROR: Could not accept connection. This is unacceptable! %s\n", strerror(errno));
+            continue;
+        }
+
+        serve_request(&sc, &pool, client_fd);
+
+        shutdown(client_fd, SHUT_WR);
+        char buffer[4096];
+        while (read(client_fd, buffer, sizeof(buffer)) > 0);
+        close(client_fd);
+        sc_reset(&sc);
+        temp_reset();
+    }
+
+    printf("Shutting down\n");
+
+defer:
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    if (server_fd >= 0) close(server_fd);
+    for (size_t i = 0; pool.slots && i < pool.capacity; ++i) {
+        if (pool.slots[i].db) tenant_close(&pool, &pool.slots[i]);
+        free(pool.slots[i].index_response.items);
+    }
+    free(pool.slots);
+    arena_free(&sc.arena);
+    grouped_notifications_free(&sc.notifs);
+    reminders_free(&sc.reminders);
+    occurrences_free(&sc.occurrences);
+    occurrences_free(&sc.occurrences_scratch);
+    free(sc.results.items);
+    sb_free(sc.request);
+    sb_free(sc.param);
+    sb_free(sc.response);
+    sb_free(sc.body);
+    return result;
+}
+
+bool notify_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    String_Builder sb = {0};
+
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected title\n");
+        return_defer(false);
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+
+    for (bool pad = false; argc > 0; pad = true) {
+        if (pad) sb_append_cstr(&sb, " ");
+        sb_append_cstr(&sb, shift(argv, argc));
+    }
+    sb_append_null(&sb);
+    const char *title = sb.items;
+
+    if (!create_notification_with_title(db, title)) return_defer(false);
+    if (!show_active_notifications(db)) return_defer(false);
+
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    free(sb.items);
+    return result;
+}
+
+bool forget_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected index\n");
+        return_defer(false);
+    }
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+    int number = atoi(shift(argv, argc));
+    if (!remove_reminder_by_number(db, number)) return_defer(false);
+    if (!show_active_reminders(db)) return_defer(false);
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    return result;
+}
+
+bool remind_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+
+    if (argc <= 0) {
+        db = open_tore_db();
+        if (!db) return_defer(false);
+        if (!txn_begin(db)) return_defer(false);
+        if (!show_active_reminders(db)) return_defer(false);
+        return_defer(true);
+    }
+
+    const char *title = shift(argv, argc);
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected scheduled_at\n");
+        return_defer(false);
+    }
+
+    // TODO: Allow the scheduled_at to be things like "today", "tomorrow", etc
+    // TODO: research if it's possible to enforce the date format on the level of sqlite3 contraints
+    const char *unparsed_scheduled_at = shift(argv, argc);
+    int64_t scheduled_at = 0;
+    if (!parse_date(unparsed_scheduled_at, &scheduled_at)) {
+        fprintf(stderr, "ERROR: %s is not a valid date of the format YYYY-MM-DD\n", unparsed_scheduled_at);
+        return_defer(false);
+    }
+
+    Period period = PERIOD_NONE;
+    unsigned long period_length = 0;
+    if (argc > 0 && strcmp(argv[0], "--lead") != 0) {
+        const char *unparsed_period = shift(argv, argc);
+        char *endptr = NULL;
+        period_length = strtoul(unparsed_period, &endptr, 10);
+        if (endptr == unparsed_period) {
+            fprintf(stderr, "ERROR: Invalid period `%s`. Expected something like\n", unparsed_period);
+            for (Period p = 0; p < COUNT_PERIODS; ++p) {
+                Period_Modifier *pm = &tore_period_modifiers[p];
+                size_t l = rand()%9 + 1;
+                fprintf(stderr, "    %lu%s - means every %lu %s\n", l, pm->modifier, l, pm->name);
+            }
+            return_defer(false);
+        }
+        unparsed_period = endptr;
+        period = period_by_tore_modifier(unparsed_period);
+        if (period == PERIOD_NONE) {
+            fprintf(stderr, "ERROR: Unknown period modifier `%s`. Expected modifiers are\n", unparsed_period);
+            for (Period p = 0; p < COUNT_PERIODS; ++p) {
+                Period_Modifier *pm = &tore_period_modifiers[p];
+                fprintf(stderr, "    %lu%s  - means every %lu %s\n", period_length, pm->modifier, period_length, pm->name);
+            }
+            return_defer(false);
+        }
+    }
+
+    int64_t lead_days = 0;
+    if (argc > 0 && strcmp(argv[0], "--lead") == 0) {
+        shift(argv, argc);
+        if (argc <= 0) {
+            fprintf(stderr, "ERROR: expected the amount of days after --lead\n");
+            return_defer(false);
+        }
+        const char *unparsed_lead = shift(argv, argc);
+        char *endptr = NULL;
+        lead_days = strtol(unparsed_lead, &endptr, 10);
+        if (endptr != unparsed_lead && strcmp(endptr, "w") == 0) {
+            lead_days *= 7;
+        } else if (endptr == unparsed_lead || !(*endptr == '\0' || strcmp(endptr, "d") == 0)) {
+            fprintf(stderr, "ERROR: Invalid lead time `%s`. Expected something like 3, 3d or 2w\n", unparsed_lead);
+            return_defer(false);
+        }
+        if (lead_days < 0 || lead_days > MAX_CALENDAR_DAYS) {
+            fprintf(stderr, "ERROR: lead time must be between 0 and %d days\n", MAX_CALENDAR_DAYS);
+            return_defer(false);
+        }
+    }
+    if (argc > 0) {
+        fprintf(stderr, "ERROR: unexpected argument `%s`\n", argv[0]);
+        return_defer(false);
+    }
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+    if (!create_new_reminder(db, title, scheduled_at, period, period_length, lead_days)) return_defer(false);
+    if (!show_active_reminders(db)) return_defer(false);
+
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    return result;
+}
+
+bool expand_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = open_tore_db();
+    if (!db) return_defer(false);
+    if (!txn_begin(db)) return_defer(false);
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: no index is provided\n");
+        return_defer(false);
+    }
+    int index = atoi(shift(argv, argc));
+    if (!show_expanded_notifications_by_index(db, index)) return_defer(false);
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    return result;
+}
+
+bool search_run(Command *self, const char *program_name, int argc, char **argv)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    Arena arena = {0};
+    Search_Results results = {0};
+    bool archive_attached = false;
+    String_Builder query = {0};
+
+    if (argc <= 0) {
+        fprintf(stderr, "Usage:\n");
+        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
+        fprintf(stderr, "ERROR: expected query\n");
+        return_defer(false);
+    }
+
+    while (argc > 0) {
+        if (query.count > 0) sb_append_cstr(&query, " ");
+        sb_append_cstr(&query, shift(argv, argc));
+    }
+    sb_append_null(&query);
+
+    db = open_tore_db();
+    if (!db) return_defer(false);
+    if (archive_db_exists(db)) {
+        if (!attach_archive_db(db)) return_defer(false);
+        archive_attached = true;
+    }
+    if (!txn_begin(db)) return_defer(false);
+
+    if (!search_history(db, &arena, query.items, archive_attached, &results)) return_defer(false);
+    for (size_t i = 0; i < results.count; ++i) {
+        Search_Result *it = &results.items[i];
+        printf("%s %"PRIi64": ", it->kind, it->id);
+        for (const char *p = it->snippet; *p; ++p) {
+            if (*p == SEARCH_MATCH_BEGIN[0] || *p == SEARCH_MATCH_END[0]) {
+                putchar('*');
+            } else {
+                putchar(*p);
+            }
+        }
+        printf(" (%s%s)\n", render_timestamp_temp(it->created_at), it->archived ? ", archived" : "");
+    }
+    if (results.count == 0) printf("Nothing found\n");
+
+defer:
+    if (db) {
+        if (result) result = txn_commit(db);
+        close_tore_db(db);
+    }
+    free(query.items);
+    free(results.items);
+    arena_free(&arena);
+    return result;
+}
+
+// The fields of the rows of `tore import` and `tore export`. They are the keys of the JSONL objects
+// and the names of the columns in the CSV header. Each row is either a "reminder" or a "notification".
+typedef enum {
+    TRANSFER_TYPE,
+    TRANSFER_ID,
+    TRANSFER_TITLE,
+    TRANSFER_CREATED_AT,
+    TRANSFER_SCHEDULED_AT,
+    TRANSFER_PERIOD,
+    TRANSFER_FINISHED_AT,
+    TRANSFER_DISMISSED_AT,
+    TRANSFER_REMINDER_ID,
+    TRANSFER_OCCURRENCES,
+    TRANSFER_LEAD_DAYS,
+    TRANSFER_PERIOD_DAY,
+    COUNT_TRANSFER_FIELDS,
+} Transfer_Field;
+
+static_assert(COUNT_TRANSFER_FIELDS == 12, "Amount of transfer fields have changed");
+const char *transfer_field_names[COUNT_TRANSFER_FIELDS] = {
+    [TRANSFER_TYPE]         = "type",
+    [TRANSFER_ID]           = "id",
+    [TRANSFER_TITLE]        = "title",
+    [TRANSFER_CREATED_AT]   = "created_at",
+    [TRANSFER_SCHEDULED_AT] = "scheduled_at",
+    [TRANSFER_PERIOD]       = "period",
+    [TRANSFER_FINISHED_AT]  = "finished_at",
+    [TRANSFER_DISMISSED_AT] = "dismissed_at",
+    [TRANSFER_REMINDER_ID]  = "reminder_id",
+    [TRANSFER_OCCURRENCES]  = "occurrences",
+    [TRANSFER_LEAD_DAYS]    = "lead_days",
+    [TRANSFER_PERIOD_DAY]   = "period_day",
+};
+
+typedef enum {
+    TRANSFER_FORMAT_JSONL,
+    TRANSFER_FORMAT_CSV,
+} Transfer_Format;
+
+bool transfer_format_by_name(const char *name, Transfer_Format *format)
+{
+    if (strcmp(name, "jsonl") == 0) {
+        *format = TRANSFER_FORMAT_JSONL;
+        return true;
+    }
+    if (strcmp(name, "csv") == 0) {
+        *format = TRANSFER_FORMAT_CSV;
+        return true;
+    }
+    fprintf(stderr, "ERROR: Unknown format `%s`. Expected `jsonl` or `csv`\n", name);
+    return false;
+}
+
+// Accepts both the tore notation of `remind` (like 2w) and the SQLite modifiers that periods used to be
+// stored and exported as (like +14 days).
+bool import_period(const char *text, Period *unit, int64_t *length)
+{
+    char *endptr = NULL;
+    if (*text == '+') {
+        *length = strtoul(text + 1, &endptr, 10);
+        if (endptr == text + 1 || *endptr != ' ') return false;
+        for (Period p = 0; p < COUNT_PERIODS; ++p) {
+            if (p != PERIOD_WEEK && strcmp(endptr + 1, tore_period_modifiers[p].name) == 0) {
+                *unit = p;
+                return true;
+            }
+        }
+        return false;
+    }
+    *length = strtoul(text, &endptr, 10);
+    if (endptr == text) return false;
+    *unit = period_by_tore_modifier(endptr);
+    return *unit != PERIOD_NONE;
+}
+
+// Timestamps may be imported either as seconds since the Unix Epoch or as anything unixepoch() understands
+#define IMPORT_TIMESTAMP_SQL(param) \
+    "CASE WHEN "param" GLOB '[0-9]*' AND NOT "param" GLOB '*[^0-9]*' THEN CAST("param" AS INTEGER) ELSE unixepoch("param") END"
+
+#define IMPORT_BATCH_SIZE 10000
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *reminder;
+    sqlite3_stmt *remember_id;
+    sqlite3_stmt *notification;
+    size_t line;
+    int reminders;
+    int notifications;
+} Importer;
+
+bool importer_bind_field(Importer *im, sqlite3_stmt *stmt, int index, const char *value)
+{
+    if (sqlite3_bind_text(stmt, index, value, value ? (int)strlen(value) : 0, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(im->db);
+        return false;
+    }
+    return true;
+}
+
+bool importer_step(Importer *im, sqlite3_stmt *stmt)
+{
+    int ret = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (ret != SQLITE_DONE) {
+        fprintf(stderr, "ERROR: line %zu: %s\n", im->line, sqlite3_errmsg(im->db));
+        return false;
+    }
+    return true;
+}
+
+// Parses an integer field within [min, max]
+bool import_integer(const char *text, int64_t min, int64_t max, int64_t *value)
+{
+    char *endptr = NULL;
+    errno = 0;
+    *value = strtoll(text, &endptr, 10);
+    return endptr != text && *endptr == '\0' && errno == 0 && *value >= min && *value <= max;
+}
+
+// Inserts a single row. The fields that are not provided are NULL.
+bool import_row(Importer *im, const char *fields[COUNT_TRANSFER_FIELDS])
+{
+    const char *type = fields[TRANSFER_TYPE];
+    if (type == NULL) {
+        fprintf(stderr, "ERROR: line %zu: no type of the row\n", im->line);
+        return false;
+    }
+
+    if (fields[TRANSFER_TITLE] == NULL) {
+        fprintf(stderr, "ERROR: line %zu: no title\n", im->line);
+        return false;
+    }
+
+    if (strcmp(type, "reminder") == 0) {
+        int64_t scheduled_at = 0;
+        if (fields[TRANSFER_SCHEDULED_AT] == NULL || !parse_date(fields[TRANSFER_SCHEDULED_AT], &scheduled_at)) {
+            fprintf(stderr, "ERROR: line %zu: scheduled_at is not a valid date of the format YYYY-MM-DD\n", im->line);
+            return false;
+        }
+        Period unit = PERIOD_NONE;
+        int64_t length = 0;
+        if (fields[TRANSFER_PERIOD] != NULL && !import_period(fields[TRANSFER_PERIOD], &unit, &length)) {
+            fprintf(stderr, "ERROR: line %zu: invalid period `%s`\n", im->line, fields[TRANSFER_PERIOD]);
+            return false;
+        }
+        // The anchor of the monthly and yearly Reminders can't be told from scheduled_at once it's clamped
+        // to the end of a shorter month, so it's carried over when the input has it
+        int64_t year;
+        unsigned month, day;
+        civil_from_days(scheduled_at, &year, &month, &day);
+        int64_t period_day = unit == PERIOD_NONE ? 0 : day;
+        if (unit != PERIOD_NONE && fields[TRANSFER_PERIOD_DAY] != NULL) {
+            int64_t last = days_in_month(year, month);
+            if (!import_integer(fields[TRANSFER_PERIOD_DAY], 1, 31, &period_day) || (period_day < last ? period_day : last) != day) {
+                fprintf(stderr, "ERROR: line %zu: period_day `%s` does not match scheduled_at\n", im->line, fields[TRANSFER_PERIOD_DAY]);
+                return false;
+            }
+        }
+        int64_t lead_days = 0;
+        if (fields[TRANSFER_LEAD_DAYS] != NULL && !import_integer(fields[TRANSFER_LEAD_DAYS], 0, MAX_CALENDAR_DAYS, &lead_days)) {
+            fprintf(stderr, "ERROR: line %zu: lead_days must be a number of days from 0 to %d\n", im->line, MAX_CALENDAR_DAYS);
+            return false;
+        }
+        if (!importer_bind_field(im, im->reminder, 1, fields[TRANSFER_TITLE])) return false;
+        if (!importer_bind_field(im, im->reminder, 2, fields[TRANSFER_CREATED_AT])) return false;
+        if (sqlite3_bind_int64(im->reminder, 3, scheduled_at) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(im->db);
+            return false;
+        }
+        int ret = unit == PERIOD_NONE ? sqlite3_bind_null(im->reminder, 4) : sqlite3_bind_int(im->reminder, 4, unit);
+        if (ret != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(im->db);
+            return false;
+        }
+        if (!importer_bind_field(im, im->reminder, 5, fields[TRANSFER_FINISHED_AT])) return false;
+        if (sqlite3_bind_int64(im->reminder, 6, length) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(im->db);
+            return false;
+        }
+        if (sqlite3_bind_int64(im->reminder, 7, period_day) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(im->db);
+            return false;
+        }
+        if (sqlite3_bind_int64(im->reminder, 8, lead_days) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(im->db);
+            return false;
+        }
+        if (!importer_step(im, im->reminder)) return false;
+
+        // The ids are not preserved, but the Notifications further down the input may refer to this Reminder by its old id
+        if (fields[TRANSFER_ID] != NULL) {
+            if (!importer_bind_field(im, im->remember_id, 1, fields[TRANSFER_ID])) return false;
+            if (!importer_step(im, im->remember_id)) return false;
+        }
+        im->reminders += 1;
+        return true;
+    }
+
+    if (strcmp(type, "notification") == 0) {
+        if (!importer_bind_field(im, im->notification, 1, fields[TRANSFER_TITLE])) return false;
+        if (!importer_bind_field(im, im->notification, 2, fields[TRANSFER_CREATED_AT])) return false;
+        if (!importer_bind_field(im, im->notification, 3, fields[TRANSFER_DISMISSED_AT])) return false;
+        if (!importer_bind_field(im, im->notification, 4, fields[TRANSFER_REMINDER_ID])) return false;
+        if (!importer_bind_field(im, im->notification, 5, fields[TRANSFER_OCCURRENCES])) return false;
+        if (!importer_step(im, im->notification)) return false;
+        im->notifications += 1;
+        return true;
+    }
+
+    fprintf(stderr, "ERROR: line %zu: unknown type `%s`. Expected `reminder` or `notification`\n", im->line, type);
+    return false;
+}
+
+typedef struct {
+    size_t offset;
+    size_t count;
+} Csv_Field;
+
+typedef struct {
+    Csv_Field *items;
+    size_t count;
+    size_t capacity;
+} Csv_Fields;
+
+// Splits a CSV record into fields according to RFC 4180. The unquoted contents of the fields are
+// collected into buffer. Returns false if a quoted field is not closed yet, which means the record
+// continues on the next line.
+bool split_csv_record(String_View record, String_Builder *buffer, Csv_Fields *fields)
+{
+    buffer->count = 0;
+    fields->count = 0;
+    size_t offset = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < record.count; ++i) {
+        char x = record.data[i];
+        if (quoted) {
+            if (x == '"') {
+                if (i + 1 < record.count && record.data[i + 1] == '"') {
+                    da_append(buffer, '"');
+                    i += 1;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                da_append(buffer, x);
+            }
+        } else if (x == '"') {
+            quoted = true;
+        } else if (x == ',') {
+            da_append(fields, ((Csv_Field) {offset, buffer->count - offset}));
+            offset = buffer->count;
+        } else if (x != '\r' && x != '\n') {
+            da_append(buffer, x);
+        }
+    }
+    if (quoted) return false;
+    da_append(fields, ((Csv_Field) {offset, buffer->count - offset}));
+    return true;
+}
+
+bool import_rows(sqlite3 *db, FILE *input, Transfer_Format format, int *reminders, int *notifications)
+{
+    bool result = true;
+    Importer im = {.db = db};
+    sqlite3_stmt *parse_json = NULL;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    String_Builder record = {0};
+    String_Builder buffer = {0};
+    Csv_Fields fields = {0};
+    int csv_columns[COUNT_TRANSFER_FIELDS]; // CSV column index of every field or -1
+    bool csv_header = true;
+    int rows_in_batch = 0;
+    int rows_committed = 0;
+
+    const char *sql =
+        "INSERT INTO Reminders (id, title, created_at, scheduled_at, period_unit, period_length, period_day, lead_days, finished_at) "
+        "VALUES ("NEXT_ID_SQL("Reminders")", ?1, coalesce("IMPORT_TIMESTAMP_SQL("?2")", unixepoch()), ?3, ?4, ?6, ?7, ?8, "IMPORT_TIMESTAMP_SQL("?5")")";
+    if (sqlite3_prepare_v2(db, sql, -1, &im.reminder, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    sql =
+        "CREATE TEMP TABLE IF NOT EXISTS ImportedReminders (old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL);"
+        "DELETE FROM temp.ImportedReminders;";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    sql = "INSERT OR REPLACE INTO temp.ImportedReminders (old_id, new_id) VALUES (?1, last_insert_rowid())";
+    if (sqlite3_prepare_v2(db, sql, -1, &im.remember_id, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    sql =
+        "INSERT INTO Notifications (id, title, created_at, dismissed_at, reminder_id, occurrences) "
+        "VALUES ("NEXT_ID_SQL("Notifications")", ?1, coalesce("IMPORT_TIMESTAMP_SQL("?2")", unixepoch()), "IMPORT_TIMESTAMP_SQL("?3")", "
+        "(SELECT new_id FROM temp.ImportedReminders WHERE old_id = ?4), coalesce(?5, 1))";
+    if (sqlite3_prepare_v2(db, sql, -1, &im.notification, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    // SQLite parses the JSON for us
+    String_Builder parse_json_sql = {0};
+    sb_append_cstr(&parse_json_sql, "SELECT ");
+    for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+        if (f > 0) sb_append_cstr(&parse_json_sql, ", ");
+        sb_append_cstr(&parse_json_sql, temp_sprintf("json_extract(?1, '$.%s')", transfer_field_names[f]));
+    }
+    int ret = sqlite3_prepare_v2(db, parse_json_sql.items, parse_json_sql.count, &parse_json, NULL);
+    free(parse_json_sql.items);
+    if (ret != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    ssize_t n = 0;
+    while ((n = getline(&line, &line_capacity, input)) >= 0) {
+        im.line += 1;
+        const char *values[COUNT_TRANSFER_FIELDS] = {0};
+
+        switch (format) {
+        case TRANSFER_FORMAT_JSONL: {
+            String_View sv = sv_trim(sv_from_parts(line, n));
+            if (sv.count == 0) continue;
+            if (sqlite3_bind_text(parse_json, 1, sv.data, sv.count, NULL) != SQLITE_OK) {
+                LOG_SQLITE3_ERROR(db);
+                return_defer(false);
+            }
+            if (sqlite3_step(parse_json) != SQLITE_ROW) {
+                fprintf(stderr, "ERROR: line %zu: %s\n", im.line, sqlite3_errmsg(db));
+                return_defer(false);
+            }
+            for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+                values[f] = (const char *)sqlite3_column_text(parse_json, f);
+            }
+            bool ok = import_row(&im, values);
+            sqlite3_reset(parse_json);
+            if (!ok) return_defer(false);
+        } break;
+
+        case TRANSFER_FORMAT_CSV: {
+            sb_append_buf(&record, line, n);
+            if (!split_csv_record(sb_to_sv(record), &buffer, &fields)) continue;
+            record.count = 0;
+
+            if (csv_header) {
+                for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+                    csv_columns[f] = -1;
+                    for (size_t i = 0; i < fields.count; ++i) {
+                        String_View name = sv_from_parts(buffer.items + fields.items[i].offset, fields.items[i].count);
+                        if (sv_eq(sv_trim(name), sv_from_cstr(transfer_field_names[f]))) csv_columns[f] = i;
+                    }
+                }
+                csv_header = false;
+                continue;
+            }
+
+            if (fields.count == 1 && fields.items[0].count == 0) continue;
+            for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+                int i = csv_columns[f];
+                if (i < 0 || (size_t)i >= fields.count || fields.items[i].count == 0) continue;
+                values[f] = temp_sv_to_cstr(sv_from_parts(buffer.items + fields.items[i].offset, fields.items[i].count));
+            }
+            if (!import_row(&im, values)) return_defer(false);
+        } break;
+
+        default: UNREACHABLE("import_rows");
+        }
+
+        // Huge inputs are committed periodically, so the journal does not grow without bounds
+        rows_in_batch += 1;
+        if (rows_in_batch >= IMPORT_BATCH_SIZE) {
+            if (!txn_commit(db)) return_defer(false);
+            if (!txn_begin(db)) return_defer(false);
+            rows_committed += rows_in_batch;
+            rows_in_batch = 0;
+        }
+        temp_reset();
+    }
+
+    if (ferror(input)) {
+        fprintf(stderr, "ERROR: could not read the input: %s\n", strerror(errno));
+        return_defer(false);
+    }
+
+    if (record.count > 0) {
+        fprintf(stderr, "ERROR: line %zu: unterminated quoted field\n", im.line);
+        return_defer(false);
+    }
+
+defer:
+    if (!result && rows_committed > 0) {
+        fprintf(stderr, "ERROR: the first %d rows are already imported\n", rows_committed);
+    }
+    if (reminders) *reminders = im.reminders;
+    if (notifications) *notifications = im.notifications;
+    if (parse_json) sqlite3_finalize(parse_json);
+    if (im.reminder) sqlite3_finalize(im.reminder);
+    if (im.remember_id) sqlite3_finalize(im.remember_id);
+    if (im.notification) sqlite3_finalize(im.notification);
+    free(line);
+    free(record.items);
+    free(buffer.items);
+    free(fields.items);
+    return result;
+}
+
+void write_json_string(FILE *output, const char *s)
+{
+    fputc('"', output);
+    for (; *s; ++s) {
+        switch (*s) {
+            case '"':  fputs("\\\"", output); break;
+            case '\\': fputs("\\\\", output); break;
+            case '\n': fputs("\\n", output);  break;
+            case '\r': fputs("\\r", output);  break;
+            case '\t': fputs("\\t", output);  break;
+            default:
+                if ((unsigned char)*s < 0x20) {
+                    fprintf(output, "\\u%04x", *s);
+                } else {
+                    fputc(*s, output);
+                }
+        }
+    }
+    fputc('"', output);
+}
+
+void write_csv_field(FILE *output, const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        fputs(s, output);
+        return;
+    }
+    fputc('"', output);
+    for (; *s; ++s) {
+        if (*s == '"') fputc('"', output);
+        fputc(*s, output);
+    }
+    fputc('"', output);
+}
+
+// Streams all the Reminders and then all the Notifications row by row, so the memory usage does not
+// depend on the size of the database. The Reminders go first, so `tore import` can link the Notifications
+// to them. The timestamps are exported in UTC.
+bool export_rows(sqlite3 *db, FILE *output, Transfer_Format format)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+
+    static_assert(COUNT_TRANSFER_FIELDS == 12, "Amount of transfer fields have changed");
+    const char *sql =
+        "SELECT 'reminder', id, title, datetime(created_at, 'unixepoch'), date(scheduled_at*86400, 'unixepoch'), "PERIOD_NOTATION_SQL", "
+        "       datetime(finished_at, 'unixepoch'), NULL, NULL, NULL, nullif(lead_days, 0), "
+        "       CASE WHEN period_unit IS NOT NULL THEN period_day END "
+        "FROM Reminders "
+        "UNION ALL "
+        "SELECT 'notification', id, title, datetime(created_at, 'unixepoch'), NULL, NULL, "
+        "       NULL, datetime(dismissed_at, 'unixepoch'), reminder_id, occurrences, NULL, NULL "
+        "FROM Notifications";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    if (format == TRANSFER_FORMAT_CSV) {
+        for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+            if (f > 0) fputc(',', output);
+            fputs(transfer_field_names[f], output);
+        }
+        fputc('\n', output);
+    }
+
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        switch (format) {
+        case TRANSFER_FORMAT_JSONL: {
+            bool first = true;
+            fputc('{', output);
+            for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+                int type = sqlite3_column_type(stmt, f);
+                if (type == SQLITE_NULL) continue;
+                if (!first) fputc(',', output);
+                first = false;
+                write_json_string(output, transfer_field_names[f]);
+                fputc(':', output);
+                if (type == SQLITE_INTEGER) {
+                    fprintf(output, "%lld", sqlite3_column_int64(stmt, f));
+                } else {
+                    write_json_string(output, (const char *)sqlite3_column_text(stmt, f));
+                }
+            }
+            fputs("}\n", output);
+        } break;
+
+        case TRANSFER_FORMAT_CSV: {
+            for (Transfer_Field f = 0; f < COUNT_TRANSFER_FIELDS; ++f) {
+                if (f > 0) fputc(',', output);
+                if (sqlite3_column_type(stmt, f) != SQLITE_NULL) {
+                    write_csv_field(output, (const char *)sqlite3_column_text(stmt, f));
+                }
+            }
+            fputc('\n', output);
+        } break;
+
+        default: UNREACHABLE("export_rows");
+        }
+    }
+
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    if (fflush(output) != 0) {
+        fprintf(stderr, "ERROR: could not write the output: %s\n", strerror(errno));
+        return_defer(false);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool import_run(Command *self, const char *program_name, int argc, char **argv)
 {
     UNUSED(self);
     UNUSED(program_name);
-    UNUSED(argc);
-    UNUSED(argv);
     bool result = true;
-    sqlite3 *db = open_tore_db();
+    sqlite3 *db = NULL;
+
+    Transfer_Format format = TRANSFER_FORMAT_JSONL;
+    if (argc > 0 && !transfer_format_by_name(shift(argv, argc), &format)) return_defer(false);
+
+    db = open_tore_db();
     if (!db) return_defer(false);
     if (!txn_begin(db)) return_defer(false);
-    if (!fire_off_reminders(db)) return_defer(false);
-    if (!show_active_notifications(db)) return_defer(false);
-    // TODO: show reminders that are about to fire off
-    //   Maybe they should fire off a "warning" notification before doing the main one?
+
+    int reminders = 0;
+    int notifications = 0;
+    if (!import_rows(db, stdin, format, &reminders, &notifications)) return_defer(false);
+    fprintf(stderr, "Imported %d reminders and %d notifications\n", reminders, notifications);
+
 defer:
     if (db) {
         if (result) result = txn_commit(db);
-        sqlite3_close(db);
+        close_tore_db(db);
     }
     return result;
 }
 
-bool dismiss_run(Command *self, const char *program_name, int argc, char **argv)
+bool export_run(Command *self, const char *program_name, int argc, char **argv)
 {
+    UNUSED(self);
+    UNUSED(program_name);
     bool result = true;
     sqlite3 *db = NULL;
-    if (argc <= 0) {
-        fprintf(stderr, "Usage:\n");
-        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
-        fprintf(stderr, "ERROR: expected indices\n");
-        return_defer(false);
-    }
+
+    Transfer_Format format = TRANSFER_FORMAT_JSONL;
+    if (argc > 0 && !transfer_format_by_name(shift(argv, argc), &format)) return_defer(false);
 
     db = open_tore_db();
     if (!db) return_defer(false);
     if (!txn_begin(db)) return_defer(false);
+    if (!export_rows(db, stdout, format)) return_defer(false);
 
-    int how_many_dismissed = 0;
-    if (!dismiss_grouped_notifications_by_indices_from_args(db, &how_many_dismissed, argc, argv)) return_defer(false);
-    if (!show_active_notifications(db)) return_defer(false);
-    printf("Dismissed %d notifications\n", how_many_dismissed);
 defer:
     if (db) {
         if (result) result = txn_commit(db);
-        sqlite3_close(db);
+        close_tore_db(db);
     }
     return result;
 }
 
-typedef struct {
-    sqlite3 *db;
-    Grouped_Notifications notifs;
-    Reminders reminders;
-    String_Builder request;
-    String_Builder response;
-    String_Builder body;
-} Serve_Context;
+bool help_run(Command *self, const char *program_name, int argc, char **argv);
 
-void sc_reset(Serve_Context *sc)
+// `tore sync` exchanges the changes between several databases of the same person (say a laptop
+// and a workstation) through a shared directory (a USB stick, Syncthing, Dropbox, etc). Every
+// database writes all the changes that some of its peers may still be missing into its own
+// <dir>/<site>.tore-sync and applies the ones it is missing from the files of the others. A file
+// is an SQLite database with the changesets recorded by Sync_Recorder and the vector of what its
+// writer has (SyncPeers). Once every known peer has a changeset it is deleted, so the cost of a
+// sync is proportional to the amount of the changes, not to the size of the database.
+//
+// The same row changed on both sides before they synced is resolved by sync_conflict():
+// - dismissing a Notification wins over not dismissing it;
+// - finishing a Reminder wins over rescheduling it, otherwise the one rescheduled further ahead wins,
+//   because it's the side that fired off more occurrences of it (both of their Notifications are kept);
+// - the changes of the rows that were archived on this side are dropped.
+#define SYNC_BUNDLE_EXTENSION ".tore-sync"
+// The layout of the tables the changesets refer to by column index, stored as the user_version of the
+// files. The files of before it was stored have 0 there. 1 is the one with the integer periods of
+// Reminders. The changesets recorded before them have the TEXT period in place of finished_at.
+// See sync_changeset_layout_matches()
+#define SYNC_FORMAT 1
+
+// The order of the columns in the tables, as the changesets refer to them by index
+typedef enum {
+    NOTIFICATION_COLUMN_ID,
+    NOTIFICATION_COLUMN_TITLE,
+    NOTIFICATION_COLUMN_CREATED_AT,
+    NOTIFICATION_COLUMN_DISMISSED_AT,
+} Notification_Column;
+
+typedef enum {
+    REMINDER_COLUMN_ID,
+    REMINDER_COLUMN_TITLE,
+    REMINDER_COLUMN_CREATED_AT,
+    REMINDER_COLUMN_SCHEDULED_AT,
+    REMINDER_COLUMN_FINISHED_AT,
+} Reminder_Column;
+
+// NULL if the changeset does not change the column
+sqlite3_value *changeset_new_value(sqlite3_changeset_iter *it, int column)
 {
-    sc->notifs.count = 0;
-    sc->reminders.count = 0;
-    sc->body.count = 0;
-    sc->response.count = 0;
-    sc->request.count = 0;
+    sqlite3_value *value = NULL;
+    if (sqlite3changeset_new(it, column, &value) != SQLITE_OK) return NULL;
+    return value;
+}
+
+sqlite3_value *changeset_local_value(sqlite3_changeset_iter *it, int column)
+{
+    sqlite3_value *value = NULL;
+    if (sqlite3changeset_conflict(it, column, &value) != SQLITE_OK) return NULL;
+    return value;
 }
 
-Resource *find_resource(const char *file_path)
+bool value_is_null(sqlite3_value *value)
 {
-    for (size_t i = 0; i < resources_count; ++i) {
-        if (strcmp(file_path, resources[i].file_path) == 0) {
-            return &resources[i];
+    return value == NULL || sqlite3_value_type(value) == SQLITE_NULL;
+}
+
+int sync_conflict(void *context, int conflict, sqlite3_changeset_iter *it)
+{
+    UNUSED(context);
+    const char *table = NULL;
+    int columns = 0;
+    int op = 0;
+    int indirect = 0;
+    if (sqlite3changeset_op(it, &table, &columns, &op, &indirect) != SQLITE_OK) return SQLITE_CHANGESET_OMIT;
+
+    switch (conflict) {
+    case SQLITE_CHANGESET_DATA: {
+        // The row was changed on both sides
+        if (op == SQLITE_DELETE) return SQLITE_CHANGESET_REPLACE;
+        if (op != SQLITE_UPDATE) return SQLITE_CHANGESET_OMIT;
+
+        if (strcmp(table, "Notifications") == 0) {
+            sqlite3_value *remote = changeset_new_value(it, NOTIFICATION_COLUMN_DISMISSED_AT);
+            sqlite3_value *local = changeset_local_value(it, NOTIFICATION_COLUMN_DISMISSED_AT);
+            if (!value_is_null(remote) && value_is_null(local)) return SQLITE_CHANGESET_REPLACE;
+            return SQLITE_CHANGESET_OMIT;
+        }
+
+        if (strcmp(table, "Reminders") == 0) {
+            if (!value_is_null(changeset_local_value(it, REMINDER_COLUMN_FINISHED_AT))) return SQLITE_CHANGESET_OMIT;
+            if (!value_is_null(changeset_new_value(it, REMINDER_COLUMN_FINISHED_AT))) return SQLITE_CHANGESET_REPLACE;
+            sqlite3_value *remote = changeset_new_value(it, REMINDER_COLUMN_SCHEDULED_AT);
+            sqlite3_value *local = changeset_local_value(it, REMINDER_COLUMN_SCHEDULED_AT);
+            if (!value_is_null(remote) && !value_is_null(local) && sqlite3_value_int64(remote) > sqlite3_value_int64(local)) {
+                return SQLITE_CHANGESET_REPLACE;
+            }
+            return SQLITE_CHANGESET_OMIT;
         }
+
+        return SQLITE_CHANGESET_OMIT;
+    }
+
+    case SQLITE_CHANGESET_NOTFOUND:    // the row was archived on this side
+    case SQLITE_CHANGESET_CONFLICT:    // the row is already here
+    case SQLITE_CHANGESET_CONSTRAINT:
+    case SQLITE_CHANGESET_FOREIGN_KEY:
+    default:
+        return SQLITE_CHANGESET_OMIT;
     }
-    return NULL;
 }
 
-void serve_request(Serve_Context *sc, int client_fd)
+bool sync_init(sqlite3 *db)
 {
-    // TODO: log queries
+    bool result = true;
+    if (!txn_begin(db)) return_defer(false);
 
-    // <Status-Line>\r\n<Header>\r\n<Header>\r\n<Header>\r\n<Header>\r\n<Header>\r\n\r\n
-    char buffer[1024];
-    size_t cur = 0;
-    String_View suffix = sv_from_parts("\r\n\r\n", 4);
-    bool finish = false;
-    ssize_t n = 0;
-    do {
-        n = read(client_fd, buffer, sizeof(buffer));
-        if (n <= 0) break;
-        sb_append_buf(&sc->request, buffer, n);
-        for (; cur < sc->request.count && !finish; cur += 1) {
-            finish = nob_sv_starts_with(sv_from_parts(sc->request.items + cur, sc->request.count - cur), suffix);
+    // A database copied over to start syncing with has the site of the original. The new site
+    // inherits everything the old one had, which is exactly what the copy has, and the old one
+    // stays known as a peer that has all of that too.
+    const char *sql =
+        "CREATE TEMP TABLE IF NOT EXISTS OldSite AS SELECT site FROM SyncSite;\n"
+        "DELETE FROM temp.OldSite;\n"
+        "INSERT INTO temp.OldSite SELECT site FROM SyncSite;\n"
+        "DELETE FROM SyncSite;\n"
+        "WITH RECURSIVE Candidates (site, n) AS (\n"
+        "    SELECT abs(random()) % 1073741823 + 1, 0\n"
+        "    UNION ALL\n"
+        "    SELECT abs(random()) % 1073741823 + 1, n + 1 FROM Candidates WHERE n < 16\n"
+        ")\n"
+        "INSERT INTO SyncSite (site, clock)\n"
+        "SELECT site, (SELECT ifnull(max(seq), 0) FROM SyncPeers) FROM Candidates\n"
+        "WHERE site NOT IN (SELECT peer FROM SyncPeers UNION SELECT site FROM SyncPeers) LIMIT 1;\n"
+        "INSERT INTO SyncPeers (peer, site, seq, pruned)\n"
+        "SELECT (SELECT site FROM SyncSite), site, seq, pruned FROM SyncPeers WHERE peer IN (SELECT site FROM temp.OldSite);\n";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    int64_t site = 0;
+    if (!query_sync_site(db, &site)) return_defer(false);
+    assert(site != 0);
+    printf("This database is now site %"PRIi64" of the sync\n", site);
+
+defer:
+    if (result) result = txn_commit(db);
+    return result;
+}
+
+// Whether all the tables of the changeset have as many columns as they have in this database. The changes
+// recorded before an ALTER of the tables can't be applied or resolved by index anymore, and there is no
+// telling which of the files of before SYNC_FORMAT have them but looking inside.
+bool sync_changeset_layout_matches(sqlite3 *db, const void *changeset, int size, bool *matches)
+{
+    bool result = true;
+    sqlite3_changeset_iter *it = NULL;
+    sqlite3_stmt *stmt = NULL;
+    *matches = true;
+
+    if (sqlite3changeset_start(&it, size, (void *)changeset) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: could not read a changeset\n");
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "SELECT count(*) FROM pragma_table_info(?1, 'main')", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    int ret = 0;
+    while (*matches && (ret = sqlite3changeset_next(it)) == SQLITE_ROW) {
+        const char *table = NULL;
+        int columns = 0;
+        int op = 0;
+        int indirect = 0;
+        if (sqlite3changeset_op(it, &table, &columns, &op, &indirect) != SQLITE_OK) {
+            fprintf(stderr, "ERROR: could not read a changeset\n");
+            return_defer(false);
         }
-    } while (!finish);
+        if (sqlite3_bind_text(stmt, 1, table, -1, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        *matches = sqlite3_column_int(stmt, 0) == columns;
+        sqlite3_reset(stmt);
+    }
+    if (*matches && ret != SQLITE_DONE) {
+        fprintf(stderr, "ERROR: could not read a changeset: %s\n", sqlite3_errstr(ret));
+        return_defer(false);
+    }
 
-    if (n < 0) {
-        fprintf(stderr, "ERROR: could not read request: %s", strerror(errno));
-        return;
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (it) sqlite3changeset_finalize(it);
+    return result;
+}
+
+// The changes this database keeps that were recorded before the layout of its tables changed are no good
+// to anybody. They are dropped as if all the peers had them already, so a peer that still misses them is
+// told to start over from a copy by the same check as for the changes that were simply pruned.
+bool sync_discard_changes_of_old_layout(sqlite3 *db, int64_t site)
+{
+    bool result = true;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *discard = NULL;
+    sqlite3_stmt *prune = NULL;
+    int discarded = 0;
+
+    if (!txn_begin(db)) return false;
+
+    if (sqlite3_prepare_v2(db, "SELECT site, seq, changeset FROM Changesets", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "DELETE FROM Changesets WHERE site = ?1 AND seq = ?2", -1, &discard, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    const char *sql =
+        "INSERT INTO SyncPeers (peer, site, seq, pruned) VALUES (?1, ?2, ?3, ?3) "
+        "ON CONFLICT DO UPDATE SET seq = max(seq, excluded.seq), pruned = max(pruned, excluded.pruned)";
+    if (sqlite3_prepare_v2(db, sql, -1, &prune, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(prune, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
     }
 
-    String_View request = sb_to_sv(sc->request);
-    String_View status_line = sv_trim(sv_chop_by_delim(&request, '\n'));
-    String_View method = sv_trim(sv_chop_by_delim(&status_line, ' '));
-    UNUSED(method);
-    String_View uri =  sv_trim(sv_chop_by_delim(&status_line, ' '));
+    int ret = 0;
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        int64_t origin = sqlite3_column_int64(stmt, 0);
+        int64_t seq = sqlite3_column_int64(stmt, 1);
+        bool matches = true;
+        if (!sync_changeset_layout_matches(db, sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2), &matches)) return_defer(false);
+        if (matches) continue;
 
-    if (sv_eq(uri, sv_from_cstr("/"))) {
-        if (!load_active_grouped_notifications(sc->db, &sc->notifs)) return;
-        if (!load_active_reminders(sc->db, &sc->reminders)) return;
-        render_index_page(&sc->body, sc->notifs, sc->reminders);
-
-        sb_append_cstr(&sc->response, "HTTP/1.0 200\r\n");
-        sb_append_cstr(&sc->response, "Content-Type: text/html\r\n");
-        sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
-        sb_append_cstr(&sc->response, "Connection: close\r\n");
-        sb_append_cstr(&sc->response, "\r\n");
-        sb_append_buf(&sc->response, sc->body.items, sc->body.count);
-    } else if (sv_eq(uri, sv_from_cstr("/favicon.ico"))) {
-        Resource *favicon = find_resource("./resources/images/tore.png");
-        if (favicon) {
-            sb_append_buf(&sc->body, &bundle[favicon->offset], favicon->size);
-            sb_append_cstr(&sc->response, "HTTP/1.0 200 OK\r\n");
-            sb_append_cstr(&sc->response, "Content-Type: image/png\r\n");
-            sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
-            sb_append_cstr(&sc->response, "Connection: close\r\n");
-            sb_append_cstr(&sc->response, "\r\n");
-            sb_append_buf(&sc->response, sc->body.items, sc->body.count);
-        } else {
-            render_error_page(&sc->body, 404, "Not Found");
-
-            sb_append_cstr(&sc->response, "HTTP/1.0 404 Not Found\r\n");
-            sb_append_cstr(&sc->response, "Content-Type: text/html\r\n");
-            sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
-            sb_append_cstr(&sc->response, "Connection: close\r\n");
-            sb_append_cstr(&sc->response, "\r\n");
-            sb_append_buf(&sc->response, sc->body.items, sc->body.count);
-        }
-    } else if (sv_eq(uri, sv_from_cstr("/urmom"))) {
-        render_error_page(&sc->body, 413, "Request Entity Too Large");
-
-        sb_append_cstr(&sc->response, "HTTP/1.0 413 Request Entity Too Large\r\n");
-        sb_append_cstr(&sc->response, "Content-Type: text/html\r\n");
-        sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
-        sb_append_cstr(&sc->response, "Connection: close\r\n");
-        sb_append_cstr(&sc->response, "\r\n");
-        sb_append_buf(&sc->response, sc->body.items, sc->body.count);
+        if (sqlite3_bind_int64(discard, 1, origin) != SQLITE_OK || sqlite3_bind_int64(discard, 2, seq) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(discard) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(discard);
+
+        if (sqlite3_bind_int64(prune, 2, origin) != SQLITE_OK || sqlite3_bind_int64(prune, 3, seq) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(prune) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(prune);
+        discarded += 1;
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (discarded > 0) {
+        printf("INFO: discarded %d changes recorded with an older layout of the tables. The peers that miss them have to start over from a copy.\n", discarded);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (discard) sqlite3_finalize(discard);
+    if (prune) sqlite3_finalize(prune);
+    if (result) {
+        result = txn_commit(db);
     } else {
-        render_error_page(&sc->body, 404, "Not Found");
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+    }
+    return result;
+}
+
+// Applies the changes from the file of a peer that this database does not have yet
+bool sync_apply_bundle(sqlite3 *db, int64_t site, const char *bundle_path, int *applied)
+{
+    bool result = true;
+    bool attached = false;
+    bool in_txn = false;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *save_changeset = NULL;
+    sqlite3_stmt *save_peer = NULL;
+    sqlite3_stmt *save_clock = NULL;
+    int64_t sender = 0;
+
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS bundle", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_text(stmt, 1, bundle_path, strlen(bundle_path), NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    attached = true;
+
+    if (!txn_begin(db)) return_defer(false);
+    in_txn = true;
+    sync_recorder_pause(db, true);
+
+    if (sqlite3_prepare_v2(db, "PRAGMA bundle.user_version", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int format = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (format > SYNC_FORMAT) {
+        fprintf(stderr, "ERROR: %s: written by a newer tore (format %d, this one knows up to %d). Update tore here first.\n", bundle_path, format, SYNC_FORMAT);
+        return_defer(false);
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT site FROM bundle.Bundle", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        fprintf(stderr, "ERROR: %s: not a file of `tore sync`\n", bundle_path);
+        return_defer(false);
+    }
+    sender = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (sender == site) {
+        fprintf(stderr, "ERROR: %s: written by another database with the same site %"PRIi64". Run `tore sync init` on the copied one.\n", bundle_path, site);
+        return_defer(false);
+    }
+
+    // The peer deletes the changes once all of its peers have them. If this database is not one of
+    // them yet, it may be too late to catch up.
+    const char *sql =
+        "SELECT h.site, h.pruned FROM bundle.Have h\n"
+        "WHERE h.site <> ?1 AND h.pruned > ifnull((SELECT seq FROM main.SyncPeers WHERE peer = ?1 AND site = h.site), 0)";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW) {
+        fprintf(stderr, "ERROR: %s: the changes of site %"PRIi64" up to %"PRIi64" are not available anymore. Copy that database over and run `tore sync init` on the copy.\n",
+                bundle_path, (int64_t)sqlite3_column_int64(stmt, 0), (int64_t)sqlite3_column_int64(stmt, 1));
+        return_defer(false);
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+
+    sql =
+        "SELECT c.site, c.seq, c.changeset FROM bundle.Changesets c\n"
+        "WHERE c.seq > ifnull((SELECT seq FROM main.SyncPeers WHERE peer = ?1 AND site = c.site), 0)\n"
+        "ORDER BY c.seq, c.site";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    // The applied changesets are kept to pass them on to the peers that don't talk to their origin directly
+    if (sqlite3_prepare_v2(db, "INSERT INTO Changesets (site, seq, changeset) VALUES (?1, ?2, ?3)", -1, &save_changeset, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "INSERT INTO SyncPeers (peer, site, seq) VALUES (?1, ?2, ?3) ON CONFLICT DO UPDATE SET seq = excluded.seq", -1, &save_peer, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(save_peer, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "UPDATE SyncSite SET clock = max(clock, ?1)", -1, &save_clock, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    for (ret = sqlite3_step(stmt); ret == SQLITE_ROW; ret = sqlite3_step(stmt)) {
+        int64_t origin = sqlite3_column_int64(stmt, 0);
+        int64_t seq = sqlite3_column_int64(stmt, 1);
+        const void *changeset = sqlite3_column_blob(stmt, 2);
+        int size = sqlite3_column_bytes(stmt, 2);
+
+        if (format < SYNC_FORMAT) {
+            bool matches = true;
+            if (!sync_changeset_layout_matches(db, changeset, size, &matches)) return_defer(false);
+            if (!matches) {
+                fprintf(stderr, "ERROR: %s: change %"PRIi64" of site %"PRIi64" was recorded with an older layout of the tables. "
+                        "Run `tore sync` with this version of tore on the database that wrote the file first.\n", bundle_path, seq, origin);
+                return_defer(false);
+            }
+        }
+
+        int apply = sqlite3changeset_apply_v2(db, size, (void *)changeset, NULL, sync_conflict, NULL, NULL, NULL, 0);
+        if (apply != SQLITE_OK) {
+            fprintf(stderr, "ERROR: %s: could not apply change %"PRIi64" of site %"PRIi64": %s\n", bundle_path, seq, origin, sqlite3_errstr(apply));
+            return_defer(false);
+        }
+
+        if (sqlite3_bind_int64(save_changeset, 1, origin) != SQLITE_OK ||
+            sqlite3_bind_int64(save_changeset, 2, seq) != SQLITE_OK ||
+            sqlite3_bind_blob(save_changeset, 3, changeset, size, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(save_changeset) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(save_changeset);
+
+        if (sqlite3_bind_int64(save_peer, 2, origin) != SQLITE_OK || sqlite3_bind_int64(save_peer, 3, seq) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(save_peer) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(save_peer);
+
+        if (sqlite3_bind_int64(save_clock, 1, seq) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (sqlite3_step(save_clock) != SQLITE_DONE) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        sqlite3_reset(save_clock);
+        *applied += 1;
+    }
+    if (ret != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
 
-        sb_append_cstr(&sc->response, "HTTP/1.0 404 Not Found\r\n");
-        sb_append_cstr(&sc->response, "Content-Type: text/html\r\n");
-        sb_append_cstr(&sc->response, temp_sprintf("Content-Length: %zu\r\n", sc->body.count));
-        sb_append_cstr(&sc->response, "Connection: close\r\n");
-        sb_append_cstr(&sc->response, "\r\n");
-        sb_append_buf(&sc->response, sc->body.items, sc->body.count);
+    // Everything the sender has, for knowing what it is still missing
+    if (sqlite3_prepare_v2(db, "INSERT INTO SyncPeers (peer, site, seq) SELECT ?1, site, seq FROM bundle.Have WHERE true ON CONFLICT DO UPDATE SET seq = max(seq, excluded.seq)", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 1, sender) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
     }
 
-    String_View untransfered = sb_to_sv(sc->response);
-    while (untransfered.count > 0) {
-        ssize_t transfered = write(client_fd, untransfered.data, untransfered.count);
-        if (transfered < 0) {
-            fprintf(stderr, "ERROR: Could not write response: %s\n", strerror(errno));
-            return;
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (save_changeset) sqlite3_finalize(save_changeset);
+    if (save_peer) sqlite3_finalize(save_peer);
+    if (save_clock) sqlite3_finalize(save_clock);
+    if (in_txn) {
+        sync_recorder_pause(db, false);
+        if (result) {
+            result = txn_commit(db);
+        } else {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
         }
-        untransfered.data += transfered;
-        untransfered.count -= transfered;
     }
+    if (attached && sqlite3_exec(db, "DETACH DATABASE bundle", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        result = false;
+    }
+    return result;
 }
 
-bool serve_run(Command *self, const char *program_name, int argc, char **argv)
+// A database copied over without `tore sync init` writes into the same file as the original.
+// That is noticed by the file having more changes of the site than this database ever made.
+bool sync_check_own_bundle(sqlite3 *db, int64_t site, const char *bundle_path)
 {
-    UNUSED(self);
-    UNUSED(program_name);
-    UNUSED(argc);
-    UNUSED(argv);
+    if (!file_exists(bundle_path)) return true;
+
     bool result = true;
-    sqlite3 *db = open_tore_db();
-    if (!db) return_defer(false);
-    // NOTE: We are intentionally not listening to the external addresses, because we are using a
-    // custom scuffed implementation of HTTP protocol, which is incomplete and possibly insecure.
-    // The `serve` command is meant to be used only locally by a single person. At least for now.
-    // We are doing it for the sake of simplicity, 'cause we don't have to ship an entire proper
-    // HTTP server. Though, if you really want to, you can always slap some reverse proxy like nginx
-    // on top of the `serve`.
-    const char *addr = "127.0.0.1";
-    uint16_t port = DEFAULT_SERVE_PORT;
-    if (argc > 0) port = atoi(shift(argv, argc));
+    sqlite3 *bundle = NULL;
+    sqlite3_stmt *stmt = NULL;
 
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        fprintf(stderr, "ERROR: Could not create socket epicly: %s\n", strerror(errno));
+    if (sqlite3_open_v2(bundle_path, &bundle, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(bundle);
         return_defer(false);
     }
-
-    int option = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
-
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    server_addr.sin_addr.s_addr = inet_addr(addr);
-
-    ssize_t err = bind(server_fd, (struct sockaddr*) &server_addr, sizeof(server_addr));
-    if (err != 0) {
-        fprintf(stderr, "ERROR: Could not bind socket epicly: %s\n", strerror(errno));
+    if (sqlite3_prepare_v2(bundle, "SELECT seq FROM Have WHERE site = ?", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(bundle);
         return_defer(false);
     }
-
-    err = listen(server_fd, 69);
-    if (err != 0) {
-        fprintf(stderr, "ERRO: Could not listen to socket, it's too quiet: %s\n", strerror(errno));
+    if (sqlite3_bind_int64(stmt, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(bundle);
         return_defer(false);
     }
-
-    printf("Listening to http://%s:%d/\n", addr, port);
-
-    Serve_Context sc = {.db = db};
-    for (;;) {
-        struct sockaddr_in client_addr;
-        socklen_t client_addrlen = 0;
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addrlen);
-        if (client_fd < 0) {
-            fprintf(stderr, "ERROR: Could not accept connection. This is unacceptable! %s\n", strerror(errno));
-            continue;
-        }
-
-        if (txn_begin(db)) {
-            serve_request(&sc, client_fd);
-            txn_commit(db);
-        }
-
-        shutdown(client_fd, SHUT_WR);
-        char buffer[4096];
-        while (read(client_fd, buffer, sizeof(buffer)) > 0);
-        close(client_fd);
-        sc_reset(&sc);
-        temp_reset();
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_DONE) return_defer(true);
+    if (ret != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(bundle);
+        return_defer(false);
     }
+    int64_t written = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
 
-    // TODO: The only way to stop the server is by SIGINT, but that probably doesn't close the db correctly.
-    // So we probably should add a SIGINT handler specifically for this.
-
-    UNREACHABLE("serve");
+    if (sqlite3_prepare_v2(db, "SELECT ifnull((SELECT seq FROM SyncPeers WHERE peer = ?1 AND site = ?1), 0)", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_int64(stmt, 1, site) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (written > sqlite3_column_int64(stmt, 0)) {
+        fprintf(stderr, "ERROR: %s was written by another database with the same site %"PRIi64". Run `tore sync init` on the copied one.\n", bundle_path, site);
+        return_defer(false);
+    }
 
 defer:
-    // TODO: properly close the sockets on defer
-    if (db) sqlite3_close(db);
+    if (stmt) sqlite3_finalize(stmt);
+    if (bundle) sqlite3_close(bundle);
     return result;
 }
 
-bool notify_run(Command *self, const char *program_name, int argc, char **argv)
+// Forgets the changes all the known peers already have and writes the rest into <dir>/<site>.tore-sync
+bool sync_write_bundle(sqlite3 *db, int64_t site, const char *dir, int *pending)
 {
     bool result = true;
-    sqlite3 *db = NULL;
-    String_Builder sb = {0};
+    bool attached = false;
+    sqlite3_stmt *stmt = NULL;
 
-    if (argc <= 0) {
-        fprintf(stderr, "Usage:\n");
-        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
-        fprintf(stderr, "ERROR: expected title\n");
+    const char *sql = temp_sprintf(
+        "UPDATE SyncPeers AS own SET pruned = max(pruned, (\n"
+        "    SELECT min(ifnull((SELECT p.seq FROM SyncPeers p WHERE p.peer = peers.peer AND p.site = own.site), 0))\n"
+        "    FROM (SELECT DISTINCT peer FROM SyncPeers WHERE peer <> %1$"PRIi64") peers\n"
+        "))\n"
+        "WHERE own.peer = %1$"PRIi64" AND EXISTS (SELECT 1 FROM SyncPeers WHERE peer <> %1$"PRIi64");\n"
+        "DELETE FROM Changesets WHERE seq <= (SELECT pruned FROM SyncPeers WHERE peer = %1$"PRIi64" AND site = Changesets.site);\n",
+        site);
+    if (!txn_begin(db)) return_defer(false);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
         return_defer(false);
     }
+    if (!txn_commit(db)) return_defer(false);
 
-    db = open_tore_db();
-    if (!db) return_defer(false);
-    if (!txn_begin(db)) return_defer(false);
-
-    for (bool pad = false; argc > 0; pad = true) {
-        if (pad) sb_append_cstr(&sb, " ");
-        sb_append_cstr(&sb, shift(argv, argc));
+    const char *bundle_path = temp_sprintf("%s/%"PRIi64 SYNC_BUNDLE_EXTENSION, dir, site);
+    const char *tmp_path = temp_sprintf("%s/.%"PRIi64 SYNC_BUNDLE_EXTENSION".tmp", dir, site);
+    if (remove(tmp_path) < 0 && errno != ENOENT) {
+        fprintf(stderr, "ERROR: could not remove %s: %s\n", tmp_path, strerror(errno));
+        return_defer(false);
     }
-    sb_append_null(&sb);
-    const char *title = sb.items;
 
-    if (!create_notification_with_title(db, title)) return_defer(false);
-    if (!show_active_notifications(db)) return_defer(false);
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS outbox", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_bind_text(stmt, 1, tmp_path, strlen(tmp_path), NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    attached = true;
+
+    sql = temp_sprintf(
+        "BEGIN;\n"
+        "PRAGMA outbox.user_version = "STR(SYNC_FORMAT)";\n"
+        "CREATE TABLE outbox.Bundle (site INTEGER NOT NULL);\n"
+        "CREATE TABLE outbox.Have (site INTEGER PRIMARY KEY, seq INTEGER NOT NULL, pruned INTEGER NOT NULL);\n"
+        "CREATE TABLE outbox.Changesets (site INTEGER NOT NULL, seq INTEGER NOT NULL, changeset BLOB NOT NULL, PRIMARY KEY (site, seq)) WITHOUT ROWID;\n"
+        "INSERT INTO outbox.Bundle (site) VALUES (%1$"PRIi64");\n"
+        "INSERT INTO outbox.Have (site, seq, pruned) SELECT site, seq, pruned FROM main.SyncPeers WHERE peer = %1$"PRIi64";\n"
+        "INSERT INTO outbox.Changesets (site, seq, changeset) SELECT site, seq, changeset FROM main.Changesets;\n"
+        "COMMIT;\n",
+        site);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    *pending = sqlite3_changes(db);
 
 defer:
-    if (db) {
-        if (result) result = txn_commit(db);
-        sqlite3_close(db);
+    if (stmt) sqlite3_finalize(stmt);
+    if (attached) {
+        if (sqlite3_exec(db, "DETACH DATABASE outbox", NULL, NULL, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            result = false;
+        }
+        // NOTE: not rename(), because nob redefines it into a version that logs every call
+        if (result && renameat(AT_FDCWD, tmp_path, AT_FDCWD, bundle_path) < 0) {
+            fprintf(stderr, "ERROR: could not rename %s to %s: %s\n", tmp_path, bundle_path, strerror(errno));
+            result = false;
+        }
     }
-    free(sb.items);
     return result;
 }
 
-bool forget_run(Command *self, const char *program_name, int argc, char **argv)
+bool sync_run(Command *self, const char *program_name, int argc, char **argv)
 {
     bool result = true;
     sqlite3 *db = NULL;
+    File_Paths children = {0};
+
     if (argc <= 0) {
-        fprintf(stderr, "Usage:\n");
-        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
-        fprintf(stderr, "ERROR: expected index\n");
+        fprintf(stderr, "Usage: %s %s %s\n", program_name, self->name, self->signature);
+        fprintf(stderr, "ERROR: expected a directory or init\n");
         return_defer(false);
     }
+    const char *dir = shift(argv, argc);
+
     db = open_tore_db();
     if (!db) return_defer(false);
-    if (!txn_begin(db)) return_defer(false);
-    int number = atoi(shift(argv, argc));
-    if (!remove_reminder_by_number(db, number)) return_defer(false);
-    if (!show_active_reminders(db)) return_defer(false);
-defer:
-    if (db) {
-        if (result) result = txn_commit(db);
-        sqlite3_close(db);
-    }
-    return result;
-}
 
-bool remind_run(Command *self, const char *program_name, int argc, char **argv)
-{
-    bool result = true;
-    sqlite3 *db = NULL;
-
-    if (argc <= 0) {
-        db = open_tore_db();
-        if (!db) return_defer(false);
-        if (!txn_begin(db)) return_defer(false);
-        if (!show_active_reminders(db)) return_defer(false);
+    if (strcmp(dir, "init") == 0) {
+        sync_recorder_stop(db);
+        if (!sync_init(db)) return_defer(false);
         return_defer(true);
     }
 
-    const char *title = shift(argv, argc);
-    if (argc <= 0) {
-        fprintf(stderr, "Usage:\n");
-        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
-        fprintf(stderr, "ERROR: expected scheduled_at\n");
-        return_defer(false);
-    }
-
-    // TODO: Allow the scheduled_at to be things like "today", "tomorrow", etc
-    // TODO: research if it's possible to enforce the date format on the level of sqlite3 contraints
-    const char *scheduled_at = shift(argv, argc);
-    if (!verify_date_format(scheduled_at)) {
-        fprintf(stderr, "ERROR: %s is not a valid date format\n", scheduled_at);
+    int64_t site = 0;
+    if (!query_sync_site(db, &site)) return_defer(false);
+    if (site == 0) {
+        fprintf(stderr, "ERROR: this database does not take part in a sync yet. Run `%s %s init` first.\n", program_name, self->name);
         return_defer(false);
     }
 
-    Period period = PERIOD_NONE;
-    unsigned long period_length = 0;
-    if (argc > 0) {
-        const char *unparsed_period = shift(argv, argc);
-        char *endptr = NULL;
-        period_length = strtoul(unparsed_period, &endptr, 10);
-        if (endptr == unparsed_period) {
-            fprintf(stderr, "ERROR: Invalid period `%s`. Expected something like\n", unparsed_period);
-            for (Period p = 0; p < COUNT_PERIODS; ++p) {
-                Period_Modifier *pm = &tore_period_modifiers[p];
-                size_t l = rand()%9 + 1;
-                fprintf(stderr, "    %lu%s - means every %lu %s\n", l, pm->modifier, l, pm->name);
-            }
-            return_defer(false);
-        }
-        unparsed_period = endptr;
-        period = period_by_tore_modifier(unparsed_period);
-        if (period == PERIOD_NONE) {
-            fprintf(stderr, "ERROR: Unknown period modifier `%s`. Expected modifiers are\n", unparsed_period);
-            for (Period p = 0; p < COUNT_PERIODS; ++p) {
-                Period_Modifier *pm = &tore_period_modifiers[p];
-                fprintf(stderr, "    %lu%s  - means every %lu %s\n", period_length, pm->modifier, period_length, pm->name);
-            }
-            return_defer(false);
-        }
+    if (!read_entire_dir(dir, &children)) return_defer(false);
+    const char *own_bundle = temp_sprintf("%"PRIi64 SYNC_BUNDLE_EXTENSION, site);
+    if (!sync_check_own_bundle(db, site, temp_sprintf("%s/%s", dir, own_bundle))) return_defer(false);
+    int applied = 0;
+    int peers = 0;
+    for (size_t i = 0; i < children.count; ++i) {
+        const char *name = children.items[i];
+        if (*name == '.' || !sv_end_with(sv_from_cstr(name), SYNC_BUNDLE_EXTENSION) || strcmp(name, own_bundle) == 0) continue;
+        if (!sync_apply_bundle(db, site, temp_sprintf("%s/%s", dir, name), &applied)) return_defer(false);
+        peers += 1;
     }
 
-    db = open_tore_db();
-    if (!db) return_defer(false);
-    if (!txn_begin(db)) return_defer(false);
-    if (!create_new_reminder(db, title, scheduled_at, period, period_length)) return_defer(false);
-    if (!show_active_reminders(db)) return_defer(false);
-
-defer:
-    if (db) {
-        if (result) result = txn_commit(db);
-        sqlite3_close(db);
-    }
-    return result;
-}
+    int pending = 0;
+    if (!sync_discard_changes_of_old_layout(db, site)) return_defer(false);
+    if (!sync_write_bundle(db, site, dir, &pending)) return_defer(false);
+    printf("Applied %d changes from %d databases. %d changes are kept for the peers that may not have them yet.\n", applied, peers, pending);
 
-bool expand_run(Command *self, const char *program_name, int argc, char **argv)
-{
-    bool result = true;
-    sqlite3 *db = open_tore_db();
-    if (!db) return_defer(false);
-    if (!txn_begin(db)) return_defer(false);
-    if (argc <= 0) {
-        fprintf(stderr, "Usage:\n");
-        command_describe(*self, program_name, 2, DESCRIPTION_SHORT);
-        fprintf(stderr, "ERROR: no index is provided\n");
-        return_defer(false);
-    }
-    int index = atoi(shift(argv, argc));
-    if (!show_expanded_notifications_by_index(db, index)) return_defer(false);
 defer:
-    if (db) {
-        if (result) result = txn_commit(db);
-        sqlite3_close(db);
-    }
+    free(children.items);
+    if (db) close_tore_db(db);
     return result;
 }
 
-bool help_run(Command *self, const char *program_name, int argc, char **argv);
-
 static Command commands[] = {
     {
         .name = "checkout",
         .signature = NULL,
         .description = "Fire off the Reminders if needed and show the current Notifications\n"
-            "This is a default command that is executed when you just call Tore by itself.",
+            "This is a default command that is executed when you just call Tore by itself.\n"
+            "All the occurrences of periodic Reminders missed since the last run are fired off at once.\n"
+            "Set `catch_up = coalesce` in ~/"TORE_CONFIG_FILENAME" to get one Notification per Reminder carrying the amount of them instead.",
         .category = "Notifications",
         .run = checkout_run,
     },
@@ -1180,8 +5581,10 @@ static Command commands[] = {
     },
     {
         .name = "dismiss",
-        .signature = "<indices...>",
-        .description = "Dismiss notifications by specified indices.",
+        .signature = "<indices...> | --all",
+        .description = "Dismiss notifications by specified indices.\n"
+            "An index may also be an inclusive range like 3-40. Pass --all to dismiss\n"
+            "every active Notification at once.",
         .category = "Notifications",
         .run = dismiss_run,
     },
@@ -1197,8 +5600,8 @@ static Command commands[] = {
     },
     {
         .name = "remind",
-        .signature = "[<title> <scheduled_at> [period]]",
-        .description = "Schedule a reminder",
+        .signature = "[<title> <scheduled_at> [period] [--lead <days>]]",
+        .description = "Schedule a reminder. With --lead it shows up in checkout that many days ahead",
         .category = "Reminders",
         .run = remind_run,
     },
@@ -1209,10 +5612,90 @@ static Command commands[] = {
         .category = "Reminders",
         .run = forget_run,
     },
+    {
+        .name = "calendar",
+        .signature = "[<year> | <month> | <from> [<to>] | <period>]",
+        .description = "Show the upcoming occurrences of the reminders day by day\n"
+            "The range is a year like 2025, a month like 2025-03, the dates YYYY-MM-DD from and to inclusive,\n"
+            "or a period from today in the notation of `remind` like 3m. By default the next " STR(DEFAULT_CALENDAR_DAYS) " days.",
+        .category = "Reminders",
+        .run = calendar_run,
+    },
+    {
+        .name = "search",
+        .signature = "<query...>",
+        .description = "Search the titles of all Notifications and Reminders including the archived ones.\n"
+            "Every word of the query must be present in the title. The last one may be a prefix of a word.\n"
+            "The matches are ranked by relevance and highlighted with *asterisks*.",
+        .category = "History",
+        .run = search_run,
+    },
+    {
+        .name = "import",
+        .signature = "[jsonl|csv]",
+        .description = "Import Reminders and Notifications from stdin in one go. The default format is jsonl.\n"
+            "Every row has a type (reminder or notification) and the fields of `tore export`.\n"
+            "Timestamps are either seconds since the Unix Epoch or UTC datetimes. The Notifications\n"
+            "are linked to the Reminders imported earlier in the same input by their old reminder_id.",
+        .category = "Maintenance",
+        .run = import_run,
+    },
+    {
+        .name = "export",
+        .signature = "[jsonl|csv]",
+        .description = "Export all the Reminders and Notifications to stdout. The default format is jsonl.",
+        .category = "Maintenance",
+        .run = export_run,
+    },
+    {
+        .name = "archive",
+        .signature = "[days]",
+        .description = "Move Notifications dismissed and Reminders finished more than `days` ago into ~/"TORE_ARCHIVE_FILENAME"\n"
+            "Default is " STR(DEFAULT_ARCHIVE_AFTER_DAYS) " days. This also happens automatically at most once a day on `checkout`.\n"
+            "The first explicit run converts an old database to incremental auto_vacuum with a full VACUUM.\n"
+            "The archive is a regular SQLite database with the same Notifications and Reminders tables,\n"
+            "so the history is still there to query, e.g. with `sqlite3 ~/"TORE_ARCHIVE_FILENAME"`.",
+        .category = "Maintenance",
+        .run = archive_run,
+    },
+    {
+        .name = "backup",
+        .signature = "<path> [--compress] [--step <pages>] [--pause <ms>]",
+        .description = "Write a consistent snapshot of the database into <path> while it is in use\n"
+            "The database is copied by --step pages at a time with a pause of --pause milliseconds between\n"
+            "the steps, so `serve` and the other commands are not blocked and the disk is not hogged.\n"
+            "The defaults are backup_pages_per_step = "STR(DEFAULT_BACKUP_PAGES_PER_STEP)" and backup_pause = "STR(DEFAULT_BACKUP_PAUSE)" in ~/"TORE_CONFIG_FILENAME".\n"
+            "The archived history in ~/"TORE_ARCHIVE_FILENAME", if there is one, is backed up the same way into <path>"TORE_ARCHIVE_SUFFIX".\n"
+            "With --compress the snapshots are compressed by gzip, which checksums them. Verify them with `gzip -t <path>`.",
+        .category = "Maintenance",
+        .run = backup_run,
+    },
+    {
+        .name = "check",
+        .signature = NULL,
+        .description = "Check the consistency of the database and repair what can be repaired\n"
+            "Right now it verifies the NotificationGroups summary against the Notifications and rebuilds it on mismatch,\n"
+            "and that `expand`, `dismiss` and the archiving probe of `checkout` look things up by an index instead of a full scan.",
+        .category = "Maintenance",
+        .run = check_run,
+    },
+    {
+        .name = "sync",
+        .signature = "init | <dir>",
+        .description = "Exchange the changes with the other databases of yours through the directory <dir>\n"
+            "To start, copy the database over once and run `sync init` on both sides. After that run\n"
+            "`sync <dir>` on each of them with <dir> shared between them in any way you like.\n"
+            "Only the changes the others don't have yet are written and applied.",
+        .category = "Maintenance",
+        .run = sync_run,
+    },
     {
         .name = "serve",
-        .signature = "[port]",
-        .description = "Start up the Web Server. Default port is " STR(DEFAULT_SERVE_PORT) ".",
+        .signature = "[port] [--tenants <dir>]",
+        .description = "Start up the Web Server. Default port is " STR(DEFAULT_SERVE_PORT) " or `port` from the [serve] section of ~/"TORE_CONFIG_FILENAME".\n"
+            "With --tenants (or `tenants` in [serve]) serves <dir>/<name>/"TORE_FILENAME" of every user <name> under "TENANT_PATH_PREFIX"<name>/\n"
+            "or to the requests with the "TENANT_HEADER" header. The databases are opened read-only and must be migrated already.\n"
+            "Statistics summed up over all the users are at /metrics.",
         .category = "Web",
         .run = serve_run,
     },
@@ -1261,6 +5744,8 @@ bool help_run(Command *self, const char *program_name, int argc, char **argv)
     return true;
 }
 
+// tests/tore_test.c includes this whole file to test its functions, so it brings its own main()
+#ifndef TORE_NO_MAIN
 int main(int argc, char **argv)
 {
     int result = 0;
@@ -1271,6 +5756,9 @@ int main(int argc, char **argv)
     const char *command_name = DEFAULT_COMMAND;
     if (argc > 0) command_name = shift(argv, argc);
 
+    if (!load_config()) return_defer(1);
+    if (strcmp(command_name, "serve") == 0) config.profile = PROFILE_SERVE;
+
     for (size_t i = 0; i < ARRAY_LEN(commands); ++i) {
         if (strcmp(commands[i].name, command_name) == 0) {
             if (!commands[i].run(&commands[i], program_name, argc, argv)) return_defer(1);
@@ -1284,7 +5772,7 @@ int main(int argc, char **argv)
 defer:
     return result;
 }
+#endif // TORE_NO_MAIN
 
 // TODO: `undo` command
 // TODO: some way to turn Notification into a Reminder
-// TODO: calendar output with the reminders
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+// Load generator for `tore serve`. It keeps the given amount of connections busy with a weighted
+// mix of paths and records how long every request took into an HDR-style histogram, so the high
+// percentiles are as precise as the median without keeping every single sample around.
+
+#define DEFAULT_PORT 6969
+#define DEFAULT_CONNECTIONS 16
+#define DEFAULT_SECONDS 10
+#define MAX_PATHS 16
+#define MAX_STATUS 600
+
+// Every power of two of nanoseconds is split into this many buckets, so a recorded value is off
+// by less than 1/2^HIST_SUB_BITS, i.e. 1%.
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1)*HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+} Histogram;
+
+size_t hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_COUNT) return value;
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((size_t)(shift + 1) << HIST_SUB_BITS) + (value >> shift) - HIST_SUB_COUNT;
+}
+
+// The highest value that falls into the bucket, which is what the percentiles are reported as
+uint64_t hist_value(size_t index)
+{
+    if (index < HIST_SUB_COUNT) return index;
+    size_t shift = (index >> HIST_SUB_BITS) - 1;
+    uint64_t sub = (index & (HIST_SUB_COUNT - 1)) + HIST_SUB_COUNT;
+    return (sub << shift) + ((1ull << shift) - 1);
+}
+
+void hist_record(Histogram *hist, uint64_t value)
+{
+    hist->buckets[hist_index(value)] += 1;
+    hist->count += 1;
+    if (value > hist->max) hist->max = value;
+}
+
+uint64_t hist_percentile(const Histogram *hist, double percentile)
+{
+    if (hist->count == 0) return 0;
+    uint64_t target = (uint64_t)(percentile/100.0*hist->count + 0.5);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= target) return hist_value(i) < hist->max ? hist_value(i) : hist->max;
+    }
+    return hist->max;
+}
+
+typedef struct {
+    const char *path;
+    unsigned weight;
+    uint64_t statuses[MAX_STATUS];
+    uint64_t errors;
+} Bench_Path;
+
+typedef enum {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_WRITING,
+    CONN_READING,
+} Conn_State;
+
+typedef struct {
+    int fd;
+    Conn_State state;
+    Bench_Path *path;
+    String_Builder request;
+    size_t written;
+    String_Builder response;
+    size_t header_size;     // 0 until the whole header is received
+    long content_length;    // -1 if the response did not say
+    bool server_closes;
+    int status;
+    uint64_t started_at;
+} Connection;
+
+typedef struct {
+    uint16_t port;
+    size_t connections;
+    double seconds;
+    uint64_t requests;      // 0 means run for the duration
+    bool keep_alive;
+    bool json;
+    Bench_Path paths[MAX_PATHS];
+    size_t paths_count;
+    unsigned total_weight;
+} Bench;
+
+Histogram latency = {0};
+uint64_t completed = 0;
+uint64_t started = 0;
+uint64_t errors = 0;
+uint64_t rng_state = 0x2545F4914F6CDD1Dull;
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+uint64_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+Bench_Path *pick_path(Bench *bench)
+{
+    unsigned x = rng_next()%bench->total_weight;
+    for (size_t i = 0; i < bench->paths_count; ++i) {
+        if (x < bench->paths[i].weight) return &bench->paths[i];
+        x -= bench->paths[i].weight;
+    }
+    UNREACHABLE("pick_path");
+}
+
+void conn_close(Connection *conn)
+{
+    if (conn->fd >= 0) close(conn->fd);
+    conn->fd = -1;
+    conn->state = CONN_IDLE;
+}
+
+void conn_fail(Connection *conn)
+{
+    errors += 1;
+    conn->path->errors += 1;
+    conn_close(conn);
+}
+
+void conn_start(Bench *bench, Connection *conn)
+{
+    conn->path = pick_path(bench);
+    conn->request.count = 0;
+    sb_append_cstr(&conn->request, temp_sprintf("GET %s HTTP/1.1\r\nHost: 127.0.0.1:%d\r\nConnection: %s\r\n\r\n",
+                                                conn->path->path, bench->port, bench->keep_alive ? "keep-alive" : "close"));
+    conn->written = 0;
+    conn->response.count = 0;
+    conn->header_size = 0;
+    conn->content_length = -1;
+    conn->server_closes = !bench->keep_alive;
+    conn->status = 0;
+    conn->started_at = now_ns();
+    started += 1;
+
+    if (conn->fd >= 0) {
+        conn->state = CONN_WRITING;
+        return;
+    }
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd < 0) {
+        conn_fail(conn);
+        return;
+    }
+    fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(bench->port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(conn->fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        conn->state = CONN_WRITING;
+    } else if (errno == EINPROGRESS) {
+        conn->state = CONN_CONNECTING;
+    } else {
+        conn_fail(conn);
+    }
+}
+
+// Parses as much of the response as is there. Returns true once it is complete.
+bool conn_parse(Connection *conn)
+{
+    if (conn->header_size == 0) {
+        String_View rest = sb_to_sv(conn->response);
+        size_t end = 0;
+        while (end + 4 <= rest.count && memcmp(rest.data + end, "\r\n\r\n", 4) != 0) end += 1;
+        if (end + 4 > rest.count) return false;
+        conn->header_size = end + 4;
+
+        String_View header = sv_from_parts(rest.data, end);
+        String_View status_line = sv_chop_by_delim(&header, '\n');
+        sv_chop_by_delim(&status_line, ' ');
+        conn->status = atoi(temp_sv_to_cstr(sv_chop_by_delim(&status_line, ' ')));
+        while (header.count > 0) {
+            String_View line = sv_trim(sv_chop_by_delim(&header, '\n'));
+            String_View name = sv_trim(sv_chop_by_delim(&line, ':'));
+            String_View value = sv_trim(line);
+            if (name.count == 14 && strncasecmp(name.data, "Content-Length", 14) == 0) {
+                conn->content_length = atol(temp_sv_to_cstr(value));
+            } else if (name.count == 10 && strncasecmp(name.data, "Connection", 10) == 0) {
+                conn->server_closes = value.count == 5 && strncasecmp(value.data, "close", 5) == 0;
+            }
+        }
+    }
+    if (conn->content_length < 0) return false;
+    return conn->response.count >= conn->header_size + (size_t)conn->content_length;
+}
+
+void conn_finish(Connection *conn)
+{
+    hist_record(&latency, now_ns() - conn->started_at);
+    completed += 1;
+    if (conn->status > 0 && conn->status < MAX_STATUS) {
+        conn->path->statuses[conn->status] += 1;
+    } else {
+        conn->path->errors += 1;
+        errors += 1;
+    }
+    if (conn->server_closes || conn->content_length < 0) {
+        conn_close(conn);
+    } else {
+        conn->state = CONN_IDLE;
+    }
+}
+
+void conn_step(Connection *conn, short revents)
+{
+    switch (conn->state) {
+    case CONN_CONNECTING: {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+            conn_fail(conn);
+            return;
+        }
+        conn->state = CONN_WRITING;
+    } break;
+    case CONN_WRITING: {
+        ssize_t n = write(conn->fd, conn->request.items + conn->written, conn->request.count - conn->written);
+        if (n < 0) {
+            if (errno != EAGAIN) conn_fail(conn);
+            return;
+        }
+        conn->written += n;
+        if (conn->written == conn->request.count) conn->state = CONN_READING;
+    } break;
+    case CONN_READING: {
+        if (!(revents & (POLLIN | POLLHUP | POLLERR))) return;
+        char buffer[16*1024];
+        ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno != EAGAIN) conn_fail(conn);
+            return;
+        }
+        if (n == 0) {
+            // The server is allowed to just close the connection to mark the end of the response
+            conn_parse(conn);
+            if (conn->header_size > 0 && (conn->content_length < 0 || conn->response.count >= conn->header_size + (size_t)conn->content_length)) {
+                conn->server_closes = true;
+                conn_finish(conn);
+            } else {
+                conn_fail(conn);
+            }
+            return;
+        }
+        sb_append_buf(&conn->response, buffer, n);
+        if (conn_parse(conn)) conn_finish(conn);
+    } break;
+    case CONN_IDLE:
+    default: UNREACHABLE("conn_step");
+    }
+}
+
+bool add_path(Bench *bench, const char *arg)
+{
+    if (bench->paths_count >= MAX_PATHS) {
+        fprintf(stderr, "ERROR: at most %d paths are supported\n", MAX_PATHS);
+        return false;
+    }
+    String_View path = sv_from_cstr(arg);
+    String_View rest = path;
+    path = sv_chop_by_delim(&rest, '=');
+    long weight = 1;
+    if (rest.count > 0 || path.count < strlen(arg)) {
+        char *endptr = NULL;
+        weight = strtol(rest.data, &endptr, 10);
+        if (rest.count == 0 || *endptr != '\0' || weight <= 0 || weight > 1000000) {
+            fprintf(stderr, "ERROR: invalid weight in `%s`. Expected <path>=<positive number>\n", arg);
+            return false;
+        }
+    }
+    if (path.count == 0 || path.data[0] != '/') {
+        fprintf(stderr, "ERROR: path `"SV_Fmt"` must start with /\n", SV_Arg(path));
+        return false;
+    }
+    bench->paths[bench->paths_count++] = (Bench_Path) {
+        .path = strndup(path.data, path.count),
+        .weight = weight,
+    };
+    bench->total_weight += weight;
+    return true;
+}
+
+void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] [port]\n", program_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -c <connections>  concurrent connections (default %d)\n", DEFAULT_CONNECTIONS);
+    fprintf(stderr, "  -d <seconds>      how long to run (default %d)\n", DEFAULT_SECONDS);
+    fprintf(stderr, "  -n <requests>     stop after this many requests instead\n");
+    fprintf(stderr, "  -k                keep the connections alive between the requests if the server allows it\n");
+    fprintf(stderr, "  -p <path>[=<w>]   add the path with the weight w to the mix. Can be repeated.\n");
+    fprintf(stderr, "                    The default mix is /=8 /favicon.ico=1 /bench-http-404=1\n");
+    fprintf(stderr, "  -json             print the summary as a single line of JSON\n");
+    fprintf(stderr, "  -h                print this help\n");
+}
+
+bool parse_number(const char *flag, int *argc, char ***argv, double min, double max, double *value)
+{
+    if (*argc <= 0) {
+        fprintf(stderr, "ERROR: expected a number after %s\n", flag);
+        return false;
+    }
+    const char *arg = shift(*argv, *argc);
+    char *endptr = NULL;
+    *value = strtod(arg, &endptr);
+    if (endptr == arg || *endptr != '\0' || *value < min || *value > max) {
+        fprintf(stderr, "ERROR: %s expects a number between %g and %g, got `%s`\n", flag, min, max, arg);
+        return false;
+    }
+    return true;
+}
+
+void print_summary(Bench *bench, double elapsed)
+{
+    static const double percentiles[] = { 50, 90, 99, 99.9 };
+    static const char *percentile_names[] = { "p50", "p90", "p99", "p999" };
+    static_assert(NOB_ARRAY_LEN(percentiles) == NOB_ARRAY_LEN(percentile_names), "Amount of percentiles has changed");
+
+    if (bench->json) {
+        printf("{\"connections\":%zu,\"keep_alive\":%s,\"seconds\":%.3f,\"requests\":%"PRIu64",\"errors\":%"PRIu64",\"rps\":%.1f",
+               bench->connections, bench->keep_alive ? "true" : "false", elapsed, completed, errors, completed/elapsed);
+        for (size_t i = 0; i < NOB_ARRAY_LEN(percentiles); ++i) {
+            printf(",\"%s_us\":%.1f", percentile_names[i], hist_percentile(&latency, percentiles[i])/1000.0);
+        }
+        printf(",\"max_us\":%.1f}\n", latency.max/1000.0);
+        return;
+    }
+
+    printf("%-24s %8s %10s  %s\n", "Path", "Weight", "Requests", "Statuses");
+    for (size_t i = 0; i < bench->paths_count; ++i) {
+        Bench_Path *it = &bench->paths[i];
+        uint64_t requests = it->errors;
+        for (size_t s = 0; s < MAX_STATUS; ++s) requests += it->statuses[s];
+        printf("%-24s %8u %10"PRIu64" ", it->path, it->weight, requests);
+        for (size_t s = 0; s < MAX_STATUS; ++s) {
+            if (it->statuses[s] > 0) printf(" %zu: %"PRIu64, s, it->statuses[s]);
+        }
+        if (it->errors > 0) printf(" errors: %"PRIu64, it->errors);
+        printf("\n");
+    }
+    printf("Requests: %"PRIu64" in %.3fs, %.1f req/s, %"PRIu64" errors\n", completed, elapsed, completed/elapsed, errors);
+    printf("Latency: ");
+    for (size_t i = 0; i < NOB_ARRAY_LEN(percentiles); ++i) {
+        printf(" %s %.3fms", percentile_names[i], hist_percentile(&latency, percentiles[i])/1e6);
+    }
+    printf(" max %.3fms\n", latency.max/1e6);
+}
+
+int main(int argc, char **argv)
+{
+    const char *program_name = shift(argv, argc);
+    Bench bench = {
+        .port = DEFAULT_PORT,
+        .connections = DEFAULT_CONNECTIONS,
+        .seconds = DEFAULT_SECONDS,
+    };
+    while (argc > 0) {
+        const char *arg = shift(argv, argc);
+        double value = 0;
+        if (strcmp(arg, "-c") == 0) {
+            if (!parse_number(arg, &argc, &argv, 1, 10000, &value)) return 1;
+            bench.connections = value;
+        } else if (strcmp(arg, "-d") == 0) {
+            if (!parse_number(arg, &argc, &argv, 0.001, 24*60*60, &value)) return 1;
+            bench.seconds = value;
+        } else if (strcmp(arg, "-n") == 0) {
+            if (!parse_number(arg, &argc, &argv, 1, 1e12, &value)) return 1;
+            bench.requests = value;
+        } else if (strcmp(arg, "-k") == 0) {
+            bench.keep_alive = true;
+        } else if (strcmp(arg, "-p") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: expected a path after -p\n");
+                return 1;
+            }
+            if (!add_path(&bench, shift(argv, argc))) return 1;
+        } else if (strcmp(arg, "-json") == 0) {
+            bench.json = true;
+        } else if (strcmp(arg, "-h") == 0) {
+            usage(program_name);
+            return 0;
+        } else if (*arg != '-') {
+            char *endptr = NULL;
+            long port = strtol(arg, &endptr, 10);
+            if (endptr == arg || *endptr != '\0' || port <= 0 || port > 65535) {
+                fprintf(stderr, "ERROR: invalid port `%s`\n", arg);
+                return 1;
+            }
+            bench.port = port;
+        } else {
+            usage(program_name);
+            fprintf(stderr, "ERROR: unknown option `%s`\n", arg);
+            return 1;
+        }
+    }
+    if (bench.paths_count == 0) {
+        add_path(&bench, "/=8");
+        add_path(&bench, "/favicon.ico=1");
+        add_path(&bench, "/bench-http-404=1");
+    }
+
+    if (!bench.json) {
+        printf("Benchmarking http://127.0.0.1:%d/ with %zu connections, %s, ", bench.port, bench.connections,
+               bench.keep_alive ? "keep-alive" : "a connection per request");
+        if (bench.requests > 0) {
+            printf("%"PRIu64" requests\n", bench.requests);
+        } else {
+            printf("%gs\n", bench.seconds);
+        }
+        fflush(stdout);
+    }
+
+    Connection *conns = calloc(bench.connections, sizeof(*conns));
+    struct pollfd *pfds = calloc(bench.connections, sizeof(*pfds));
+    assert(conns != NULL && pfds != NULL && "Buy more RAM lol");
+    for (size_t i = 0; i < bench.connections; ++i) conns[i].fd = -1;
+
+    uint64_t started_at = now_ns();
+    uint64_t deadline = bench.requests > 0 ? UINT64_MAX : started_at + (uint64_t)(bench.seconds*1e9);
+    for (;;) {
+        uint64_t now = now_ns();
+        bool more = now < deadline && (bench.requests == 0 || started < bench.requests);
+        size_t active = 0;
+        for (size_t i = 0; i < bench.connections; ++i) {
+            Connection *conn = &conns[i];
+            if (conn->state == CONN_IDLE && more) {
+                conn_start(&bench, conn);
+                temp_reset();
+                more = bench.requests == 0 || started < bench.requests;
+            }
+            pfds[i].fd = conn->state == CONN_IDLE ? -1 : conn->fd;
+            pfds[i].events = conn->state == CONN_READING ? POLLIN : POLLOUT;
+            pfds[i].revents = 0;
+            if (conn->state != CONN_IDLE) active += 1;
+        }
+        if (now >= deadline || (active == 0 && !more)) break;
+        // Nothing ever succeeds, most likely nobody is listening
+        if (completed == 0 && errors >= bench.connections) {
+            fprintf(stderr, "ERROR: could not get any response from port %d. Is `tore serve %d` running?\n", bench.port, bench.port);
+            return 1;
+        }
+
+        int timeout = deadline == UINT64_MAX ? -1 : (int)((deadline - now)/1000000 + 1);
+        int ready = poll(pfds, bench.connections, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "ERROR: could not poll the connections: %s\n", strerror(errno));
+            return 1;
+        }
+        for (size_t i = 0; i < bench.connections; ++i) {
+            if (pfds[i].fd >= 0 && pfds[i].revents) conn_step(&conns[i], pfds[i].revents);
+        }
+    }
+    double elapsed = (now_ns() - started_at)/1e9;
+
+    print_summary(&bench, elapsed);
+    for (size_t i = 0; i < bench.connections; ++i) {
+        conn_close(&conns[i]);
+        free(conns[i].request.items);
+        free(conns[i].response.items);
+    }
+    free(conns);
+    free(pfds);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+// Renders error_page.h.tt (compiled by tt into error_page.h) for a single error. nob runs it for
+// every canned response of the Web Server to prerender them into the bundle.
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <error-code> <error-name>\n", argv[0]);
+        return 1;
+    }
+    int error_code = atoi(argv[1]);
+    const char *error_name = argv[2];
+
+    String_Builder page = {0};
+    String_Builder *sb = &page;
+#define OUT(buf, size) sb_append_buf(sb, buf, size)
+#define ERROR_CODE sb_append_cstr(sb, temp_sprintf("%d", error_code));
+#define ERROR_NAME sb_append_cstr(sb, error_name);
+#include "error_page.h"
+#undef ERROR_CODE
+#undef ERROR_NAME
+#undef OUT
+
+    fwrite(page.items, 1, page.count, stdout);
+    return ferror(stdout) ? 1 : 0;
+}
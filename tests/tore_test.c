@@ -0,0 +1,1348 @@
+// The tests of tore. Run them with `./nob test`.
+//
+// tore.c is included as a whole, so the tests call its functions directly. The scenarios drive the tore
+// binary given on the command line against a fresh home folder of their own in build/test/,
+// which is left there after the run to look into when a scenario fails.
+//
+// `./nob test bench` measures how fire_off_reminders() catches up on long overdue Reminders instead.
+#define TORE_NO_MAIN
+#include "../src/tore.c"
+#include <inttypes.h>
+
+#define TEST_HOMES_FOLDER "build/test/"
+
+static const char *tore_bin = NULL;
+static const char *test_home = NULL; // absolute path of the home folder of the current scenario
+
+// Deletes the folder with everything inside
+bool remove_tree(const char *path)
+{
+    bool result = true;
+    File_Paths children = {0};
+    int exists = file_exists(path);
+    if (exists <= 0) return_defer(exists == 0);
+    if (get_file_type(path) == FILE_DIRECTORY) {
+        if (!read_entire_dir(path, &children)) return_defer(false);
+        for (size_t i = 0; i < children.count; ++i) {
+            if (strcmp(children.items[i], ".") == 0 || strcmp(children.items[i], "..") == 0) continue;
+            if (!remove_tree(temp_sprintf("%s/%s", path, children.items[i]))) return_defer(false);
+        }
+    }
+    if (remove(path) < 0) {
+        fprintf(stderr, "ERROR: could not delete %s: %s\n", path, strerror(errno));
+        return_defer(false);
+    }
+defer:
+    free(children.items);
+    return result;
+}
+
+// Runs tore in the home folder of the scenario with the input on stdin unless it is NULL. Everything it
+// prints ends up in output. Returns whether tore succeeded, so the scenarios can expect it to fail too.
+bool run_tore_argv(String_Builder *output, const char *input, const char **args)
+{
+    Cmd cmd = {0};
+    const char *input_path = temp_sprintf("%s/input", test_home);
+    const char *output_path = temp_sprintf("%s/output", test_home);
+    output->count = 0;
+
+    Fd fdin = INVALID_FD;
+    if (input) {
+        if (!write_entire_file(input_path, input, strlen(input))) return false;
+        fdin = fd_open_for_read(input_path);
+        if (fdin == INVALID_FD) return false;
+    }
+    if (!write_entire_file(output_path, NULL, 0)) return false;
+    Fd fdout = open(output_path, O_WRONLY | O_APPEND);
+    Fd fderr = open(output_path, O_WRONLY | O_APPEND);
+    assert(fdout >= 0 && fderr >= 0);
+
+    cmd_append(&cmd, tore_bin);
+    for (size_t i = 0; args[i]; ++i) cmd_append(&cmd, args[i]);
+    Nob_Cmd_Redirect redirect = { .fdin = input ? &fdin : NULL, .fdout = &fdout, .fderr = &fderr };
+    // The scenarios report the failures they don't expect themselves
+    Log_Level log_level = minimal_log_level;
+    minimal_log_level = NO_LOGS;
+    bool ok = cmd_run_sync_redirect_and_reset(&cmd, redirect);
+    minimal_log_level = log_level;
+    free(cmd.items);
+
+    if (!read_entire_file(output_path, output)) return false;
+    sb_append_null(output);
+    output->count -= 1;
+    return ok;
+}
+
+#define run_tore(output, ...) run_tore_argv((output), NULL, ((const char*[]) {__VA_ARGS__, NULL}))
+#define run_tore_with_input(output, input, ...) run_tore_argv((output), (input), ((const char*[]) {__VA_ARGS__, NULL}))
+
+// Runs tore and fails the scenario if tore fails
+#define EXPECT_TORE(output, ...)                                                 \
+    do {                                                                         \
+        if (!run_tore((output), __VA_ARGS__)) {                                  \
+            fprintf(stderr, "%s:%d: tore failed:\n%s\n", __FILE__, __LINE__, (output)->items); \
+            return_defer(false);                                                 \
+        }                                                                        \
+    } while (0)
+
+#define EXPECT(cond, ...)                                                        \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: FAILED: %s: ", __FILE__, __LINE__, #cond);   \
+            fprintf(stderr, __VA_ARGS__);                                        \
+            fprintf(stderr, "\n");                                               \
+            return_defer(false);                                                 \
+        }                                                                        \
+    } while (0)
+
+#define EXPECT_OUTPUT(output, needle) \
+    EXPECT(strstr((output)->items, (needle)) != NULL, "`%s` not found in the output of tore:\n%s", (needle), (output)->items)
+
+sqlite3 *open_test_db_at(const char *path)
+{
+    sqlite3 *db = NULL;
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+// The database of the scenario to check what tore left there
+sqlite3 *open_test_db(void)
+{
+    return open_test_db_at(temp_sprintf("%s/"TORE_FILENAME, test_home));
+}
+
+// The first column of the first row of the query as an integer, or -1 if it fails
+int64_t query_int(sqlite3 *db, const char *sql)
+{
+    int64_t result = -1;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(-1);
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(-1);
+    }
+    result = sqlite3_column_int64(stmt, 0);
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    return result;
+}
+
+bool exec_sql_at(const char *path, const char *sql)
+{
+    sqlite3 *db = open_test_db_at(path);
+    if (!db) return false;
+    bool ok = sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK;
+    if (!ok) LOG_SQLITE3_ERROR(db);
+    sqlite3_close(db);
+    return ok;
+}
+
+// Changes the database of the scenario behind the back of tore
+bool exec_test_sql(const char *sql)
+{
+    return exec_sql_at(temp_sprintf("%s/"TORE_FILENAME, test_home), sql);
+}
+
+// The first column of the first row of the query on the database at the path, or -1 if it fails
+int64_t query_int_at(const char *path, const char *sql)
+{
+    sqlite3 *db = open_test_db_at(path);
+    if (!db) return -1;
+    int64_t result = query_int(db, sql);
+    sqlite3_close(db);
+    return result;
+}
+
+// The first column of the first row of the query on the database at the path as text, or NULL if it fails
+const char *query_text_at_temp(const char *path, const char *sql)
+{
+    const char *result = NULL;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3 *db = open_test_db_at(path);
+    if (!db) return NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(NULL);
+    }
+    const char *text = (const char *)sqlite3_column_text(stmt, 0);
+    result = temp_strdup(text ? text : "");
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return result;
+}
+
+// A group of Notifications is titled after its latest active Notification by (created_at, id) whatever order
+// they come and go in, and `tore check` rebuilds NotificationGroups when it does not match Notifications
+bool test_notification_group_title(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+
+    // Creates the database
+    EXPECT_TORE(&output, "checkout");
+    if (!exec_test_sql("INSERT INTO Reminders (id, title, scheduled_at) VALUES (7, 'rent', unixepoch('2090-01-01')/86400);"
+                       "INSERT INTO Notifications (title, created_at, reminder_id) VALUES "
+                       "    ('rent (old)', unixepoch('2026-01-01 10:00:00'), 7),"
+                       "    ('rent (new)', unixepoch('2026-02-01 10:00:00'), 7);"
+                       "INSERT INTO Notifications (title, created_at) VALUES ('standalone', unixepoch('2026-01-15 10:00:00'));")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "[2] rent (new) (2026-02-01 10:00:00)");
+    EXPECT_OUTPUT(&output, "standalone (2026-01-15 10:00:00)");
+
+    // An older Notification arriving later (like from a restored backup) does not take the title over
+    if (!exec_test_sql("INSERT INTO Notifications (id, title, created_at, reminder_id) "
+                       "VALUES (100, 'rent (older)', unixepoch('2025-12-01 10:00:00'), 7)")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "[3] rent (new) (2026-02-01 10:00:00)");
+
+    // Dismissing the latest one leaves the group to the next latest
+    if (!exec_test_sql("UPDATE Notifications SET dismissed_at = unixepoch() WHERE title = 'rent (new)'")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "[2] rent (old) (2026-01-01 10:00:00)");
+
+    if (!exec_test_sql("UPDATE Notifications SET dismissed_at = NULL WHERE title = 'rent (new)'")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "[3] rent (new) (2026-02-01 10:00:00)");
+    EXPECT_TORE(&output, "check");
+    EXPECT_OUTPUT(&output, "NotificationGroups: OK");
+
+    if (!exec_test_sql("UPDATE NotificationGroups SET title = 'bogus', active_count = 42")) return_defer(false);
+    EXPECT_TORE(&output, "check");
+    EXPECT_OUTPUT(&output, "inconsistent rows. Rebuilding...");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "[3] rent (new) (2026-02-01 10:00:00)");
+    EXPECT_TORE(&output, "check");
+    EXPECT_OUTPUT(&output, "NotificationGroups: OK");
+
+defer:
+    free(output.items);
+    return result;
+}
+
+// A single index or an inclusive range of them, and nothing else
+bool test_parse_index_range(void)
+{
+    bool result = true;
+    int begin = -1, end = -1;
+    EXPECT(parse_index_range("7", &begin, &end) && begin == 7 && end == 7, "7 is %d-%d", begin, end);
+    EXPECT(parse_index_range("3-40", &begin, &end) && begin == 3 && end == 40, "3-40 is %d-%d", begin, end);
+    EXPECT(parse_index_range("0-0", &begin, &end) && begin == 0 && end == 0, "0-0 is %d-%d", begin, end);
+    const char *invalid[] = { "5-3", "-1", "3-", "", "x", "3x", "3-40x", "3--40", "99999999999" };
+    for (size_t i = 0; i < ARRAY_LEN(invalid); ++i) {
+        EXPECT(!parse_index_range(invalid[i], &begin, &end), "`%s` is accepted as %d-%d", invalid[i], begin, end);
+    }
+defer:
+    return result;
+}
+
+// `dismiss` takes ranges of indices, skips the arguments that are not indices without dismissing anything
+// for them, and `dismiss --all` dismisses whatever is left
+bool test_dismiss_ranges(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    sqlite3 *db = NULL;
+
+    // Creates the database
+    EXPECT_TORE(&output, "checkout");
+    if (!exec_test_sql("WITH RECURSIVE N (i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM N WHERE i < 45) "
+                       "INSERT INTO Notifications (title, created_at) SELECT 'n' || i, i FROM N")) return_defer(false);
+    db = open_test_db();
+    if (!db) return_defer(false);
+
+    EXPECT_TORE(&output, "dismiss", "3-40");
+    EXPECT_OUTPUT(&output, "Dismissed 38 notifications");
+    // The oldest Notification comes first, so the indices 3-40 are n4 up to n41
+    EXPECT(query_int(db, "SELECT count(*) FROM Notifications WHERE dismissed_at IS NOT NULL AND created_at BETWEEN 4 AND 41") == 38,
+           "not the Notifications at the indices 3-40 were dismissed");
+
+    EXPECT_TORE(&output, "dismiss", "5-3", "-1", "3-");
+    EXPECT_OUTPUT(&output, "WARNING: 5-3 is not a valid index or range of indices");
+    EXPECT_OUTPUT(&output, "WARNING: -1 is not a valid index or range of indices");
+    EXPECT_OUTPUT(&output, "WARNING: 3- is not a valid index or range of indices");
+    EXPECT_OUTPUT(&output, "Dismissed 0 notifications");
+    EXPECT(query_int(db, "SELECT count(*) FROM Notifications WHERE dismissed_at IS NULL") == 7, "the invalid ranges dismissed something");
+
+    EXPECT_TORE(&output, "dismiss", "--all");
+    EXPECT_OUTPUT(&output, "Dismissed 7 notifications");
+    EXPECT(query_int(db, "SELECT count(*) FROM Notifications WHERE dismissed_at IS NULL") == 0, "--all left active Notifications");
+    EXPECT(query_int(db, "SELECT count(*) FROM NotificationGroups") == 0, "--all left groups behind");
+
+defer:
+    if (db) sqlite3_close(db);
+    free(output.items);
+    return result;
+}
+
+// `expand` and `dismiss` find the Notifications of a group by a seek on Notifications_active_group_id, and
+// `tore check` fails once they don't. The same goes for the archiving probe of checkout and its indexes.
+bool test_group_seeks(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    sqlite3 *db = NULL;
+
+    // Creates the database
+    EXPECT_TORE(&output, "checkout");
+    if (!exec_test_sql("INSERT INTO Reminders (id, title, scheduled_at, period_unit, period_length) VALUES (1, 'standup', unixepoch('2090-01-01')/86400, 0, 1);"
+                       "INSERT INTO Notifications (title, created_at, reminder_id) VALUES "
+                       "    ('first',     unixepoch('2026-01-01 10:00:00'), NULL),"
+                       "    ('standup 1', unixepoch('2026-02-01 10:00:00'), 1),"
+                       "    ('standup 2', unixepoch('2026-02-02 10:00:00'), 1),"
+                       "    ('standup 3', unixepoch('2026-02-03 10:00:00'), 1),"
+                       "    ('last',      unixepoch('2026-03-01 10:00:00'), NULL);")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "1: [3] standup 3 (2026-02-03 10:00:00)");
+
+    EXPECT_TORE(&output, "expand", "1");
+    EXPECT_OUTPUT(&output, "standup 1 (2026-02-01 10:00:00)");
+    EXPECT_OUTPUT(&output, "standup 2 (2026-02-02 10:00:00)");
+    EXPECT_OUTPUT(&output, "standup 3 (2026-02-03 10:00:00)");
+    EXPECT(strstr(output.items, "first") == NULL && strstr(output.items, "last") == NULL, "expand shows other groups:\n%s", output.items);
+
+    EXPECT_TORE(&output, "check");
+    EXPECT_OUTPUT(&output, "expand: OK");
+    EXPECT_OUTPUT(&output, "dismiss: OK");
+    EXPECT_OUTPUT(&output, "archive notifications: OK");
+    EXPECT_OUTPUT(&output, "archive reminders: OK");
+
+    EXPECT_TORE(&output, "dismiss", "1");
+    db = open_test_db();
+    if (!db) return_defer(false);
+    EXPECT(query_int(db, "SELECT count(*) FROM Notifications WHERE dismissed_at IS NULL AND reminder_id IS NOT NULL") == 0, "the group is not dismissed");
+    EXPECT(query_int(db, "SELECT count(*) FROM Notifications WHERE dismissed_at IS NULL") == 2, "other groups are dismissed");
+    sqlite3_close(db);
+    db = NULL;
+
+    if (!exec_test_sql("DROP INDEX Notifications_active_group_id; DROP INDEX Notifications_dismissed_at;")) return_defer(false);
+    EXPECT(!run_tore(&output, "check"), "check passes without the indexes:\n%s", output.items);
+    EXPECT_OUTPUT(&output, "expand: does not use Notifications_active_group_id");
+    EXPECT_OUTPUT(&output, "dismiss: does not use Notifications_active_group_id");
+    EXPECT_OUTPUT(&output, "archive notifications: does not use Notifications_dismissed_at");
+    EXPECT_OUTPUT(&output, "archive reminders: OK");
+
+defer:
+    if (db) sqlite3_close(db);
+    free(output.items);
+    return result;
+}
+
+// `tore search` finds the titles by the prefixes of their words among the active, the dismissed and the
+// archived Notifications and the Reminders, and marks what matched
+bool test_search(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+
+    // Creates the database
+    EXPECT_TORE(&output, "checkout");
+    if (!exec_test_sql("INSERT INTO Reminders (title, scheduled_at) VALUES ('rent again', unixepoch('2090-01-01')/86400);"
+                       "INSERT INTO Notifications (title, created_at, dismissed_at) VALUES "
+                       "    ('pay the rent', unixepoch('2025-01-01 10:00:00'), unixepoch('2025-01-02 10:00:00')),"
+                       "    ('Rental car',   unixepoch('2026-09-01 10:00:00'), NULL),"
+                       "    ('dentist',      unixepoch('2026-09-02 10:00:00'), NULL);")) return_defer(false);
+    EXPECT_TORE(&output, "archive", "30");
+    EXPECT_OUTPUT(&output, "Archived 1 notifications");
+
+    EXPECT_TORE(&output, "search", "rent");
+    EXPECT_OUTPUT(&output, "reminder 1: *rent* again");
+    EXPECT_OUTPUT(&output, "notification 1: pay the *rent* (2025-01-01 10:00:00, archived)");
+    EXPECT_OUTPUT(&output, "notification 2: *Rental* car (2026-09-01 10:00:00)");
+    EXPECT(strstr(output.items, "dentist") == NULL, "found too much:\n%s", output.items);
+
+    EXPECT_TORE(&output, "search", "dent*");
+    EXPECT_OUTPUT(&output, "notification 3: *dentist* (2026-09-02 10:00:00)");
+
+    EXPECT_TORE(&output, "search", "zzz");
+    EXPECT_OUTPUT(&output, "Nothing found");
+
+defer:
+    free(output.items);
+    return result;
+}
+
+// Sends the request to serve_request() over a socketpair and collects the whole response. The request is
+// written by a child process, so serve_request() may stop reading it at any point without blocking the test.
+bool serve_test_request(Serve_Context *sc, Tenant_Pool *pool, const char *request, size_t request_size, String_Builder *response)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        fprintf(stderr, "ERROR: could not create a socketpair: %s\n", strerror(errno));
+        return false;
+    }
+    pid_t writer = fork();
+    if (writer < 0) {
+        fprintf(stderr, "ERROR: could not fork: %s\n", strerror(errno));
+        return false;
+    }
+    if (writer == 0) {
+        close(fds[1]);
+        signal(SIGPIPE, SIG_DFL);
+        while (request_size > 0) {
+            ssize_t n = write(fds[0], request, request_size);
+            if (n <= 0) break;
+            request += n;
+            request_size -= n;
+        }
+        _exit(0);
+    }
+
+    serve_request(sc, pool, fds[1]);
+    close(fds[1]);
+    sc_reset(sc);
+    temp_reset();
+
+    response->count = 0;
+    char buffer[4096];
+    ssize_t n = 0;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) sb_append_buf(response, buffer, n);
+    sb_append_null(response);
+    response->count -= 1;
+    close(fds[0]);
+    waitpid(writer, NULL, 0);
+    return true;
+}
+
+// The search page decodes its query and a request of any size is answered without the server holding
+// all of it in memory: the ones over SERVE_MAX_REQUEST_SIZE get the canned 413
+bool test_serve_search_query_size(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    String_Builder request = {0};
+    String_Builder response = {0};
+    Serve_Context sc = {0};
+    Tenant pool_slot = {0};
+    Tenant_Pool pool = { .slots = &pool_slot, .capacity = 1 };
+
+    EXPECT_TORE(&output, "notify", "pay the rent");
+    if (!tenant_open(&pool, &pool_slot, tore_db_path_temp(), sv_from_cstr(SINGLE_TENANT_NAME))) return_defer(false);
+
+    const char *search = "GET /search?q=r%65nt HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (!serve_test_request(&sc, &pool, search, strlen(search), &response)) return_defer(false);
+    EXPECT_OUTPUT(&response, "HTTP/1.0 200");
+    EXPECT_OUTPUT(&response, "rent");
+
+    size_t sizes[] = { 20*1024, 9*1024*1024 };
+    for (size_t i = 0; i < ARRAY_LEN(sizes); ++i) {
+        request.count = 0;
+        sb_append_cstr(&request, "GET /search?q=");
+        while (request.count < sizes[i]) da_append(&request, 'a');
+        sb_append_cstr(&request, " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        if (!serve_test_request(&sc, &pool, request.items, request.count, &response)) return_defer(false);
+        EXPECT(strncmp(response.items, "HTTP/1.0 413", 12) == 0, "a query of %zu bytes got:\n%.*s", sizes[i], 200, response.items);
+        EXPECT(sc.request.capacity <= 2*SERVE_MAX_REQUEST_SIZE, "the server buffered %zu bytes of a query of %zu bytes", sc.request.capacity, sizes[i]);
+    }
+
+    // The server is still fine after that
+    if (!serve_test_request(&sc, &pool, search, strlen(search), &response)) return_defer(false);
+    EXPECT_OUTPUT(&response, "HTTP/1.0 200");
+
+defer:
+    if (pool_slot.db) sqlite3_close(pool_slot.db);
+    free(pool_slot.index_response.items);
+    arena_free(&sc.arena);
+    free(output.items);
+    free(request.items);
+    free(response.items);
+    return result;
+}
+
+// What `tore export` writes `tore import` reads back into the same Reminders and Notifications in either
+// format, and an import that does not make sense leaves nothing behind
+bool test_import_export(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    const char *formats[] = { "jsonl", "csv" };
+    const char *a_db = temp_sprintf("%s/"TORE_FILENAME, test_home);
+    const char *sql =
+        "SELECT (SELECT group_concat(title || ' ' || scheduled_at || ' ' || ifnull(period_unit, '-') || ' ' || period_length || ' ' || period_day || ' ' || lead_days, ', ') FROM (SELECT * FROM Reminders ORDER BY id)) || ' | ' || "
+        "       (SELECT group_concat(title || ' ' || created_at || ' ' || ifnull(dismissed_at, '-'), ', ') FROM (SELECT * FROM Notifications ORDER BY id))";
+
+    EXPECT_TORE(&output, "remind", "rent", "2090-01-31", "1m");
+    EXPECT_TORE(&output, "remind", "tax", "2090-03-01", "1y", "--lead", "5");
+    EXPECT_TORE(&output, "remind", "once", "2090-02-15");
+    EXPECT_TORE(&output, "notify", "hello, \"world\"");
+    EXPECT_TORE(&output, "notify", "gone");
+    EXPECT_TORE(&output, "dismiss", "1");
+    // Clamped to the end of February, but still anchored to the 31st
+    if (!exec_test_sql("UPDATE Reminders SET scheduled_at = unixepoch('2090-02-28')/86400 WHERE title = 'rent'")) return_defer(false);
+    const char *expected = query_text_at_temp(a_db, sql);
+    if (!expected) return_defer(false);
+
+    for (size_t i = 0; i < ARRAY_LEN(formats); ++i) {
+        EXPECT_TORE(&output, "export", formats[i]);
+        const char *exported = temp_strdup(output.items);
+        const char *home = temp_sprintf("%s/%s", test_home, formats[i]);
+        if (!mkdir_if_not_exists(home)) return_defer(false);
+        if (setenv("HOME", home, 1) < 0) return_defer(false);
+        if (!run_tore_with_input(&output, exported, "import", formats[i])) {
+            fprintf(stderr, "%s\n", output.items);
+            return_defer(false);
+        }
+        EXPECT_OUTPUT(&output, "Imported 3 reminders and 2 notifications");
+        const char *imported = query_text_at_temp(temp_sprintf("%s/"TORE_FILENAME, home), sql);
+        EXPECT(imported && strcmp(imported, expected) == 0, "%s: expected %s, got %s", formats[i], expected, imported);
+        if (setenv("HOME", test_home, 1) < 0) return_defer(false);
+    }
+
+    const char *input =
+        "{\"type\":\"reminder\",\"title\":\"fine\",\"scheduled_at\":\"2090-02-28\",\"period\":\"1m\"}\n"
+        "{\"type\":\"reminder\",\"title\":\"off\",\"scheduled_at\":\"2090-02-30\"}\n";
+    EXPECT(!run_tore_with_input(&output, input, "import"), "imported a day that does not exist");
+    EXPECT_OUTPUT(&output, "line 2: scheduled_at is not a valid date");
+    input = "{\"type\":\"reminder\",\"title\":\"often\",\"scheduled_at\":\"2090-02-28\",\"period\":\"1x\"}\n";
+    EXPECT(!run_tore_with_input(&output, input, "import"), "imported an invalid period");
+    EXPECT_OUTPUT(&output, "line 1: invalid period `1x`");
+    input = "{\"type\":\"reminder\",\"title\":\"rent\",\"scheduled_at\":\"2090-02-28\",\"period\":\"1m\",\"period_day\":5}\n";
+    EXPECT(!run_tore_with_input(&output, input, "import"), "imported an anchor that can't produce scheduled_at");
+    EXPECT_OUTPUT(&output, "line 1: period_day `5` does not match scheduled_at");
+    input = "{\"type\":\"reminder\",\"title\":\"early\",\"scheduled_at\":\"2090-02-28\",\"lead_days\":-1}\n";
+    EXPECT(!run_tore_with_input(&output, input, "import"), "imported a negative lead_days");
+    EXPECT_OUTPUT(&output, "line 1: lead_days must be a number of days");
+    EXPECT(query_int_at(a_db, "SELECT count(*) FROM Reminders") == 3, "a failed import left some of its rows behind");
+
+defer:
+    setenv("HOME", test_home, 1);
+    free(output.items);
+    return result;
+}
+
+// The second checkout in a row is served from ~/.tore-checkout-cache, and anything written to the
+// database in between or a different upcoming_days in ~/.torerc makes checkout compute the output again
+bool test_checkout_cache(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    const char *config_path = temp_sprintf("%s/"TORE_CONFIG_FILENAME, test_home);
+    if (setenv("TORE_DEBUG_CHECKOUT_CACHE", "1", 1) < 0) return_defer(false);
+
+    EXPECT_TORE(&output, "notify", "first");
+    if (!exec_test_sql("INSERT INTO Reminders (title, scheduled_at) VALUES ('dentist', unixepoch('now', 'localtime')/86400 + 10)")) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: saved");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: hit");
+    EXPECT_OUTPUT(&output, "0: first (");
+
+    EXPECT_TORE(&output, "notify", "second");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: miss (stale)");
+    EXPECT_OUTPUT(&output, ": second (");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: hit");
+    EXPECT_OUTPUT(&output, ": second (");
+    EXPECT(strstr(output.items, "dentist") == NULL, "the Reminder is shown before it is upcoming:\n%s", output.items);
+
+    const char *config = "upcoming_days = 30\n";
+    if (!write_entire_file(config_path, config, strlen(config))) return_defer(false);
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: miss (stale)");
+    EXPECT_OUTPUT(&output, "Upcoming: dentist (");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "checkout cache: hit");
+    EXPECT_OUTPUT(&output, "Upcoming: dentist (");
+
+defer:
+    remove(config_path);
+    unsetenv("TORE_DEBUG_CHECKOUT_CACHE");
+    free(output.items);
+    return result;
+}
+
+// The calendar lays out the occurrences of the Reminders over the range inclusively and a monthly
+// Reminder keeps to its day of the month through the short months. /calendar lays out the same,
+// and its range of any size is decoded without crashing the server.
+bool test_calendar(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    String_Builder request = {0};
+    String_Builder response = {0};
+    Serve_Context sc = {0};
+    Tenant pool_slot = {0};
+    Tenant_Pool pool = { .slots = &pool_slot, .capacity = 1 };
+
+    EXPECT_TORE(&output, "remind", "rent", "2090-01-31", "1m");
+    EXPECT_TORE(&output, "remind", "standup", "2090-02-01", "1w");
+    EXPECT_TORE(&output, "remind", "once", "2090-02-15");
+
+    EXPECT_TORE(&output, "calendar", "2090-02");
+    EXPECT_OUTPUT(&output, "2090-02-01 .. 2090-02-28\n");
+    EXPECT_OUTPUT(&output, "Wed 2090-02-01\n    standup\n");
+    EXPECT_OUTPUT(&output, "Wed 2090-02-15\n    once\n    standup\n");
+    EXPECT_OUTPUT(&output, "Wed 2090-02-22\n    standup\n");
+    EXPECT_OUTPUT(&output, "Tue 2090-02-28\n    rent\n");
+
+    EXPECT_TORE(&output, "calendar", "2090-03-01", "2090-03-31");
+    EXPECT_OUTPUT(&output, "Fri 2090-03-31\n    rent\n");
+    EXPECT(strstr(output.items, "once") == NULL, "a one-off Reminder came back:\n%s", output.items);
+
+    EXPECT_TORE(&output, "calendar", "2092-02");
+    EXPECT_OUTPUT(&output, "Fri 2092-02-29\n    rent\n");
+
+    EXPECT(!run_tore(&output, "calendar", "bogus"), "calendar accepted bogus");
+    EXPECT_OUTPUT(&output, "invalid range");
+    EXPECT(!run_tore(&output, "calendar", "2090-01-01", "2101-01-01"), "calendar accepted more than MAX_CALENDAR_DAYS");
+    EXPECT_OUTPUT(&output, "invalid range");
+
+    if (!tenant_open(&pool, &pool_slot, tore_db_path_temp(), sv_from_cstr(SINGLE_TENANT_NAME))) return_defer(false);
+    const char *calendar = "GET /calendar?range=2090-03-01+2090-03-31 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (!serve_test_request(&sc, &pool, calendar, strlen(calendar), &response)) return_defer(false);
+    EXPECT_OUTPUT(&response, "HTTP/1.0 200");
+    EXPECT_OUTPUT(&response, "value=\"2090-03-01 2090-03-31\"");
+    EXPECT_OUTPUT(&response, "<li>rent</li>");
+
+    const char *bogus = "GET /calendar?range=bogus HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (!serve_test_request(&sc, &pool, bogus, strlen(bogus), &response)) return_defer(false);
+    EXPECT_OUTPUT(&response, "HTTP/1.0 400");
+
+    sb_append_cstr(&request, "GET /calendar?range=");
+    while (request.count < 64*1024) da_append(&request, '2');
+    sb_append_cstr(&request, " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    if (!serve_test_request(&sc, &pool, request.items, request.count, &response)) return_defer(false);
+    EXPECT(strncmp(response.items, "HTTP/1.0 413", 12) == 0, "a range of %zu bytes got:\n%.*s", request.count, 200, response.items);
+
+    EXPECT_TORE(&output, "forget", "0");
+    EXPECT_TORE(&output, "calendar", "2090-02");
+    EXPECT(strstr(output.items, "once") == NULL, "a forgotten Reminder is still there:\n%s", output.items);
+
+defer:
+    if (pool_slot.db) sqlite3_close(pool_slot.db);
+    free(pool_slot.index_response.items);
+    arena_free(&sc.arena);
+    free(request.items);
+    free(response.items);
+    free(output.items);
+    return result;
+}
+
+// Loads the config from the text into the global config of tore.c starting from the defaults. What
+// load_config() complains about ends up in errors.
+bool load_config_from(const char *text, String_Builder *errors)
+{
+    static Config defaults = {0};
+    static bool defaults_saved = false;
+    if (!defaults_saved) {
+        defaults = config;
+        defaults_saved = true;
+    }
+    free((char *)config.database_path);
+    config = defaults;
+
+    const char *errors_path = temp_sprintf("%s/errors", test_home);
+    if (!write_entire_file(temp_sprintf("%s/"TORE_CONFIG_FILENAME, test_home), text, strlen(text))) return false;
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    int fd = open(errors_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(saved_stderr >= 0 && fd >= 0);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    bool ok = load_config();
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+
+    errors->count = 0;
+    if (!read_entire_file(errors_path, errors)) return false;
+    sb_append_null(errors);
+    errors->count -= 1;
+    return ok;
+}
+
+// ~/.torerc sets the global keys and the profiles of its sections, and every mistake in it is an error
+// that names the line
+bool test_config(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    const char *text =
+        "# comment\n"
+        "; also a comment\n"
+        "database = ~/other.tore\n"
+        "catch_up = Coalesce\n"
+        "\n"
+        "[cli]\n"
+        "synchronous = normal\n"
+        "cache_size = -2000\n"
+        "[ serve ]\n"
+        "port = 7000\n"
+        "temp_store = 1\n"
+        "mmap_size = 0\n";
+    EXPECT(load_config_from(text, &output), "the config is rejected:\n%s", output.items);
+    EXPECT(strcmp(config.database_path, temp_sprintf("%s/other.tore", test_home)) == 0, "database = %s", config.database_path);
+    EXPECT(config.catch_up == CATCH_UP_COALESCE, "catch_up = %d", config.catch_up);
+    EXPECT(config.profiles[PROFILE_CLI].synchronous == 1, "[cli] synchronous = %d", config.profiles[PROFILE_CLI].synchronous);
+    EXPECT(config.profiles[PROFILE_CLI].cache_size == -2000, "[cli] cache_size = %"PRIi64, config.profiles[PROFILE_CLI].cache_size);
+    EXPECT(config.profiles[PROFILE_CLI].temp_store == 2, "[cli] temp_store = %d", config.profiles[PROFILE_CLI].temp_store);
+    EXPECT(config.serve_port == 7000, "[serve] port = %d", config.serve_port);
+    EXPECT(config.profiles[PROFILE_SERVE].temp_store == 1, "[serve] temp_store = %d", config.profiles[PROFILE_SERVE].temp_store);
+    EXPECT(config.profiles[PROFILE_SERVE].mmap_size == 0, "[serve] mmap_size = %"PRIi64, config.profiles[PROFILE_SERVE].mmap_size);
+
+    struct { const char *text, *error; } invalid[] = {
+        { "[nope]\n",                      ":1: ERROR: unknown section `nope`" },
+        { "\n[cli\n",                      ":2: ERROR: unclosed section name" },
+        { "[cli]\ntemp_store = 3\n",       ":2: ERROR: invalid value `3` of `temp_store`" },
+        { "catch_up = later\n",            ":1: ERROR: invalid value `later` of `catch_up`" },
+        { "database\n",                    ":1: ERROR: expected `key = value`" },
+        { "port = 7000\n",                 ":1: ERROR: unknown key `port`" },
+        { "[serve]\nport = 70000\n",       ":2: ERROR: invalid value `70000` of `port`" },
+        { "[cli]\ncache_size = 0\n",       ":2: ERROR: invalid value `0` of `cache_size`" },
+        { "[cli]\nsynchronous = often\n",  ":2: ERROR: invalid value `often` of `synchronous`" },
+        { "[cli]\nbacklog = 16\n",         ":2: ERROR: unknown key `backlog`" },
+    };
+    for (size_t i = 0; i < ARRAY_LEN(invalid); ++i) {
+        EXPECT(!load_config_from(invalid[i].text, &output), "accepted %s", invalid[i].text);
+        EXPECT_OUTPUT(&output, invalid[i].error);
+    }
+
+    // tore itself follows the database key and refuses to run with a broken config
+    const char *config_path = temp_sprintf("%s/"TORE_CONFIG_FILENAME, test_home);
+    text = "database = ~/other.tore\n";
+    if (!write_entire_file(config_path, text, strlen(text))) return_defer(false);
+    EXPECT_TORE(&output, "remind", "dentist", "2090-01-01");
+    EXPECT(file_exists(temp_sprintf("%s/other.tore", test_home)) == 1, "no ~/other.tore");
+    EXPECT(file_exists(temp_sprintf("%s/"TORE_FILENAME, test_home)) == 0, "~/"TORE_FILENAME" is created anyway");
+    text = "database = ~/other.tore\ncatch_up = coalesce\n";
+    if (!write_entire_file(config_path, text, strlen(text))) return_defer(false);
+    EXPECT_TORE(&output, "remind", "water", render_date_temp(today_local_days() - 3), "1d");
+    EXPECT_TORE(&output, "checkout");
+    EXPECT_OUTPUT(&output, "0: [4] water (");
+    text = "[serve]\nbacklog = many\n";
+    if (!write_entire_file(config_path, text, strlen(text))) return_defer(false);
+    EXPECT(!run_tore(&output, "checkout"), "tore runs with a broken config");
+    EXPECT_OUTPUT(&output, ":2: ERROR: invalid value `many` of `backlog`");
+
+defer:
+    load_config_from("", &output);
+    free(output.items);
+    return result;
+}
+
+// The names of the tenants can't escape their folder, requesting a tenant that does not exist creates
+// nothing, and the pool closes the least recently used and the idle tenants
+bool test_tenant_pool(void)
+{
+    bool result = true;
+    const char *dir = temp_sprintf("%s/tenants", test_home);
+    const char *names[] = { "alice", "bob", "carol" };
+    Tenant_Pool pool = { .dir = dir, .capacity = 2 };
+    pool.slots = calloc(pool.capacity, sizeof(*pool.slots));
+    assert(pool.slots != NULL && "Buy more RAM lol");
+
+    const char *valid[] = { "alice", "bob.smith", "a-b_c" };
+    for (size_t i = 0; i < ARRAY_LEN(valid); ++i) {
+        EXPECT(tenant_name_valid(sv_from_cstr(valid[i])), "`%s` is rejected", valid[i]);
+    }
+    const char *invalid[] = { "", ".", "..", ".x", "a/b", "../alice", "a b", "a\\b",
+                              "a2345678901234567890123456789012345678901234567890123456789012345" };
+    for (size_t i = 0; i < ARRAY_LEN(invalid); ++i) {
+        EXPECT(!tenant_name_valid(sv_from_cstr(invalid[i])), "`%s` is accepted", invalid[i]);
+    }
+
+    if (!mkdir_if_not_exists(dir)) return_defer(false);
+    for (size_t i = 0; i < ARRAY_LEN(names); ++i) {
+        const char *home = temp_sprintf("%s/%s", dir, names[i]);
+        if (!mkdir_if_not_exists(home)) return_defer(false);
+        sqlite3 *db = open_tore_db_at(temp_sprintf("%s/"TORE_FILENAME, home));
+        if (db == NULL) return_defer(false);
+        sqlite3_close(db);
+    }
+
+    bool failed = true;
+    const char *unknown[] = { "nobody", "..", ".x" };
+    for (size_t i = 0; i < ARRAY_LEN(unknown); ++i) {
+        EXPECT(tenant_acquire(&pool, sv_from_cstr(unknown[i]), &failed) == NULL, "`%s` is served", unknown[i]);
+        EXPECT(!failed, "`%s` is reported as a failure instead of an unknown tenant", unknown[i]);
+    }
+    EXPECT(file_exists(temp_sprintf("%s/nobody", dir)) == 0, "requesting an unknown tenant created its folder");
+    EXPECT(file_exists(temp_sprintf("%s/.x", dir)) == 0, "requesting `.x` created a file");
+
+    Tenant *alice = tenant_acquire(&pool, sv_from_cstr("alice"), &failed);
+    Tenant *bob = tenant_acquire(&pool, sv_from_cstr("bob"), &failed);
+    EXPECT(alice && bob && alice != bob, "alice and bob don't get their own slots");
+    EXPECT(tenant_acquire(&pool, sv_from_cstr("alice"), &failed) == alice, "alice is not reused");
+    EXPECT(pool.metrics.opens == 2, "%zu opens of 2 tenants", pool.metrics.opens);
+
+    // bob is the least recently used one now
+    Tenant *carol = tenant_acquire(&pool, sv_from_cstr("carol"), &failed);
+    EXPECT(carol == bob && strcmp(carol->name, "carol") == 0, "carol does not replace bob");
+    EXPECT(strcmp(alice->name, "alice") == 0 && alice->db != NULL, "alice is evicted instead of bob");
+    EXPECT(pool.metrics.evictions == 1, "%zu evictions", pool.metrics.evictions);
+
+    time_t now = time(NULL);
+    tenant_pool_close_idle(&pool, now);
+    EXPECT(alice->db != NULL && carol->db != NULL, "the tenants are closed before they are idle");
+    tenant_pool_close_idle(&pool, now + config.serve_tenant_idle_timeout);
+    EXPECT(alice->db == NULL && carol->db == NULL, "the idle tenants are still open");
+    EXPECT(pool.metrics.evictions == 3, "%zu evictions", pool.metrics.evictions);
+
+defer:
+    for (size_t i = 0; i < pool.capacity; ++i) {
+        if (pool.slots[i].db) sqlite3_close(pool.slots[i].db);
+        free(pool.slots[i].index_response.items);
+    }
+    free(pool.slots);
+    return result;
+}
+
+// Places the changeset of an INSERT into a Notifications table of an older layout into all the changes of
+// the file of `tore sync` and makes it look written by a tore of before SYNC_FORMAT
+bool fake_sync_bundle_of_old_layout(const char *bundle_path)
+{
+    bool result = true;
+    sqlite3 *old = NULL;
+    sqlite3 *bundle = NULL;
+    sqlite3_session *session = NULL;
+    sqlite3_stmt *stmt = NULL;
+    void *changeset = NULL;
+    int size = 0;
+
+    if (sqlite3_open(":memory:", &old) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(old);
+        return_defer(false);
+    }
+    if (sqlite3_exec(old, "CREATE TABLE Notifications (id INTEGER PRIMARY KEY, title TEXT NOT NULL)", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(old);
+        return_defer(false);
+    }
+    if (sqlite3session_create(old, "main", &session) != SQLITE_OK || sqlite3session_attach(session, "Notifications") != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(old);
+        return_defer(false);
+    }
+    if (sqlite3_exec(old, "INSERT INTO Notifications (id, title) VALUES (1000, 'from the past')", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(old);
+        return_defer(false);
+    }
+    if (sqlite3session_changeset(session, &size, &changeset) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(old);
+        return_defer(false);
+    }
+
+    bundle = open_test_db_at(bundle_path);
+    if (!bundle) return_defer(false);
+    if (sqlite3_exec(bundle, "PRAGMA user_version = 0", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(bundle);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(bundle, "UPDATE Changesets SET changeset = ?1", -1, &stmt, NULL) != SQLITE_OK ||
+        sqlite3_bind_blob(stmt, 1, changeset, size, NULL) != SQLITE_OK ||
+        sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG_SQLITE3_ERROR(bundle);
+        return_defer(false);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (bundle) sqlite3_close(bundle);
+    sqlite3_free(changeset);
+    if (session) sqlite3session_delete(session);
+    if (old) sqlite3_close(old);
+    return result;
+}
+
+// Two databases exchange their changes through a folder with `tore sync`: the new rows of both sides, a dismiss,
+// and the files of an older format. A file of a newer format and the changes recorded with an older layout of
+// the tables are refused instead of being applied wrong.
+bool test_sync_round_trip(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    const char *a = temp_sprintf("%s/a", test_home);
+    const char *b = temp_sprintf("%s/b", test_home);
+    const char *dir = temp_sprintf("%s/sync", test_home);
+    const char *a_db = temp_sprintf("%s/"TORE_FILENAME, a);
+    const char *b_db = temp_sprintf("%s/"TORE_FILENAME, b);
+    if (!mkdir_if_not_exists(a) || !mkdir_if_not_exists(b) || !mkdir_if_not_exists(dir)) return_defer(false);
+
+#define AT(home) if (setenv("HOME", (home), 1) < 0) return_defer(false)
+    AT(a); EXPECT_TORE(&output, "sync", "init");
+    AT(b); EXPECT_TORE(&output, "sync", "init");
+    int64_t a_site = query_int_at(a_db, "SELECT site FROM SyncSite");
+    const char *a_bundle = temp_sprintf("%s/%"PRIi64 SYNC_BUNDLE_EXTENSION, dir, a_site);
+
+    AT(a);
+    EXPECT_TORE(&output, "remind", "dentist", "2090-01-01");
+    EXPECT_TORE(&output, "notify", "from a");
+    EXPECT_TORE(&output, "sync", dir);
+    EXPECT_OUTPUT(&output, "2 changes are kept for the peers");
+
+    if (!exec_sql_at(a_bundle, temp_sprintf("PRAGMA user_version = %d", SYNC_FORMAT + 1))) return_defer(false);
+    AT(b);
+    EXPECT(!run_tore(&output, "sync", dir), "applied a file of a newer format");
+    EXPECT_OUTPUT(&output, "written by a newer tore");
+    EXPECT(query_int_at(b_db, "SELECT count(*) FROM Notifications") == 0, "applied some of a file of a newer format");
+
+    // The files of before SYNC_FORMAT are fine as long as their changes have the current layout
+    if (!exec_sql_at(a_bundle, "PRAGMA user_version = 0")) return_defer(false);
+    EXPECT_TORE(&output, "sync", dir);
+    EXPECT_OUTPUT(&output, "Applied 2 changes from 1 databases");
+    EXPECT(query_int_at(b_db, "SELECT count(*) FROM Reminders WHERE title = 'dentist'") == 1, "no Reminder from a");
+    EXPECT(query_int_at(b_db, "SELECT count(*) FROM Notifications WHERE title = 'from a'") == 1, "no Notification from a");
+
+    EXPECT_TORE(&output, "dismiss", "0");
+    EXPECT_TORE(&output, "notify", "from b");
+    EXPECT_TORE(&output, "sync", dir);
+    AT(a);
+    EXPECT_TORE(&output, "notify", "also from a");
+    EXPECT_TORE(&output, "sync", dir);
+    EXPECT(query_int_at(a_db, "SELECT dismissed_at IS NOT NULL FROM Notifications WHERE title = 'from a'") == 1, "the dismiss is lost");
+    EXPECT(query_int_at(a_db, "SELECT count(*) FROM Notifications WHERE title = 'from b'") == 1, "no Notification from b");
+    AT(b);
+    EXPECT_TORE(&output, "sync", dir);
+    EXPECT(query_int_at(b_db, "SELECT count(*) FROM Notifications") == 3, "the Notifications of both sides are not all there");
+    const char *sql = "SELECT group_concat(id || ' ' || title || ' ' || (dismissed_at IS NULL), ', ') FROM (SELECT * FROM Notifications ORDER BY id)";
+    const char *a_notifications = query_text_at_temp(a_db, sql);
+    const char *b_notifications = query_text_at_temp(b_db, sql);
+    EXPECT(a_notifications && b_notifications && strcmp(a_notifications, b_notifications) == 0, "the sides differ: %s vs %s", a_notifications, b_notifications);
+
+    AT(a);
+    EXPECT_TORE(&output, "notify", "recorded with an older layout");
+    EXPECT_TORE(&output, "sync", dir);
+    if (!fake_sync_bundle_of_old_layout(a_bundle)) return_defer(false);
+    AT(b);
+    EXPECT(!run_tore(&output, "sync", dir), "applied the changes of an older layout");
+    EXPECT_OUTPUT(&output, "was recorded with an older layout of the tables");
+    EXPECT(query_int_at(b_db, "SELECT count(*) FROM Notifications") == 3, "applied some of the changes of an older layout");
+#undef AT
+
+defer:
+    setenv("HOME", test_home, 1);
+    free(output.items);
+    return result;
+}
+
+// `tore backup` copies the database and its archive a few pages at a time into snapshots that have all the same
+// rows, gzips them with --compress and leaves nothing behind when it fails
+bool test_backup(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    String_Builder input = {0};
+    Cmd cmd = {0};
+    File_Paths children = {0};
+    const char *db_path = temp_sprintf("%s/"TORE_FILENAME, test_home);
+    const char *backup_path = temp_sprintf("%s/backup.db", test_home);
+    const char *compressed_path = temp_sprintf("%s/backup.db.gz", test_home);
+    const char *decompressed_path = temp_sprintf("%s/decompressed.db", test_home);
+
+    // Enough rows for the backup to take many steps of a page
+    for (size_t i = 0; i < 2000; ++i) {
+        sb_append_cstr(&input, temp_sprintf("{\"type\":\"notification\",\"title\":\"backup me #%zu\",\"created_at\":%zu}\n", i, 1700000000 + i*60));
+    }
+    sb_append_null(&input);
+    // Creates the database. The newest row is never archived, so the one for the archive comes first
+    EXPECT_TORE(&output, "checkout");
+    if (!exec_test_sql("INSERT INTO Notifications (title, created_at, dismissed_at) VALUES "
+                       "    ('archive me', unixepoch('2025-01-01 10:00:00'), unixepoch('2025-01-02 10:00:00'))")) return_defer(false);
+    if (!run_tore_with_input(&output, input.items, "import")) {
+        fprintf(stderr, "%s\n", output.items);
+        return_defer(false);
+    }
+    EXPECT_TORE(&output, "archive", "30");
+    EXPECT_OUTPUT(&output, "Archived 1 notifications");
+
+    EXPECT_TORE(&output, "backup", backup_path, "--step", "1", "--pause", "0");
+    EXPECT(query_int_at(temp_sprintf("%s"TORE_ARCHIVE_SUFFIX, backup_path), "SELECT count(*) FROM Notifications WHERE title = 'archive me'") == 1,
+           "the archive is not backed up");
+    const char *sql = "SELECT count(*) || ' ' || sum(created_at) || ' ' || group_concat(title, '') FROM Notifications";
+    const char *expected = query_text_at_temp(db_path, sql);
+    const char *actual = query_text_at_temp(backup_path, sql);
+    EXPECT(expected && actual && strcmp(expected, actual) == 0, "the backup differs from the database");
+    actual = query_text_at_temp(backup_path, "PRAGMA integrity_check");
+    EXPECT(actual && strcmp(actual, "ok") == 0, "the backup is broken: %s", actual);
+
+    EXPECT_TORE(&output, "backup", compressed_path, "--compress");
+    cmd_append(&cmd, "gzip", "-t", compressed_path);
+    EXPECT(cmd_run_sync_and_reset(&cmd), "the compressed backup is broken");
+    Fd fdout = fd_open_for_write(decompressed_path);
+    if (fdout == INVALID_FD) return_defer(false);
+    cmd_append(&cmd, "gzip", "-dc", compressed_path);
+    EXPECT(cmd_run_sync_redirect_and_reset(&cmd, (Nob_Cmd_Redirect) {.fdout = &fdout}), "could not decompress the backup");
+    actual = query_text_at_temp(decompressed_path, sql);
+    EXPECT(expected && actual && strcmp(expected, actual) == 0, "the compressed backup differs from the database");
+    cmd_append(&cmd, "gzip", "-t", temp_sprintf("%s"TORE_ARCHIVE_SUFFIX, compressed_path));
+    EXPECT(cmd_run_sync_and_reset(&cmd), "the compressed backup of the archive is broken");
+
+    // No gzip to be found
+    const char *path = temp_strdup(getenv("PATH"));
+    const char *no_gzip_path = temp_sprintf("%s/no-gzip.db.gz", test_home);
+    if (setenv("PATH", test_home, 1) < 0) return_defer(false);
+    bool compressed = run_tore(&output, "backup", no_gzip_path, "--compress");
+    if (setenv("PATH", path, 1) < 0) return_defer(false);
+    EXPECT(!compressed, "compressed without gzip");
+    EXPECT_OUTPUT(&output, "--compress needs gzip");
+    EXPECT(file_exists(no_gzip_path) == 0, "left %s behind without gzip", no_gzip_path);
+
+    const char *nowhere = temp_sprintf("%s/nowhere/backup.db", test_home);
+    EXPECT(!run_tore(&output, "backup", nowhere), "backed up into a folder that does not exist");
+    EXPECT(!run_tore(&output, "backup", backup_path, "--step", "0"), "backed up with steps of 0 pages");
+    EXPECT(!run_tore(&output, "backup"), "backed up into nowhere");
+    if (!read_entire_dir(test_home, &children)) return_defer(false);
+    for (size_t i = 0; i < children.count; ++i) {
+        EXPECT(strstr(children.items[i], ".tmp") == NULL, "left %s behind", children.items[i]);
+    }
+
+defer:
+    free(children.items);
+    free(cmd.items);
+    free(input.items);
+    free(output.items);
+    return result;
+}
+
+// period_advance() against the date arithmetic of SQLite from every day of the ranges below, with every anchor
+// the day may have and the lengths of up to 2 years. The ranges cover the dates before the Unix Epoch, the
+// leap years and both kinds of centuries (2000 is a leap year, 2100 is not). SQLite does not clamp the ends
+// of the months (it rolls 2024-01-31 +1 month over to 2024-03-02), so the expected date is the anchor day
+// counted from the start of the target month and capped by its last day. Where the anchor is the day itself
+// and the target month has it, it must also be what date() with the very same modifier says.
+bool test_period_advance_matches_sqlite(void)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    size_t checked = 0;
+
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    const char *sql =
+        "SELECT unixepoch(?1*86400, 'unixepoch', ?2)/86400, "
+        "       min(unixepoch(?1*86400, 'unixepoch', 'start of month', ?2, '+'||(?3 - 1)||' days'), "
+        "           unixepoch(?1*86400, 'unixepoch', 'start of month', ?2, '+1 months', '-1 days'))/86400";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    struct { int64_t from, to; } years[] = { {1968, 1971}, {1999, 2005}, {2095, 2105} };
+    struct { Period unit; int64_t lengths[24]; } periods[] = {
+        { PERIOD_DAY,   {1, 2, 3, 28, 29, 30, 31, 365, 366} },
+        { PERIOD_WEEK,  {1, 2, 4, 52} },
+        { PERIOD_MONTH, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24} },
+        { PERIOD_YEAR,  {1, 2, 3, 4, 5} },
+    };
+    static_assert(COUNT_PERIODS == 4, "Amount of periods has changed");
+
+    for (size_t r = 0; r < ARRAY_LEN(years); ++r) {
+        int64_t to = days_from_civil(years[r].to, 12, 31);
+        for (int64_t days = days_from_civil(years[r].from, 1, 1); days <= to; ++days) {
+            int64_t year;
+            unsigned month, day;
+            civil_from_days(days, &year, &month, &day);
+            // A date clamped to the end of its month may be anchored to any later day
+            unsigned last = days_in_month(year, month);
+            unsigned anchor_to = day == last ? 31 : day;
+            for (unsigned anchor = day; anchor <= anchor_to; ++anchor) {
+                for (size_t p = 0; p < ARRAY_LEN(periods); ++p) {
+                    Period unit = periods[p].unit;
+                    if (unit != PERIOD_MONTH && unit != PERIOD_YEAR && anchor != day) continue;
+                    for (size_t l = 0; l < ARRAY_LEN(periods[p].lengths) && periods[p].lengths[l] > 0; ++l) {
+                        int64_t length = periods[p].lengths[l];
+                        const char *modifier = unit == PERIOD_WEEK
+                            ? temp_sprintf("+%"PRIi64" days", length*7)
+                            : temp_sprintf("+%"PRIi64" %s", length, tore_period_modifiers[unit].name);
+                        sqlite3_reset(stmt);
+                        if (sqlite3_bind_int64(stmt, 1, days) != SQLITE_OK ||
+                            sqlite3_bind_text(stmt, 2, modifier, -1, NULL) != SQLITE_OK ||
+                            sqlite3_bind_int(stmt, 3, anchor) != SQLITE_OK ||
+                            sqlite3_step(stmt) != SQLITE_ROW) {
+                            LOG_SQLITE3_ERROR(db);
+                            return_defer(false);
+                        }
+                        int64_t sqlite_date = sqlite3_column_int64(stmt, 0);
+                        int64_t clamped = sqlite3_column_int64(stmt, 1);
+
+                        int64_t actual = period_advance(days, unit, length, anchor);
+                        int64_t expected = unit == PERIOD_MONTH || unit == PERIOD_YEAR ? clamped : sqlite_date;
+                        EXPECT(actual == expected, "%s %s anchored to %u: expected %s, got %s",
+                               render_date_temp(days), modifier, anchor, render_date_temp(expected), render_date_temp(actual));
+                        unsigned actual_day;
+                        civil_from_days(actual, &year, &month, &actual_day);
+                        if (anchor == day && actual_day == day) {
+                            EXPECT(actual == sqlite_date, "%s %s: date() says %s, got %s",
+                                   render_date_temp(days), modifier, render_date_temp(sqlite_date), render_date_temp(actual));
+                        }
+                        checked += 1;
+                        temp_reset();
+                    }
+                }
+            }
+        }
+    }
+    printf("    %zu dates checked\n", checked);
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (db) sqlite3_close(db);
+    return result;
+}
+
+// The periods stored as text never clamped anything (SQLite rolls the end of a month over into the next one),
+// so the day of scheduled_at is all the anchor there is to carry over into period_day. A Reminder made on the
+// 31st drifted to the 2nd or 3rd after its first February and stays anchored there.
+bool test_period_migration(void)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    const char *path = temp_sprintf("%s/"TORE_FILENAME, test_home);
+
+    size_t period_migration = 0;
+    while (period_migration < ARRAY_LEN(migrations) && strcmp(migrations[period_migration], PERIOD_MIGRATION_SQL) != 0) {
+        period_migration += 1;
+    }
+    EXPECT(period_migration < ARRAY_LEN(migrations), "no PERIOD_MIGRATION_SQL among the migrations");
+
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (!create_schema(db, path, migrations, period_migration)) return_defer(false);
+    const char *sql = temp_sprintf(
+        "INSERT INTO Reminders (id, title, created_at, scheduled_at, period) VALUES "
+        "(1, 'rent', 0, %"PRIi64", '+1 months'), "
+        "(2, 'drifted', 0, %"PRIi64", '+1 months'), "
+        "(3, 'birthday', 0, %"PRIi64", '+1 years'), "
+        "(4, 'standup', 0, %"PRIi64", '+14 days'), "
+        "(5, 'once', 0, %"PRIi64", NULL)",
+        days_from_civil(2031, 1, 31), days_from_civil(2031, 3, 3), days_from_civil(2032, 2, 29),
+        days_from_civil(2031, 1, 5), days_from_civil(2031, 1, 5));
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (!create_schema(db, path, migrations, ARRAY_LEN(migrations))) return_defer(false);
+
+    int64_t expected[][3] = {
+        // id, period_unit, period_day
+        {1, PERIOD_MONTH, 31},
+        {2, PERIOD_MONTH, 3},
+        {3, PERIOD_YEAR,  29},
+        {4, PERIOD_DAY,   5},
+    };
+    for (size_t i = 0; i < ARRAY_LEN(expected); ++i) {
+        int64_t unit = query_int(db, temp_sprintf("SELECT period_unit FROM Reminders WHERE id = %"PRIi64, expected[i][0]));
+        int64_t day = query_int(db, temp_sprintf("SELECT period_day FROM Reminders WHERE id = %"PRIi64, expected[i][0]));
+        EXPECT(unit == expected[i][1] && day == expected[i][2], "Reminder %"PRIi64": expected unit %"PRIi64" day %"PRIi64", got %"PRIi64" %"PRIi64,
+               expected[i][0], expected[i][1], expected[i][2], unit, day);
+    }
+    EXPECT(query_int(db, "SELECT period_unit IS NULL AND period_day = 0 FROM Reminders WHERE id = 5") == 1, "a one-off Reminder got a period");
+
+defer:
+    if (db) sqlite3_close(db);
+    return result;
+}
+
+// A monthly Reminder anchored to the 31st missed since 2024 fires off all its occurrences at once and is
+// rescheduled to the 31st or the end of the month after today, not to the day a February clamped it to.
+bool test_monthly_reminder_catches_up(void)
+{
+    bool result = true;
+    String_Builder output = {0};
+    sqlite3 *db = NULL;
+
+    EXPECT_TORE(&output, "remind", "rent", "2024-01-31", "1m");
+    EXPECT_TORE(&output, "checkout");
+
+    int64_t today = today_local_days();
+    int64_t occurrences = 0;
+    int64_t next = days_from_civil(2024, 1, 31);
+    for (; next <= today; next = period_advance(next, PERIOD_MONTH, 1, 31)) occurrences += 1;
+
+    db = open_test_db();
+    if (!db) return_defer(false);
+    int64_t scheduled_at = query_int(db, "SELECT scheduled_at FROM Reminders");
+    EXPECT(scheduled_at == next, "expected the Reminder at %s, got %s", render_date_temp(next), render_date_temp(scheduled_at));
+    EXPECT(query_int(db, "SELECT period_day FROM Reminders") == 31, "the anchor is lost");
+    int64_t fired = query_int(db, "SELECT sum(occurrences) FROM Notifications WHERE reminder_id IS NOT NULL");
+    EXPECT(fired == occurrences, "expected %"PRIi64" occurrences, got %"PRIi64, occurrences, fired);
+
+defer:
+    if (db) sqlite3_close(db);
+    free(output.items);
+    return result;
+}
+
+typedef struct {
+    const char *name;
+    bool (*run)(void);
+} Test;
+
+Test tests[] = {
+    { "notification group title",      test_notification_group_title },
+    { "parse_index_range",             test_parse_index_range },
+    { "dismiss ranges",                test_dismiss_ranges },
+    { "group seeks",                   test_group_seeks },
+    { "search",                        test_search },
+    { "serve search query size",       test_serve_search_query_size },
+    { "import export",                 test_import_export },
+    { "checkout cache",                test_checkout_cache },
+    { "config",                        test_config },
+    { "tenant pool",                   test_tenant_pool },
+    { "sync round trip",               test_sync_round_trip },
+    { "backup",                        test_backup },
+    { "calendar",                      test_calendar },
+    { "period_advance matches SQLite", test_period_advance_matches_sqlite },
+    { "period migration",              test_period_migration },
+    { "monthly reminder catches up",   test_monthly_reminder_catches_up },
+};
+
+double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// fire_off_reminders() catching up on thousands of Reminders nobody checked out for a long time in either
+// mode. Every mode starts from the same database, because its changes are rolled back.
+bool bench_catch_up(void)
+{
+    bool result = true;
+    sqlite3 *db = open_tore_db();
+    if (!db) return false;
+
+    const char *sql =
+        "WITH RECURSIVE N (i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM N WHERE i < 3000)\n"
+        "INSERT INTO Reminders (title, scheduled_at, period_unit, period_length, period_day)\n"
+        "SELECT 'daily ' || i, unixepoch('now', '-1 year')/86400, 0, 1, 0 FROM N WHERE i <= 2000\n"
+        "UNION ALL\n"
+        "SELECT 'monthly ' || i, unixepoch('now', '-5 years')/86400, 2, 1, CAST(strftime('%d', 'now', '-5 years') AS INTEGER) FROM N WHERE i > 2000";
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    printf("2000 daily Reminders 1 year overdue, 1000 monthly Reminders 5 years overdue\n");
+
+    struct { const char *name; Catch_Up_Mode mode; } modes[] = {
+        { "each",     CATCH_UP_EACH },
+        { "coalesce", CATCH_UP_COALESCE },
+    };
+    for (size_t i = 0; i < ARRAY_LEN(modes); ++i) {
+        if (!txn_begin(db)) return_defer(false);
+        double start = now_secs();
+        bool ok = fire_off_reminders(db, modes[i].mode, today_local_days());
+        double elapsed = now_secs() - start;
+        int64_t notifications = query_int(db, "SELECT count(*) FROM Notifications");
+        if (sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL) != SQLITE_OK) {
+            LOG_SQLITE3_ERROR(db);
+            return_defer(false);
+        }
+        if (!ok) return_defer(false);
+        printf("  %-8s %9.1fms %8"PRIi64" Notifications\n", modes[i].name, elapsed*1000, notifications);
+    }
+
+defer:
+    sqlite3_close(db);
+    return result;
+}
+
+// The date stepping of fire_off_reminders() and the calendar against the date() of SQLite that it replaced
+// on the same dates and periods
+bool bench_period_advance(void)
+{
+    bool result = true;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    const size_t steps = 1000*1000;
+    const char *modifiers[] = { "+1 days", "+14 days", "+1 months", "+3 months", "+1 years" };
+    Period units[]          = { PERIOD_DAY, PERIOD_DAY, PERIOD_MONTH, PERIOD_MONTH, PERIOD_YEAR };
+    int64_t lengths[]       = { 1, 14, 1, 3, 1 };
+    int64_t start = days_from_civil(2024, 1, 31);
+
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+    if (sqlite3_prepare_v2(db, "SELECT unixepoch(?1*86400, 'unixepoch', ?2)/86400", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG_SQLITE3_ERROR(db);
+        return_defer(false);
+    }
+
+    printf("%-12s%16s%16s\n", "", "period_advance", "SQLite date()");
+    for (size_t m = 0; m < ARRAY_LEN(modifiers); ++m) {
+        // Every step starts from the next day, so neither side can get away with the same answer
+        volatile int64_t sink = 0;
+        double started_at = now_secs();
+        for (size_t i = 0; i < steps; ++i) sink += period_advance(start + (int64_t)(i%4096), units[m], lengths[m], 0);
+        double native = now_secs() - started_at;
+
+        started_at = now_secs();
+        for (size_t i = 0; i < steps; ++i) {
+            sqlite3_reset(stmt);
+            if (sqlite3_bind_int64(stmt, 1, start + (int64_t)(i%4096)) != SQLITE_OK ||
+                sqlite3_bind_text(stmt, 2, modifiers[m], -1, NULL) != SQLITE_OK ||
+                sqlite3_step(stmt) != SQLITE_ROW) {
+                LOG_SQLITE3_ERROR(db);
+                return_defer(false);
+            }
+            sink += sqlite3_column_int64(stmt, 0);
+        }
+        double sqlite = now_secs() - started_at;
+        printf("%-12s%13.1fns%13.1fns\n", modifiers[m], native/steps*1e9, sqlite/steps*1e9);
+    }
+
+defer:
+    if (stmt) sqlite3_finalize(stmt);
+    if (db) sqlite3_close(db);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const char *program_name = shift(argv, argc);
+    if (argc <= 0) {
+        fprintf(stderr, "Usage: %s <tore> [bench]\n", program_name);
+        return 1;
+    }
+    tore_bin = shift(argv, argc);
+    bool bench = argc > 0 && strcmp(argv[0], "bench") == 0;
+
+    // The commands the scenarios run are not interesting unless they fail
+    minimal_log_level = WARNING;
+    // The scenarios expect the timestamps they store to be shown as they are
+    if (setenv("TZ", "UTC", 1) < 0) return 1;
+    // Every scenario resets the temporary storage
+    const char *cwd = get_current_dir_temp();
+    if (cwd == NULL) return 1;
+    char *current_dir = strdup(cwd);
+    if (!remove_tree(TEST_HOMES_FOLDER)) return 1;
+    if (!mkdir_if_not_exists(TEST_HOMES_FOLDER)) return 1;
+
+    if (bench) {
+        char *home = temp_sprintf("%s/"TEST_HOMES_FOLDER"bench", current_dir);
+        if (!mkdir_if_not_exists(home) || setenv("HOME", home, 1) < 0) return 1;
+        free(current_dir);
+        return bench_catch_up() && bench_period_advance() ? 0 : 1;
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < ARRAY_LEN(tests); ++i) {
+        printf("[TEST] %s\n", tests[i].name);
+        fflush(stdout);
+        // Every scenario starts with an empty home with no config
+        char *home = temp_sprintf("%s/"TEST_HOMES_FOLDER"%zu", current_dir, i);
+        if (!mkdir_if_not_exists(home) || setenv("HOME", home, 1) < 0) return 1;
+        test_home = strdup(home);
+        if (!tests[i].run()) {
+            printf("[FAILED] %s, see %s\n", tests[i].name, test_home);
+            failed += 1;
+        }
+        free((char *)test_home);
+        temp_reset();
+    }
+    printf("%zu out of %zu tests passed\n", ARRAY_LEN(tests) - failed, ARRAY_LEN(tests));
+    free(current_dir);
+    return failed == 0 ? 0 : 1;
+}